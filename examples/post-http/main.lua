@@ -2,6 +2,11 @@
 -- This example makes usage of lit-installed luvit modules.
 -- Before running, make sure you install all the dependencies via `lit install`.
 --
+-- Run with `--checkpoint-dir <dir> --manual-ack` so that logs are only
+-- checkpointed once they and the logs before them have been posted
+-- (at-least-once delivery). A log whose post failed is never acked, so it is
+-- read again after a restart even if later ones were posted.
+--
 local logd = require("logd")
 local JSON = require('json')
 local URL = require('url')
@@ -75,6 +80,7 @@ function logd.on_log(logptr)
 	event.time = logd.log_get(logptr, 'time')
 	event.msg = logd.log_get(logptr, 'msg')
 
+	local mark = logd.mark()
 	post_event('https://unstable.build/log', event, function(err)
 		if err ~= nil then
 			logd.print({
@@ -83,12 +89,14 @@ function logd.on_log(logptr)
 			})
 			return
 		end
+		logd.ack(mark)
 		logd.print('Yay!')
 	end)
 end
 
 function logd.on_error(msg, logptr, at)
 	errors = errors + 1
+	logd.ack()
 	logd.print({
 		level = 'ERROR',
 		err = msg,
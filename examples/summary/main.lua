@@ -6,7 +6,7 @@ local logd = require("logd")
 local logs = 0
 local errors = 0
 
-function logd.on_log(logptr)
+local function summarize(logptr)
 	logs = logs + 1
 
 	local date = logd.log_get(logptr, "date")
@@ -15,6 +15,17 @@ function logd.on_log(logptr)
 	logd.print(string.format('scanned log with date %s and time %s', date, time))
 end
 
+-- LOGD_ON_LOGS=1 takes all the logs scanned at once in a single call
+if os.getenv("LOGD_ON_LOGS") then
+	function logd.on_logs(logptrs, n)
+		for i = 1, n do
+			summarize(logptrs[i])
+		end
+	end
+else
+	logd.on_log = summarize
+end
+
 function logd.on_error(msg, logptr, at)
 	errors = errors + 1
 	logd.print({
@@ -0,0 +1,160 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "util.h"
+
+#define CHECKPOINT_SUFFIX ".checkpoint"
+#define CHECKPOINT_TMP_SUFFIX ".tmp"
+#define CHECKPOINT_FMT "%" PRIu64 " %" PRIu64 " %" PRId64 "\n"
+#define CHECKPOINT_SCAN_FMT "%" SCNu64 " %" SCNu64 " %" SCNd64
+/* two 20 digit unsigned, one signed, separators and new line */
+#define CHECKPOINT_MAX_LEN 72
+
+char* checkpoint_path(const char* dir, const char* input_file)
+{
+	size_t dir_len = strlen(dir);
+	const char* c;
+	char *path, *p;
+
+	/* worst case every character of input_file is escaped */
+	path = malloc(dir_len + 1 + strlen(input_file) * 3 +
+	  sizeof(CHECKPOINT_SUFFIX));
+	if (path == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	memcpy(path, dir, dir_len);
+	p = path + dir_len;
+	*p++ = '/';
+
+	/* escape input_file into a single path component */
+	for (c = input_file; *c != '\0'; c++) {
+		switch (*c) {
+		case '/':
+			memcpy(p, "%2F", 3);
+			p += 3;
+			break;
+		case '%':
+			memcpy(p, "%25", 3);
+			p += 3;
+			break;
+		default:
+			*p++ = *c;
+		}
+	}
+
+	memcpy(p, CHECKPOINT_SUFFIX, sizeof(CHECKPOINT_SUFFIX));
+
+	return path;
+}
+
+int checkpoint_load(const char* path, checkpoint_t* cp)
+{
+	char buf[CHECKPOINT_MAX_LEN + 1];
+	ssize_t len;
+	int fd, lerrno;
+
+	do {
+		errno = 0;
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+		return 1;
+
+	do {
+		errno = 0;
+		len = read(fd, buf, CHECKPOINT_MAX_LEN);
+	} while (len == -1 && errno == EINTR);
+	lerrno = errno;
+	UNEINTR2(close(fd));
+
+	if (len < 0) {
+		errno = lerrno;
+		return 1;
+	}
+	buf[len] = '\0';
+
+	if (sscanf(buf, CHECKPOINT_SCAN_FMT, &cp->dev, &cp->ino, &cp->offset) !=
+	    3 ||
+	  cp->offset < 0) {
+		errno = EINVAL;
+		return 1;
+	}
+
+	return 0;
+}
+
+int checkpoint_save(const char* path, const checkpoint_t* cp)
+{
+	char buf[CHECKPOINT_MAX_LEN + 1];
+	char* tmp_path = NULL;
+	int fd = -1, len, ret = 1, lerrno;
+
+	len = snprintf(buf, sizeof(buf), CHECKPOINT_FMT, cp->dev, cp->ino,
+	  cp->offset);
+
+	if ((tmp_path = malloc(strlen(path) + sizeof(CHECKPOINT_TMP_SUFFIX))) ==
+	  NULL) {
+		errno = ENOMEM;
+		goto exit;
+	}
+	sprintf(tmp_path, "%s" CHECKPOINT_TMP_SUFFIX, path);
+
+	do {
+		errno = 0;
+		fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+		goto exit;
+
+	/* checkpoints are tiny so a short write is an error */
+	errno = 0;
+	if (write(fd, buf, len) != len) {
+		if (errno == 0)
+			errno = EIO;
+		goto exit;
+	}
+
+	if (fsync(fd) != 0)
+		goto exit;
+
+	if (rename(tmp_path, path) != 0)
+		goto exit;
+
+	ret = 0;
+
+exit:
+	lerrno = errno;
+	if (fd != -1)
+		UNEINTR2(close(fd));
+	if (tmp_path)
+		free(tmp_path);
+	errno = lerrno;
+	return ret;
+}
+
+int checkpoint_sync_dir(const char* dir)
+{
+	int fd, ret = 0;
+
+	do {
+		errno = 0;
+		fd = open(dir, O_RDONLY | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+		return 1;
+
+	if (fsync(fd) != 0)
+		ret = 1;
+
+	UNEINTR2(close(fd));
+
+	return ret;
+}
@@ -0,0 +1,27 @@
+#ifndef LOGD_CHECKPOINT_H
+#define LOGD_CHECKPOINT_H
+
+#include <stdint.h>
+
+/* position right after the last log of a file that was fully consumed */
+typedef struct checkpoint_s {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t offset;
+} checkpoint_t;
+
+/* checkpoint_path returns a malloc'd path inside dir that is unique to
+ * input_file */
+char* checkpoint_path(const char* dir, const char* input_file);
+/* checkpoint_load reads a checkpoint saved with checkpoint_save; it returns 0
+ * on success and 1 otherwise with errno set to ENOENT if there is no
+ * checkpoint at path yet */
+int checkpoint_load(const char* path, checkpoint_t* cp);
+/* checkpoint_save atomically replaces the checkpoint at path and fsyncs it.
+ * The directory entry is not synced: see checkpoint_sync_dir */
+int checkpoint_save(const char* path, const checkpoint_t* cp);
+/* checkpoint_sync_dir fsyncs dir so renames done by checkpoint_save are
+ * durable. It is meant to be called once after saving a batch */
+int checkpoint_sync_dir(const char* dir);
+
+#endif
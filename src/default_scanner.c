@@ -6,6 +6,7 @@
 #include "./config.h"
 #include "./default_scanner.h"
 #include "./scanner.h"
+#include "./simd.h"
 #include "./util.h"
 
 #define TRIM_SPACES(p, SET_MACRO, label, END_MACRO)                            \
@@ -23,15 +24,60 @@
 		goto label;                                                            \
 	}
 
+/* like TRIM_SPACES before the calltype but the calltype prop, which was added
+ * at the end of the class, is left to scan_body with the rest of the line */
+#define TRIM_SPACES_BODY(p)                                                    \
+	switch ((p)->token) {                                                      \
+	case '\n':                                                                 \
+		SCAN_END_MESSAGE(p);                                                   \
+		return (p)->res;                                                       \
+	case '\t':                                                                 \
+	case ' ':                                                                  \
+		SKIP(p);                                                               \
+		break;                                                                 \
+	default:                                                                   \
+		REMOVE_PROP(p);                                                        \
+		(p)->body.start = (p)->chunk;                                          \
+		(p)->state = BODY_PSTATE;                                              \
+		goto body;                                                             \
+	}
+
 #define SCAN_END_MESSAGE(p)                                                   \
-	SET_KEY((p), KEY_MESSAGE);                                                 \
+	SET_KEY_ID(p, KEY_MESSAGE, KEY_ID_MESSAGE);                                \
 	SET_VALUE(p, (p)->chunk);                                                  \
-	COMMIT(p);                                                                 \
+	COMMIT_VALUE(p);                                                           \
 	(p)->res.type = SCAN_COMPLETE;
 
 #define SCAN_END(p)                                                           \
 	SET_VALUE(p, (p)->chunk);                                                  \
-	COMMIT(p);                                                                 \
+	COMMIT_VALUE(p);                                                           \
+	(p)->res.type = SCAN_COMPLETE;
+
+/* the token being scanned may have started in a previous chunk so its start
+ * is taken from where it was recorded instead of from (p)->chunk */
+#define SCAN_END_KEY_MESSAGE(p)                                               \
+	SET_VALUE(p, (p)->result.props->key);                                      \
+	SET_KEY_ID(p, KEY_MESSAGE, KEY_ID_MESSAGE);                                \
+	COMMIT_VALUE(p);                                                           \
+	(p)->res.type = SCAN_COMPLETE;
+
+#define SCAN_END_VALUE_MESSAGE(p)                                             \
+	SET_KEY_ID(p, KEY_MESSAGE, KEY_ID_MESSAGE);                                \
+	COMMIT_VALUE(p);                                                           \
+	(p)->res.type = SCAN_COMPLETE;
+
+#define SCAN_END_VALUE(p)                                                     \
+	COMMIT_VALUE(p);                                                           \
+	(p)->res.type = SCAN_COMPLETE;
+
+/* the line end is left in place for scan_body */
+#define SCAN_END_BODY(p)                                                       \
+	(p)->body.len = (p)->chunk + (p)->blen - (p)->body.start;                  \
+	(p)->body.pslab = (p)->pslab;                                              \
+	(p)->body.pnext = (p)->pnext;                                              \
+	(p)->body.at = (p)->result.props;                                          \
+	(p)->body.scan = &scan_body;                                               \
+	(p)->result.body = &(p)->body;                                             \
 	(p)->res.type = SCAN_COMPLETE;
 
 #define SCANNER_END_ERROR_INCOMPLETE(p)                                         \
@@ -42,11 +88,11 @@
 #define SCANNER_SCAN_NEXT_KEY(p)                                               \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
-		SCAN_END_MESSAGE(p);                                                  \
+		SCAN_END_KEY_MESSAGE(p);                                              \
 		return (p)->res;                                                       \
 	case ':':                                                                  \
 	case '\x00': /* re-submitted partial data */                               \
-		COMMIT(p);                                                             \
+		COMMIT_KEY(p);                                                         \
 		(p)->state = TRANSITIONVALUE_PSTATE;                                   \
 		break;                                                                 \
 	default:                                                                   \
@@ -57,11 +103,11 @@
 #define SCANNER_SCAN_NEXT_VALUE(p)                                             \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
-		SCAN_END(p);                                                          \
+		SCAN_END_VALUE(p);                                                    \
 		return (p)->res;                                                       \
 	case ',':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		TRY_ADD_PROP(p, ERROR_PSTATE);                                         \
 		(p)->state = TRANSITIONKEY_PSTATE;                                     \
 		break;                                                                 \
@@ -70,7 +116,7 @@
 		break;                                                                 \
 	}
 
-#define SCANNER_SCAN_NEXT_DATE(p, next_key)                                    \
+#define SCANNER_SCAN_NEXT_DATE(p, next_key, next_id)                           \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
 		SCANNER_END_ERROR_INCOMPLETE(p);                                        \
@@ -102,9 +148,9 @@
 	case ']':                                                                  \
 	case '\t':                                                                 \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		ADD_PROP(p);                                                           \
-		SET_KEY(p, next_key);                                                  \
+		SET_KEY_ID(p, next_key, next_id);                                      \
 		SET_VALUE(p, (p)->chunk);                                              \
 		(p)->state++;                                                          \
 		break;                                                                 \
@@ -116,7 +162,7 @@
 		break;                                                                 \
 	}
 
-#define SCANNER_SCAN_NEXT_HEADER(p, next_key)                                  \
+#define SCANNER_SCAN_NEXT_HEADER(p, next_key, next_id)                         \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
 		SCANNER_END_ERROR_INCOMPLETE(p);                                        \
@@ -129,9 +175,9 @@
 	case ' ':                                                                  \
 	case ']':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		ADD_PROP(p);                                                           \
-		SET_KEY(p, next_key);                                                  \
+		SET_KEY_ID(p, next_key, next_id);                                      \
 		(p)->state++;                                                          \
 		break;                                                                 \
 	default:                                                                   \
@@ -147,9 +193,9 @@
 	case ']':                                                                  \
 	case '\t':                                                                 \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		ADD_PROP(p);                                                           \
-		SET_KEY(p, KEY_CLASS);                                                 \
+		SET_KEY_ID(p, KEY_CLASS, KEY_ID_CLASS);                                \
 		(p)->state = TRANSITIONCLASS_PSTATE;                                   \
 		break;                                                                 \
 	default:                                                                   \
@@ -169,18 +215,18 @@
 		break;                                                                 \
 	default:                                                                   \
 		(p)->state = THREADNOBRACKET_PSTATE;                                   \
-		SCANNER_SCAN_NEXT_HEADER(p, KEY_CLASS);                                \
+		SCANNER_SCAN_NEXT_HEADER(p, KEY_CLASS, KEY_ID_CLASS);                  \
 		break;                                                                 \
 	}
 
 #define SCANNER_SCAN_NEXT_CALLTYPE(p)                                          \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
-		SCAN_END_MESSAGE(p);                                                  \
+		SCAN_END_VALUE_MESSAGE(p);                                            \
 		return (p)->res;                                                       \
 	case ':':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		ADD_PROP(p);                                                           \
 		(p)->state++;                                                          \
 		break;                                                                 \
@@ -192,11 +238,13 @@
 #define SCANNER_SCAN_VERIFY_CALLTYPE(p)                                        \
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
-		SCAN_END_MESSAGE(p);                                                  \
+		SCAN_END_KEY_MESSAGE(p);                                              \
 		return (p)->res;                                                       \
 	case ',':                                                                  \
 		(p)->result.props->next->key = (p)->result.props->next->value;         \
-		(p)->result.props->next->value = (p)->chunk;                           \
+		(p)->result.props->next->klen = (p)->result.props->next->vlen;         \
+		(p)->result.props->next->kid = KEY_ID_NONE;                            \
+		(p)->result.props->next->value = (p)->result.props->key;               \
 		REMOVE_PROP(p);                                                        \
 		SCANNER_SCAN_NEXT_VALUE(p);                                            \
 		break;                                                                 \
@@ -205,6 +253,18 @@
 		break;                                                                 \
 	}
 
+#define SCANNER_SCAN_BODY(p)                                                   \
+	switch ((p)->token) {                                                      \
+	case '\n':                                                                 \
+		SCAN_END_BODY(p);                                                      \
+		return (p)->res;                                                       \
+	default:                                                                   \
+		(p)->blen++;                                                           \
+		break;                                                                 \
+	}
+
+static prop_t* scan_body(log_body_t* body);
+
 void* scanner_create()
 {
 	scanner_t* p = NULL;
@@ -239,7 +299,25 @@ void scanner_reset(void* _p)
 	LOGD_SCANNER_RESET(p);
 
 	ADD_PROP(p);
-	SET_KEY(p, KEY_DATE);
+	SET_KEY_ID(p, KEY_DATE, KEY_ID_DATE);
+}
+
+void scanner_rebase(void* _p, const char* start, size_t len, ptrdiff_t delta)
+{
+	scanner_t* p = (scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+
+	LOGD_SCANNER_REBASE(p, start, len, delta);
+}
+
+void scanner_set_lazy(void* _p, bool lazy)
+{
+	scanner_t* p = (scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+
+	p->lazy = lazy;
 }
 
 void scanner_init(void* _p, prop_t* pslab)
@@ -261,9 +339,15 @@ void scanner_free(void* _p)
 	free(p);
 }
 
+/* every byte that ends a key or a value. Keys do not end on ',' and values
+ * do not end on ':' but stopping there too just falls back to the switch */
+static const char kv_delims[4] = {'\n', ':', ',', '\x00'};
+
 scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 {
 	scanner_t* p = (scanner_t*)_p;
+	const char* line;
+	size_t skip;
 
 	DEBUG_ASSERT(p != NULL);
 	DEBUG_ASSERT(chunk != NULL);
@@ -273,6 +357,26 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 	p->res.consumed = 0;
 
 	while (p->res.consumed < clen) {
+		/* bytes inside of keys and values only need counting */
+		if (p->state == KEY_PSTATE || p->state == VALUE_PSTATE) {
+			skip = simd_find4(
+			  chunk + p->res.consumed, clen - p->res.consumed, kv_delims);
+			p->blen += skip;
+			p->res.consumed += skip;
+			if (p->res.consumed == clen)
+				break;
+		}
+		/* and so do the bytes of a body that is not scanned yet */
+		if (p->state == BODY_PSTATE) {
+			line = memchr(
+			  chunk + p->res.consumed, '\n', clen - p->res.consumed);
+			skip = line != NULL ? line - (chunk + p->res.consumed)
+								: clen - p->res.consumed;
+			p->blen += skip;
+			p->res.consumed += skip;
+			if (p->res.consumed == clen)
+				break;
+		}
 		p->token = chunk[p->res.consumed++];
 		switch (p->state) {
 		case INIT_PSTATE:
@@ -280,14 +384,14 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 			break;
 		case DATE_PSTATE:
 		date:
-			SCANNER_SCAN_NEXT_DATE(p, KEY_TIME);
+			SCANNER_SCAN_NEXT_DATE(p, KEY_TIME, KEY_ID_TIME);
 			break;
 		case TIME_PSTATE:
-			SCANNER_SCAN_NEXT_DATE(p, KEY_LEVEL);
+			SCANNER_SCAN_NEXT_DATE(p, KEY_LEVEL, KEY_ID_LEVEL);
 			break;
 		case LEVEL_PSTATE:
 		level:
-			SCANNER_SCAN_NEXT_HEADER(p, KEY_THREAD);
+			SCANNER_SCAN_NEXT_HEADER(p, KEY_THREAD, KEY_ID_THREAD);
 			break;
 		case THREAD_PSTATE:
 		thread:
@@ -297,11 +401,11 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 			SCANNER_SCAN_NEXT_THREAD_BRACKET(p);
 			break;
 		case THREADNOBRACKET_PSTATE:
-			SCANNER_SCAN_NEXT_HEADER(p, KEY_CLASS);
+			SCANNER_SCAN_NEXT_HEADER(p, KEY_CLASS, KEY_ID_CLASS);
 			break;
 		case CLASS_PSTATE:
 		clazz:
-			SCANNER_SCAN_NEXT_HEADER(p, KEY_CALLTYPE);
+			SCANNER_SCAN_NEXT_HEADER(p, KEY_CALLTYPE, KEY_ID_CALLTYPE);
 			break;
 		case CALLTYPE_PSTATE:
 		calltype:
@@ -332,7 +436,15 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 			TRIM_SPACES(p, SET_VALUE, thread, SCANNER_END_ERROR_INCOMPLETE);
 			break;
 		case TRANSITIONCALLTYPE_PSTATE:
-			TRIM_SPACES(p, SET_VALUE, calltype, SCAN_END_MESSAGE);
+			if (p->lazy) {
+				TRIM_SPACES_BODY(p);
+			} else {
+				TRIM_SPACES(p, SET_VALUE, calltype, SCAN_END_MESSAGE);
+			}
+			break;
+		case BODY_PSTATE:
+		body:
+			SCANNER_SCAN_BODY(p);
 			break;
 		case TRANSITIONCLASS_PSTATE:
 			TRIM_SPACES(p, SET_VALUE, clazz, SCANNER_END_ERROR_INCOMPLETE);
@@ -349,3 +461,39 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 
 	return p->res;
 }
+
+/* scan_body scans the body that a lazy scanner left behind as it would have
+ * been scanned right after the class */
+static prop_t* scan_body(log_body_t* body)
+{
+	scanner_t p;
+
+	p.state = TRANSITIONCALLTYPE_PSTATE;
+	p.lazy = false;
+	p.pslab = body->pslab;
+	p.pnext = body->pnext;
+	log_init(&p.result);
+	p.result.props = body->at;
+	p.res.log = &p.result;
+	p.res.type = SCAN_PARTIAL;
+
+	ADD_PROP(&p);
+	SET_KEY_ID(&p, KEY_CALLTYPE, KEY_ID_CALLTYPE);
+
+	/* errors cannot be reported anymore: the props scanned until then stay */
+	scanner_scan(&p, body->start, body->len + 1);
+	DEBUG_ASSERT(p.res.type != SCAN_PARTIAL);
+
+	return p.result.props;
+}
+
+size_t scanner_scan_batch(
+  void* _p, char* chunk, size_t clen, scan_batch_t* batch)
+{
+	scanner_t* p = (scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+	DEBUG_ASSERT(batch != NULL);
+
+	LOGD_SCANNER_SCAN_BATCH(p, scanner_scan, scanner_reset, chunk, clen, batch);
+}
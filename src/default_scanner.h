@@ -29,10 +29,13 @@ typedef enum pstate_s {
 	TRANSITIONVALUE_PSTATE = 17,
 	VALUE_PSTATE = 18,
 	ERROR_PSTATE = 19,
+	BODY_PSTATE = 20, // IF LAZY, AFTER CLASS
 } pstate_t;
 
 typedef struct scanner_s {
 	pstate_t state;
+	/* the body after the class is only scanned once it is needed */
+	bool lazy;
 	LOGD_SCANNER_FIELDS
 } scanner_t;
 
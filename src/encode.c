@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./encode.h"
+#include "./util.h"
+
+/* first capacity of buffers, which then double as needed */
+#define ENCODE_BUF_MIN 512
+
+/* bytes that a byte can take in the worst case once escaped, as \u00XX */
+#define ESCAPED_MAX 6
+
+static const char hex[] = "0123456789abcdef";
+
+void encode_buf_init(encode_buf_t* b)
+{
+	b->data = NULL;
+	b->cap = 0;
+}
+
+void encode_buf_free(encode_buf_t* b)
+{
+	free(b->data);
+	encode_buf_init(b);
+}
+
+/* reserve makes room in b for want bytes after the used ones */
+static int reserve(encode_buf_t* b, size_t used, size_t want)
+{
+	size_t cap = b->cap > 0 ? b->cap : ENCODE_BUF_MIN;
+	char* data;
+
+	if (used + want <= b->cap)
+		return 0;
+
+	while (cap < used + want)
+		cap *= 2;
+
+	if ((data = realloc(b->data, cap)) == NULL)
+		return 1;
+
+	b->data = data;
+	b->cap = cap;
+
+	return 0;
+}
+
+/* shadowed returns whether p is hidden from log_get by a prop with the same
+ * key that was set after it */
+static bool shadowed(log_t* l, prop_t* p)
+{
+	return log_get_prop(l, p->key) != p;
+}
+
+/* json_escape writes the len bytes at s as the contents of a JSON string,
+ * which takes at most ESCAPED_MAX bytes per byte, and returns its end */
+static char* json_escape(char* out, const char* s, size_t len)
+{
+	const char* end = s + len;
+	unsigned char c;
+
+	for (; s < end; s++) {
+		c = *s;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			*out++ = c;
+			continue;
+		}
+
+		*out++ = '\\';
+		switch (c) {
+		case '"':
+		case '\\':
+			*out++ = c;
+			break;
+		case '\n':
+			*out++ = 'n';
+			break;
+		case '\r':
+			*out++ = 'r';
+			break;
+		case '\t':
+			*out++ = 't';
+			break;
+		default:
+			*out++ = 'u';
+			*out++ = '0';
+			*out++ = '0';
+			*out++ = hex[c >> 4];
+			*out++ = hex[c & 0xf];
+			break;
+		}
+	}
+
+	return out;
+}
+
+char* encode_str(encode_buf_t* b, log_t* l, size_t* len)
+{
+	int want = snprintl(b->data, (int)b->cap, l);
+
+	if (want < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* logs that do not fit are written again once there is room */
+	if ((size_t)want >= b->cap) {
+		if (reserve(b, 0, want + 1) != 0)
+			return NULL;
+		snprintl(b->data, (int)b->cap, l);
+	}
+
+	*len = want;
+	return b->data;
+}
+
+char* encode_json(encode_buf_t* b, log_t* l, size_t* len)
+{
+	size_t n = 0, klen, vlen;
+	prop_t* p;
+	char* out;
+
+	log_scan_body(l);
+
+	if (reserve(b, n, 2) != 0)
+		return NULL;
+	b->data[n++] = '{';
+
+	for (p = l->props; p != NULL && p->key != NULL; p = p->next) {
+		if (shadowed(l, p))
+			continue;
+
+		klen = log_key_len(p);
+		vlen = p->value != NULL ? log_value_len(p) : 0;
+		/* a comma, the quotes of the key, a colon, the quotes of the value or
+		 * null, and the closing brace */
+		if (reserve(b, n, ESCAPED_MAX * (klen + vlen) + 9) != 0)
+			return NULL;
+
+		out = b->data + n;
+		if (n > 1)
+			*out++ = ',';
+		*out++ = '"';
+		out = json_escape(out, p->key, klen);
+		*out++ = '"';
+		*out++ = ':';
+		if (p->value == NULL) {
+			memcpy(out, "null", 4);
+			out += 4;
+		} else {
+			*out++ = '"';
+			out = json_escape(out, p->value, vlen);
+			*out++ = '"';
+		}
+		n = out - b->data;
+	}
+
+	b->data[n++] = '}';
+	*len = n;
+
+	return b->data;
+}
+
+static bool logfmt_special(unsigned char c)
+{
+	return c <= ' ' || c == '=' || c == '"' || c == 0x7f;
+}
+
+char* encode_logfmt(encode_buf_t* b, log_t* l, size_t* len)
+{
+	size_t n = 0, klen, vlen, i;
+	bool quote;
+	prop_t* p;
+	char* out;
+
+	log_scan_body(l);
+
+	for (p = l->props; p != NULL && p->key != NULL; p = p->next) {
+		if (shadowed(l, p))
+			continue;
+
+		klen = log_key_len(p);
+		vlen = p->value != NULL ? log_value_len(p) : 0;
+		/* a space, the equals sign and the quotes of the value or null */
+		if (reserve(b, n, klen + ESCAPED_MAX * vlen + 6) != 0)
+			return NULL;
+
+		out = b->data + n;
+		if (n > 0)
+			*out++ = ' ';
+		for (i = 0; i < klen; i++)
+			*out++ = logfmt_special(p->key[i]) ? '_' : p->key[i];
+		*out++ = '=';
+
+		if (p->value == NULL) {
+			memcpy(out, "null", 4);
+			out += 4;
+			n = out - b->data;
+			continue;
+		}
+
+		for (quote = vlen == 0, i = 0; !quote && i < vlen; i++)
+			quote = logfmt_special(p->value[i]);
+
+		if (quote) {
+			*out++ = '"';
+			out = json_escape(out, p->value, vlen);
+			*out++ = '"';
+		} else {
+			memcpy(out, p->value, vlen);
+			out += vlen;
+		}
+		n = out - b->data;
+	}
+
+	/* so that empty logs do not return NULL */
+	if (reserve(b, n, 1) != 0)
+		return NULL;
+	*len = n;
+
+	return b->data;
+}
+
+static char* put_be16(char* out, uint16_t v)
+{
+	*out++ = v >> 8;
+	*out++ = v;
+
+	return out;
+}
+
+static char* put_be32(char* out, uint32_t v)
+{
+	out = put_be16(out, v >> 16);
+
+	return put_be16(out, v);
+}
+
+/* msgpack_str writes len bytes at s as a MessagePack string, which takes at
+ * most 5 bytes more than s */
+static char* msgpack_str(char* out, const char* s, size_t len)
+{
+	if (len <= 31) {
+		*out++ = 0xa0 | len;
+	} else if (len <= UINT8_MAX) {
+		*out++ = 0xd9;
+		*out++ = len;
+	} else if (len <= UINT16_MAX) {
+		*out++ = 0xda;
+		out = put_be16(out, len);
+	} else {
+		*out++ = 0xdb;
+		out = put_be32(out, len);
+	}
+
+	memcpy(out, s, len);
+	return out + len;
+}
+
+/* msgpack maps start with their size, which is only known at the end, so
+ * there is room left for the biggest header in front of them */
+#define MSGPACK_MAP_HEADER_MAX 5
+
+char* encode_msgpack(encode_buf_t* b, log_t* l, size_t* len)
+{
+	size_t n = MSGPACK_MAP_HEADER_MAX, klen, vlen, start;
+	uint32_t pairs = 0;
+	prop_t* p;
+	char* out;
+
+	log_scan_body(l);
+
+	if (reserve(b, 0, n) != 0)
+		return NULL;
+
+	for (p = l->props; p != NULL && p->key != NULL; p = p->next) {
+		if (shadowed(l, p))
+			continue;
+
+		klen = log_key_len(p);
+		vlen = p->value != NULL ? log_value_len(p) : 0;
+		if (reserve(b, n, klen + vlen + 10) != 0)
+			return NULL;
+
+		out = msgpack_str(b->data + n, p->key, klen);
+		if (p->value == NULL)
+			*out++ = 0xc0;
+		else
+			out = msgpack_str(out, p->value, vlen);
+		n = out - b->data;
+		pairs++;
+	}
+
+	if (pairs <= 15) {
+		start = MSGPACK_MAP_HEADER_MAX - 1;
+		b->data[start] = 0x80 | pairs;
+	} else if (pairs <= UINT16_MAX) {
+		start = MSGPACK_MAP_HEADER_MAX - 3;
+		b->data[start] = 0xde;
+		put_be16(b->data + start + 1, pairs);
+	} else {
+		start = 0;
+		b->data[start] = 0xdf;
+		put_be32(b->data + start + 1, pairs);
+	}
+	*len = n - start;
+
+	return b->data + start;
+}
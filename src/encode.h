@@ -0,0 +1,39 @@
+#ifndef LOGD_ENCODE_H
+#define LOGD_ENCODE_H
+
+#include <stddef.h>
+
+#include "log.h"
+
+/* scratch buffer that logs are serialized into, which grows as needed and is
+ * reused by every call so that serializing a log does not allocate */
+typedef struct encode_buf_s {
+	char* data;
+	size_t cap;
+} encode_buf_t;
+
+void encode_buf_init(encode_buf_t* b);
+void encode_buf_free(encode_buf_t* b);
+
+/*
+ * The following serialize the properties of l into b and return the start of
+ * the result and its length in len, or NULL with errno set if b could not
+ * grow. Results are only valid until the next call with b.
+ *
+ * Other than with encode_str, keys that were set more than once are written
+ * once, with the value that log_get returns, and props without a value are
+ * written as null. Bytes that are not ASCII are copied as they are.
+ */
+
+/* encode_str serializes l like snprintl */
+char* encode_str(encode_buf_t* b, log_t* l, size_t* len);
+/* encode_json serializes l into a JSON object of strings */
+char* encode_json(encode_buf_t* b, log_t* l, size_t* len);
+/* encode_logfmt serializes l into space separated key=value pairs. Values
+ * are quoted if they are empty or have spaces, quotes, '=' or control
+ * characters in them, and those characters are replaced with '_' in keys */
+char* encode_logfmt(encode_buf_t* b, log_t* l, size_t* len);
+/* encode_msgpack serializes l into a MessagePack map of strings */
+char* encode_msgpack(encode_buf_t* b, log_t* l, size_t* len);
+
+#endif
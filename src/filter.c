@@ -0,0 +1,463 @@
+#include <errno.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./filter.h"
+#include "./keys.h"
+#include "./util.h"
+
+#define FILTER_AND "and"
+#define FILTER_OR "or"
+#define FILTER_NOT "not"
+#define FILTER_IN "in"
+
+enum op_e {
+	OR_OP,
+	AND_OP,
+	NOT_OP,
+	/* conditions on a property */
+	EXISTS_OP,
+	EQ_OP,
+	NE_OP,
+	PREFIX_OP,
+	MATCH_OP,
+	IN_OP,
+};
+
+typedef struct value_s {
+	char* s;
+	size_t len;
+} value_t;
+
+typedef struct node_s {
+	enum op_e op;
+	/* operands of OR, AND and NOT */
+	int a, b;
+	/* key of conditions and its id, or KEY_ID_NONE if it did not fit in the
+	 * registry */
+	char* key;
+	size_t klen;
+	uint32_t id;
+	/* values of EQ, NE, PREFIX and IN */
+	value_t* values;
+	int values_len;
+	/* compiled value of MATCH */
+	regex_t re;
+} node_t;
+
+struct filter_s {
+	node_t* nodes;
+	int nodes_len;
+	int root;
+};
+
+enum tok_e {
+	END_TOK,
+	WORD_TOK,
+	STR_TOK,
+	LPAREN_TOK,
+	RPAREN_TOK,
+	COMMA_TOK,
+	EQ_TOK,
+	NE_TOK,
+	PREFIX_TOK,
+	MATCH_TOK,
+	ERROR_TOK,
+};
+
+typedef struct parser_s {
+	filter_t* f;
+	/* rest of the expression after the current token */
+	const char* s;
+	enum tok_e tok;
+	/* text of words and of quoted strings without their quotes */
+	const char* text;
+	size_t len;
+	const char* err;
+} parser_t;
+
+/* is_op returns whether s starts with '!=' or '^=' */
+static int is_op(const char* s)
+{
+	return (s[0] == '!' || s[0] == '^') && s[1] == '=';
+}
+
+static int is_word(const char* s)
+{
+	if (is_op(s))
+		return 0;
+
+	switch (*s) {
+	case '\0':
+	case ' ':
+	case '\t':
+	case '\n':
+	case '(':
+	case ')':
+	case ',':
+	case '=':
+	case '~':
+	case '\'':
+	case '"':
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+/* next moves on to the next token. '!' and '^' are only operators when they
+ * are followed by '=' so that they can be in words */
+static void next(parser_t* p)
+{
+	const char* s = p->s;
+	char quote;
+
+	while (*s == ' ' || *s == '\t' || *s == '\n')
+		s++;
+
+	p->text = s;
+	p->len = 1;
+	switch (*s) {
+	case '\0':
+		p->tok = END_TOK;
+		p->len = 0;
+		break;
+	case '(':
+		p->tok = LPAREN_TOK;
+		break;
+	case ')':
+		p->tok = RPAREN_TOK;
+		break;
+	case ',':
+		p->tok = COMMA_TOK;
+		break;
+	case '=':
+		p->tok = EQ_TOK;
+		break;
+	case '~':
+		p->tok = MATCH_TOK;
+		break;
+	case '\'':
+	case '"':
+		quote = *s;
+		p->text = ++s;
+		while (*s != quote && *s != '\0')
+			s++;
+		if (*s == '\0') {
+			p->tok = ERROR_TOK;
+			p->err = "unterminated quoted string";
+			break;
+		}
+		p->tok = STR_TOK;
+		p->len = s - p->text;
+		s++;
+		break;
+	default:
+		if (is_op(s)) {
+			p->tok = *s == '!' ? NE_TOK : PREFIX_TOK;
+			p->len = 2;
+			break;
+		}
+		while (is_word(s))
+			s++;
+		p->tok = WORD_TOK;
+		p->len = s - p->text;
+		break;
+	}
+
+	if (p->tok != STR_TOK && p->tok != WORD_TOK)
+		s += p->len;
+	p->s = s;
+}
+
+static int word_is(parser_t* p, const char* word)
+{
+	return p->tok == WORD_TOK && p->len == strlen(word) &&
+	  strncmp(p->text, word, p->len) == 0;
+}
+
+static int node_new(parser_t* p, enum op_e op, int a, int b)
+{
+	node_t* n = &p->f->nodes[p->f->nodes_len];
+
+	n->op = op;
+	n->a = a;
+	n->b = b;
+
+	return p->f->nodes_len++;
+}
+
+static int value_append(parser_t* p, node_t* n)
+{
+	value_t* values;
+
+	if (p->tok != WORD_TOK && p->tok != STR_TOK) {
+		p->err = p->err != NULL ? p->err : "expected a value";
+		return 1;
+	}
+
+	values = realloc(n->values, (n->values_len + 1) * sizeof(value_t));
+	if (values == NULL) {
+		p->err = strerror(errno);
+		return 1;
+	}
+	n->values = values;
+	if ((values[n->values_len].s = strndup(p->text, p->len)) == NULL) {
+		p->err = strerror(errno);
+		return 1;
+	}
+	values[n->values_len++].len = p->len;
+	next(p);
+
+	return 0;
+}
+
+static int parse_or(parser_t* p);
+
+static int parse_cond(parser_t* p)
+{
+	enum op_e op;
+	node_t* n;
+	int i;
+
+	if (p->tok != WORD_TOK && p->tok != STR_TOK) {
+		p->err = p->err != NULL ? p->err : "expected a key";
+		return -1;
+	}
+
+	i = node_new(p, EXISTS_OP, -1, -1);
+	n = &p->f->nodes[i];
+	if ((n->key = strndup(p->text, p->len)) == NULL) {
+		p->err = strerror(errno);
+		return -1;
+	}
+	n->klen = p->len;
+	if ((n->id = keys_id(n->key, n->klen)) == KEY_ID_UNINTERNED)
+		n->id = KEY_ID_NONE;
+	next(p);
+
+	switch (p->tok) {
+	case EQ_TOK:
+		op = EQ_OP;
+		break;
+	case NE_TOK:
+		op = NE_OP;
+		break;
+	case PREFIX_TOK:
+		op = PREFIX_OP;
+		break;
+	case MATCH_TOK:
+		op = MATCH_OP;
+		break;
+	default:
+		if (!word_is(p, FILTER_IN))
+			return i;
+		n->op = IN_OP;
+		next(p);
+		if (p->tok != LPAREN_TOK) {
+			p->err = "expected '(' after '" FILTER_IN "'";
+			return -1;
+		}
+		do {
+			next(p);
+			if (value_append(p, n) != 0)
+				return -1;
+		} while (p->tok == COMMA_TOK);
+		if (p->tok != RPAREN_TOK) {
+			p->err = "expected ',' or ')'";
+			return -1;
+		}
+		next(p);
+		return i;
+	}
+
+	next(p);
+	if (value_append(p, n) != 0)
+		return -1;
+
+	/* the op is only set once there is a regex to free */
+	if (op == MATCH_OP &&
+	  regcomp(&n->re, n->values[0].s, REG_EXTENDED | REG_NOSUB) != 0) {
+		p->err = "invalid regular expression";
+		return -1;
+	}
+	n->op = op;
+
+	return i;
+}
+
+static int parse_not(parser_t* p)
+{
+	int a;
+
+	if (word_is(p, FILTER_NOT)) {
+		next(p);
+		if ((a = parse_not(p)) < 0)
+			return -1;
+		return node_new(p, NOT_OP, a, -1);
+	}
+
+	if (p->tok != LPAREN_TOK)
+		return parse_cond(p);
+
+	next(p);
+	if ((a = parse_or(p)) < 0)
+		return -1;
+	if (p->tok != RPAREN_TOK) {
+		p->err = p->err != NULL ? p->err : "expected ')'";
+		return -1;
+	}
+	next(p);
+
+	return a;
+}
+
+static int parse_and(parser_t* p)
+{
+	int a, b;
+
+	if ((a = parse_not(p)) < 0)
+		return -1;
+
+	while (word_is(p, FILTER_AND)) {
+		next(p);
+		if ((b = parse_not(p)) < 0)
+			return -1;
+		a = node_new(p, AND_OP, a, b);
+	}
+
+	return a;
+}
+
+static int parse_or(parser_t* p)
+{
+	int a, b;
+
+	if ((a = parse_and(p)) < 0)
+		return -1;
+
+	while (word_is(p, FILTER_OR)) {
+		next(p);
+		if ((b = parse_and(p)) < 0)
+			return -1;
+		a = node_new(p, OR_OP, a, b);
+	}
+
+	return a;
+}
+
+filter_t* filter_compile(const char* expr)
+{
+	filter_t* f = NULL;
+	parser_t p;
+
+	/* every node takes at least one token, which takes at least one byte */
+	if ((f = calloc(1, sizeof(filter_t))) == NULL ||
+	  (f->nodes = calloc(strlen(expr) + 1, sizeof(node_t))) == NULL) {
+		perror("calloc");
+		goto error;
+	}
+
+	p = (parser_t){.f = f, .s = expr};
+	next(&p);
+	if ((f->root = parse_or(&p)) >= 0 && p.tok != END_TOK)
+		p.err = p.err != NULL ? p.err : "expected 'and', 'or' or the end";
+
+	if (p.err != NULL) {
+		fprintf(stderr, "invalid filter '%s': %s\n", expr, p.err);
+		goto error;
+	}
+
+	return f;
+
+error:
+	filter_free(f);
+	return NULL;
+}
+
+void filter_free(filter_t* f)
+{
+	node_t* n;
+	int i, j;
+
+	if (f == NULL)
+		return;
+
+	for (i = 0; f->nodes != NULL && i < f->nodes_len; i++) {
+		n = &f->nodes[i];
+		free(n->key);
+		for (j = 0; j < n->values_len; j++)
+			free(n->values[j].s);
+		free(n->values);
+		if (n->op == MATCH_OP)
+			regfree(&n->re);
+	}
+
+	free(f->nodes);
+	free(f);
+}
+
+static bool value_eq(const value_t* v, const prop_t* prop, size_t vlen)
+{
+	return v->len == vlen && memcmp(v->s, prop->value, vlen) == 0;
+}
+
+static bool match(const filter_t* f, int i, log_t* log)
+{
+	const node_t* n = &f->nodes[i];
+	prop_t* prop;
+	size_t vlen;
+	int j;
+
+	switch (n->op) {
+	case OR_OP:
+		return match(f, n->a, log) || match(f, n->b, log);
+	case AND_OP:
+		return match(f, n->a, log) && match(f, n->b, log);
+	case NOT_OP:
+		return !match(f, n->a, log);
+	default:
+		break;
+	}
+
+	if (n->id != KEY_ID_NONE)
+		prop = log_get_id(log, n->id, n->key, n->klen);
+	else
+		prop = log_get_prop(log, n->key);
+
+	if (prop == NULL)
+		return n->op == NE_OP;
+
+	vlen = log_value_len(prop);
+	switch (n->op) {
+	case EXISTS_OP:
+		return true;
+	case EQ_OP:
+		return value_eq(&n->values[0], prop, vlen);
+	case NE_OP:
+		return !value_eq(&n->values[0], prop, vlen);
+	case PREFIX_OP:
+		return n->values[0].len <= vlen &&
+		  memcmp(n->values[0].s, prop->value, n->values[0].len) == 0;
+	case MATCH_OP:
+		return regexec(&n->re, prop->value, 0, NULL, 0) == 0;
+	case IN_OP:
+		for (j = 0; j < n->values_len; j++) {
+			if (value_eq(&n->values[j], prop, vlen))
+				return true;
+		}
+		return false;
+	default:
+		abort(); /* not possible */
+	}
+}
+
+bool filter_match(const filter_t* f, log_t* log)
+{
+	DEBUG_ASSERT(f != NULL);
+	DEBUG_ASSERT(log != NULL);
+
+	return match(f, f->root, log);
+}
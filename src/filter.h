@@ -0,0 +1,35 @@
+#ifndef LOGD_FILTER_H
+#define LOGD_FILTER_H
+
+#include <stdbool.h>
+
+#include "log.h"
+
+/*
+ * Filters that logs have to pass before they are handed to lua, for example:
+ *
+ * level in (WARN, ERROR) and class ~ '^com\.acme'
+ *
+ * Conditions look at the property with the given key: 'key' passes if the log
+ * has it, 'key = value' and 'key != value' compare its value, 'key ^= value'
+ * checks that it starts with value, 'key ~ regex' matches it with a POSIX
+ * extended regular expression and 'key in (a, b, ...)' checks that it is one
+ * of the values. Logs that do not have the property only pass 'key != value'.
+ *
+ * Conditions are combined with 'and', 'or', 'not' and parentheses, in the
+ * usual order of precedence. Keys and values are words, or are quoted with
+ * ' or " if they have spaces, parentheses, commas or operators in them.
+ *
+ * Filters are compiled once into a tree of conditions whose keys are interned
+ * so that logs are looked up by id.
+ */
+typedef struct filter_s filter_t;
+
+/* filter_compile returns NULL and prints why if expr is not valid */
+filter_t* filter_compile(const char* expr);
+void filter_free(filter_t* f);
+
+/* filter_match returns whether log passes f */
+bool filter_match(const filter_t* f, log_t* log);
+
+#endif
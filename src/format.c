@@ -0,0 +1,548 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./config.h"
+#include "./format.h"
+#include "./simd.h"
+#include "./util.h"
+
+#define FORMAT_KV "kv"
+#define FORMAT_MAX_STATES 256
+
+#define ERROR_INVALID "invalid log header"
+#define ERROR_INCOMPLETE "incomplete header"
+#define ERROR_MAX_PROPS                                                        \
+	"reached max number of log properties: " STR(LOGD_SLAB_CAP)
+
+enum elem_e {
+	LIT_ELEM,
+	WS_ELEM,
+	FIELD_ELEM,
+	KV_ELEM,
+};
+
+typedef struct elem_s {
+	enum elem_e type;
+	/* byte of literals */
+	char c;
+	/* index in keys of fields */
+	int key;
+} elem_t;
+
+enum action_e {
+	/* the byte is part of the current token */
+	COUNT_ACTION,
+	/* the byte is not part of any token */
+	SKIP_ACTION,
+	/* the byte starts a field, or an empty field that it ends */
+	BEGIN_ACTION,
+	BEGIN_COMMIT_ACTION,
+	BEGIN_END_ACTION,
+	/* the byte ends the current value, and the log */
+	COMMIT_ACTION,
+	COMMIT_END_ACTION,
+	END_ACTION,
+	/* the byte starts or ends a key of %kv */
+	KEY_ACTION,
+	COMMIT_KEY_ACTION,
+	/* a key of %kv ended with the line so it is a message */
+	MESSAGE_END_ACTION,
+	/* the byte starts a value of %kv, or an empty value that it ends */
+	VALUE_ACTION,
+	EMPTY_ACTION,
+	EMPTY_END_ACTION,
+	/* the log does not match the format */
+	INVALID_ACTION,
+	INCOMPLETE_ACTION,
+	END_ERROR_ACTION,
+};
+
+typedef struct trans_s {
+	uint8_t next;
+	uint8_t action;
+	/* index in keys of the field that the action begins */
+	uint16_t key;
+} trans_t;
+
+typedef struct fstate_s {
+	trans_t trans[256];
+	/* bytes that do anything but being counted if there are up to 4, so that
+	 * the rest can be skipped in bulk */
+	int skippable;
+	char stops[4];
+} fstate_t;
+
+struct format_s {
+	fstate_t* states;
+	int states_len;
+	int start;
+	int error;
+	char** keys;
+	/* ids of keys, or KEY_ID_NONE if they did not fit in the registry */
+	uint32_t* ids;
+	int keys_len;
+};
+
+typedef struct format_scanner_s {
+	const format_t* format;
+	int state;
+	LOGD_SCANNER_FIELDS
+} format_scanner_t;
+
+static void set(fstate_t* st, unsigned char c, int next, int action, int key)
+{
+	st->trans[c] = (trans_t){.next = next, .action = action, .key = key};
+}
+
+static void set_all(fstate_t* st, int next, int action, int key)
+{
+	int c;
+
+	for (c = 0; c < 256; c++)
+		set(st, c, next, action, key);
+}
+
+static int elem_append(elem_t* elems, int* len, elem_t e)
+{
+	if (*len > 0 && elems[*len - 1].type == KV_ELEM)
+		return 1;
+	if (*len > 0 && e.type == WS_ELEM && elems[*len - 1].type == WS_ELEM)
+		return 0;
+	if (*len > 0 && (e.type == FIELD_ELEM || e.type == KV_ELEM) &&
+	  elems[*len - 1].type == FIELD_ELEM)
+		return 1;
+
+	elems[(*len)++] = e;
+
+	return 0;
+}
+
+/* format_parse returns why spec is not valid or NULL */
+static const char* format_parse(
+  format_t* f, const char* spec, elem_t* elems, int* len)
+{
+	const char* s = spec;
+	const char* name;
+	elem_t e;
+
+	*len = 0;
+	while (*s != '\0') {
+		e = (elem_t){.type = LIT_ELEM, .c = *s};
+		if (*s == ' ' || *s == '\t') {
+			e.type = WS_ELEM;
+			s++;
+		} else if (*s == '\\') {
+			if (s[1] == 't')
+				e.type = WS_ELEM;
+			else if (s[1] == '\\')
+				e.c = '\\';
+			else
+				return "unknown escape sequence";
+			s += 2;
+		} else if (*s == '%' && s[1] == '%') {
+			s += 2;
+		} else if (*s == '%') {
+			for (name = ++s; isalnum((unsigned char)*s) || *s == '_'; s++)
+				;
+			if (s == name)
+				return "expected a field name after '%'";
+			if (s - name == strlen(FORMAT_KV) &&
+			  strncmp(name, FORMAT_KV, s - name) == 0) {
+				e.type = KV_ELEM;
+			} else {
+				if (f->keys_len == LOGD_SLAB_CAP)
+					return "too many fields";
+				if ((f->keys[f->keys_len] = strndup(name, s - name)) == NULL)
+					return strerror(errno);
+				f->ids[f->keys_len] = keys_id(name, s - name);
+				if (f->ids[f->keys_len] == KEY_ID_UNINTERNED)
+					f->ids[f->keys_len] = KEY_ID_NONE;
+				e.type = FIELD_ELEM;
+				e.key = f->keys_len++;
+			}
+		} else if (*s == '\n') {
+			return "newlines end logs";
+		} else {
+			s++;
+		}
+
+		if (elem_append(elems, len, e) != 0)
+			return "fields must be separated by literals and %kv must come "
+				   "last";
+	}
+
+	return *len == 0 ? "empty format" : NULL;
+}
+
+static void format_build(format_t* f, elem_t* elems, int len, int* base)
+{
+	int i, c, n, next, term, end = base[len], error = end + 1;
+	fstate_t* st;
+
+	/* entry state of element i */
+#define ENTRY(i) ((i) < len ? base[(i)] : end)
+
+	st = &f->states[end];
+	set_all(st, error, INVALID_ACTION, 0);
+	set(st, '\n', end, END_ACTION, 0);
+	set(st, ' ', end, SKIP_ACTION, 0);
+	set(st, '\t', end, SKIP_ACTION, 0);
+	set(st, '\x00', end, SKIP_ACTION, 0);
+
+	st = &f->states[error];
+	set_all(st, error, COUNT_ACTION, 0);
+	set(st, '\n', error, END_ERROR_ACTION, 0);
+
+	/* backwards so that whitespace can take the transitions of what follows
+	 * it when it is done */
+	for (i = len - 1; i >= 0; i--) {
+		st = &f->states[base[i]];
+		switch (elems[i].type) {
+		case LIT_ELEM:
+			set_all(st, error, INVALID_ACTION, 0);
+			set(st, '\n', error, INCOMPLETE_ACTION, 0);
+			set(st, elems[i].c, ENTRY(i + 1), SKIP_ACTION, 0);
+			break;
+		case WS_ELEM:
+			*st = f->states[ENTRY(i + 1)];
+			set(st, ' ', base[i], SKIP_ACTION, 0);
+			set(st, '\t', base[i], SKIP_ACTION, 0);
+			break;
+		case FIELD_ELEM:
+			/* ends with what follows it: a literal that it consumes,
+			 * whitespace, or the line */
+			if (i + 1 == len) {
+				term = '\n';
+				next = end;
+			} else if (elems[i + 1].type == LIT_ELEM) {
+				term = elems[i + 1].c;
+				next = ENTRY(i + 2);
+			} else {
+				term = ' ';
+				next = base[i + 1];
+			}
+			set_all(st, base[i] + 1, BEGIN_ACTION, elems[i].key);
+			set_all(st + 1, base[i] + 1, COUNT_ACTION, 0);
+			if (term == '\n') {
+				set(st, '\n', next, BEGIN_END_ACTION, elems[i].key);
+				set(st + 1, '\n', next, COMMIT_END_ACTION, 0);
+				break;
+			}
+			set(st, '\n', error, INCOMPLETE_ACTION, 0);
+			set(st + 1, '\n', error, INCOMPLETE_ACTION, 0);
+			/* '\x00' is re-submitted data */
+			set(st, term, next, BEGIN_COMMIT_ACTION, elems[i].key);
+			set(st, '\x00', next, BEGIN_COMMIT_ACTION, elems[i].key);
+			set(st + 1, term, next, COMMIT_ACTION, 0);
+			set(st + 1, '\x00', next, COMMIT_ACTION, 0);
+			if (term == ' ') {
+				set(st, '\t', next, BEGIN_COMMIT_ACTION, elems[i].key);
+				set(st + 1, '\t', next, COMMIT_ACTION, 0);
+			}
+			break;
+		case KV_ELEM:
+			/* key transition, key, value transition and value */
+			set_all(st, base[i] + 1, KEY_ACTION, 0);
+			set(st, '\n', base[i], END_ACTION, 0);
+			set(st, ' ', base[i], SKIP_ACTION, 0);
+			set(st, '\t', base[i], SKIP_ACTION, 0);
+			set(st, ',', base[i], SKIP_ACTION, 0);
+			set(st, '\x00', base[i], SKIP_ACTION, 0);
+
+			set_all(st + 1, base[i] + 1, COUNT_ACTION, 0);
+			set(st + 1, '\n', base[i], MESSAGE_END_ACTION, 0);
+			set(st + 1, ':', base[i] + 2, COMMIT_KEY_ACTION, 0);
+			set(st + 1, '\x00', base[i] + 2, COMMIT_KEY_ACTION, 0);
+
+			set_all(st + 2, base[i] + 3, VALUE_ACTION, 0);
+			set(st + 2, '\n', base[i], EMPTY_END_ACTION, 0);
+			set(st + 2, ' ', base[i] + 2, SKIP_ACTION, 0);
+			set(st + 2, '\t', base[i] + 2, SKIP_ACTION, 0);
+			set(st + 2, ',', base[i], EMPTY_ACTION, 0);
+			set(st + 2, '\x00', base[i], EMPTY_ACTION, 0);
+
+			set_all(st + 3, base[i] + 3, COUNT_ACTION, 0);
+			set(st + 3, '\n', base[i], COMMIT_END_ACTION, 0);
+			set(st + 3, ',', base[i], COMMIT_ACTION, 0);
+			set(st + 3, '\x00', base[i], COMMIT_ACTION, 0);
+			break;
+		}
+	}
+#undef ENTRY
+
+	for (i = 0; i < f->states_len; i++) {
+		st = &f->states[i];
+		for (c = 0, n = 0; c < 256 && n <= 4; c++) {
+			if (st->trans[c].next == i && st->trans[c].action == COUNT_ACTION)
+				continue;
+			if (n < 4)
+				st->stops[n] = c;
+			n++;
+		}
+		if (n == 0 || n > 4)
+			continue;
+		st->skippable = 1;
+		for (; n < 4; n++)
+			st->stops[n] = st->stops[0];
+	}
+
+	f->start = base[0];
+	f->error = error;
+}
+
+format_t* format_compile(const char* spec)
+{
+	format_t* f = NULL;
+	elem_t* elems = NULL;
+	int* base = NULL;
+	const char* err;
+	int i, len;
+
+	if ((f = calloc(1, sizeof(format_t))) == NULL ||
+	  (f->keys = calloc(strlen(spec) + 1, sizeof(char*))) == NULL ||
+	  (f->ids = calloc(strlen(spec) + 1, sizeof(uint32_t))) == NULL ||
+	  (elems = calloc(strlen(spec) + 1, sizeof(elem_t))) == NULL ||
+	  (base = calloc(strlen(spec) + 1, sizeof(int))) == NULL) {
+		perror("calloc");
+		goto error;
+	}
+
+	if ((err = format_parse(f, spec, elems, &len)) != NULL) {
+		fprintf(stderr, "invalid format '%s': %s\n", spec, err);
+		goto error;
+	}
+
+	/* fields take a state for their first byte and one for the rest, and
+	 * %kv one for each of the transitions, keys and values */
+	for (i = 0; i < len; i++) {
+		base[i + 1] = base[i] + (elems[i].type == FIELD_ELEM ? 2 :
+									elems[i].type == KV_ELEM ? 4 : 1);
+	}
+	/* plus the end of the header and the error state */
+	f->states_len = base[len] + 2;
+	if (f->states_len > FORMAT_MAX_STATES) {
+		fprintf(stderr, "invalid format '%s': too long\n", spec);
+		goto error;
+	}
+
+	if ((f->states = calloc(f->states_len, sizeof(fstate_t))) == NULL) {
+		perror("calloc");
+		goto error;
+	}
+
+	format_build(f, elems, len, base);
+
+	free(elems);
+	free(base);
+
+	return f;
+
+error:
+	format_free(f);
+	free(elems);
+	free(base);
+	return NULL;
+}
+
+void format_free(format_t* f)
+{
+	int i;
+
+	if (f == NULL)
+		return;
+
+	for (i = 0; i < f->keys_len; i++)
+		free(f->keys[i]);
+	free(f->keys);
+	free(f->ids);
+	free(f->states);
+	free(f);
+}
+
+void format_scanner_reset(void* _p)
+{
+	format_scanner_t* p = (format_scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+
+	p->state = p->format->start;
+
+	LOGD_SCANNER_RESET(p);
+}
+
+void format_scanner_rebase(
+  void* _p, const char* start, size_t len, ptrdiff_t delta)
+{
+	format_scanner_t* p = (format_scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+
+	LOGD_SCANNER_REBASE(p, start, len, delta);
+}
+
+void format_scanner_free(void* _p)
+{
+	format_scanner_t* p = (format_scanner_t*)_p;
+
+	if (p == NULL)
+		return;
+
+	free(p->pslab);
+	free(p);
+}
+
+void* format_scanner_create(const format_t* f)
+{
+	format_scanner_t* p = NULL;
+	prop_t* pslab = NULL;
+
+	DEBUG_ASSERT(f != NULL);
+
+	if ((p = calloc(1, sizeof(format_scanner_t))) == NULL ||
+	  (pslab = calloc(LOGD_SLAB_CAP, sizeof(prop_t))) == NULL) {
+		perror("calloc");
+		goto error;
+	}
+
+	p->format = f;
+	p->pslab = pslab;
+	p->res.log = &p->result;
+	format_scanner_reset(p);
+
+	return (void*)p;
+
+error:
+	if (p)
+		free(p);
+	if (pslab)
+		free(pslab);
+	return NULL;
+}
+
+scan_res_t format_scanner_scan(void* _p, char* chunk, size_t clen)
+{
+	format_scanner_t* p = (format_scanner_t*)_p;
+	const fstate_t* states = p->format->states;
+	const fstate_t* st;
+	const trans_t* t;
+	size_t skip;
+
+	DEBUG_ASSERT(p != NULL);
+	DEBUG_ASSERT(chunk != NULL);
+
+	p->chunk = chunk;
+	p->blen = 0;
+	p->res.consumed = 0;
+
+	while (p->res.consumed < clen) {
+		st = &states[p->state];
+		if (st->skippable) {
+			skip = simd_find4(
+			  chunk + p->res.consumed, clen - p->res.consumed, st->stops);
+			p->blen += skip;
+			p->res.consumed += skip;
+			if (p->res.consumed == clen)
+				break;
+		}
+
+		p->token = chunk[p->res.consumed++];
+		t = &st->trans[(unsigned char)p->token];
+		p->state = t->next;
+
+		switch (t->action) {
+		case COUNT_ACTION:
+			p->blen++;
+			break;
+		case SKIP_ACTION:
+			SKIP(p);
+			break;
+		case BEGIN_ACTION:
+		case BEGIN_COMMIT_ACTION:
+		case BEGIN_END_ACTION:
+			ADD_PROP(p);
+			SET_KEY_ID(p, p->format->keys[t->key], p->format->ids[t->key]);
+			SET_VALUE(p, p->chunk);
+			if (t->action == BEGIN_ACTION) {
+				p->blen++;
+				break;
+			}
+			COMMIT_VALUE(p);
+			if (t->action == BEGIN_END_ACTION) {
+				p->res.type = SCAN_COMPLETE;
+				return p->res;
+			}
+			break;
+		case COMMIT_ACTION:
+			COMMIT_VALUE(p);
+			break;
+		case COMMIT_END_ACTION:
+			COMMIT_VALUE(p);
+			p->res.type = SCAN_COMPLETE;
+			return p->res;
+		case END_ACTION:
+			p->res.type = SCAN_COMPLETE;
+			return p->res;
+		case KEY_ACTION:
+			if (p->pnext == LOGD_SLAB_CAP) {
+				SCANNER_SET_ERROR(p, ERROR_MAX_PROPS, p->format->error);
+				p->blen++;
+				break;
+			}
+			ADD_PROP(p);
+			SET_KEY(p, p->chunk);
+			p->blen++;
+			break;
+		case COMMIT_KEY_ACTION:
+			COMMIT_KEY(p);
+			break;
+		case MESSAGE_END_ACTION:
+			SET_VALUE(p, p->result.props->key);
+			SET_KEY_ID(p, KEY_MESSAGE, KEY_ID_MESSAGE);
+			COMMIT_VALUE(p);
+			p->res.type = SCAN_COMPLETE;
+			return p->res;
+		case VALUE_ACTION:
+			SET_VALUE(p, p->chunk);
+			p->blen++;
+			break;
+		case EMPTY_ACTION:
+		case EMPTY_END_ACTION:
+			SET_VALUE(p, p->chunk);
+			COMMIT_VALUE(p);
+			if (t->action == EMPTY_END_ACTION) {
+				p->res.type = SCAN_COMPLETE;
+				return p->res;
+			}
+			break;
+		case INVALID_ACTION:
+			SCANNER_SET_ERROR(p, ERROR_INVALID, p->format->error);
+			p->blen++;
+			break;
+		case INCOMPLETE_ACTION:
+			SCANNER_SET_ERROR(p, ERROR_INCOMPLETE, p->format->error);
+			SCANNER_END_ERROR(p);
+			return p->res;
+		case END_ERROR_ACTION:
+			SCANNER_END_ERROR(p);
+			return p->res;
+		}
+	}
+
+	return p->res;
+}
+
+size_t format_scanner_scan_batch(
+  void* _p, char* chunk, size_t clen, scan_batch_t* batch)
+{
+	format_scanner_t* p = (format_scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+	DEBUG_ASSERT(batch != NULL);
+
+	LOGD_SCANNER_SCAN_BATCH(
+	  p, format_scanner_scan, format_scanner_reset, chunk, clen, batch);
+}
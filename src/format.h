@@ -0,0 +1,38 @@
+#ifndef LOGD_FORMAT_H
+#define LOGD_FORMAT_H
+
+#include "scanner.h"
+
+/*
+ * Scanners for log layouts given at runtime, for example:
+ *
+ * %date %time\t%level\t[%thread]\t%class\t%kv
+ *
+ * %<name> is a field that is set to property <name> and ends at the literal
+ * that follows it, or at the end of the line if it is the last one. %kv
+ * scans the rest of the line into 'key: value, key: value' pairs like the
+ * default scanner and must come last. Spaces and tabs, which can also be
+ * written as \t, match any number of spaces and tabs. Anything else, and %%
+ * and \\, must match as is.
+ *
+ * The spec is compiled into a table with the next state and the action to
+ * take for every state and byte.
+ */
+typedef struct format_s format_t;
+
+/* format_compile returns NULL and prints why if spec is not valid */
+format_t* format_compile(const char* spec);
+void format_free(format_t* f);
+
+/* same as their scanner.h counterparts. The format must outlive its
+ * scanners */
+void* format_scanner_create(const format_t* f);
+void format_scanner_free(void* p);
+void format_scanner_reset(void* p);
+void format_scanner_rebase(
+  void* p, const char* start, size_t len, ptrdiff_t delta);
+scan_res_t format_scanner_scan(void* p, char* chunk, size_t clen);
+size_t format_scanner_scan_batch(
+  void* p, char* chunk, size_t clen, scan_batch_t* batch);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keys.h"
+#include "log.h"
+#include "util.h"
+
+/* slots of the open addressing table of ids by key hash, at most half full */
+#define SLOTS_CAP (KEYS_CAP * 2)
+#define SLOTS_MASK (SLOTS_CAP - 1)
+
+#define STATIC_KEY(name) {name, sizeof(name) - 1, 0, true}
+
+typedef struct interned_s {
+	const char* name;
+	uint32_t len;
+	uint32_t hash;
+	bool is_static;
+} interned_t;
+
+static interned_t keys[KEYS_CAP] = {
+  [KEY_ID_DATE] = STATIC_KEY(KEY_DATE),
+  [KEY_ID_TIME] = STATIC_KEY(KEY_TIME),
+  [KEY_ID_LEVEL] = STATIC_KEY(KEY_LEVEL),
+  [KEY_ID_THREAD] = STATIC_KEY(KEY_THREAD),
+  [KEY_ID_CLASS] = STATIC_KEY(KEY_CLASS),
+  [KEY_ID_MESSAGE] = STATIC_KEY(KEY_MESSAGE),
+  [KEY_ID_CALLTYPE] = STATIC_KEY(KEY_CALLTYPE),
+};
+/* next id to give out, 0 until the static keys are in slots */
+static uint32_t keys_next = 0;
+static uint16_t slots[SLOTS_CAP];
+
+/* FNV-1a, same as log_hash but for keys that may have NULs in them */
+static uint32_t hash(const char* key, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)key[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/* find returns the slot of key, which is empty if key was not interned */
+static uint32_t find(const char* key, size_t len, uint32_t h)
+{
+	uint32_t i = h & SLOTS_MASK;
+	interned_t* k;
+
+	for (; slots[i] != KEY_ID_NONE; i = (i + 1) & SLOTS_MASK) {
+		k = &keys[slots[i]];
+		if (k->hash == h && k->len == len && memcmp(k->name, key, len) == 0)
+			break;
+	}
+
+	return i;
+}
+
+static void init()
+{
+	interned_t* k;
+
+	for (keys_next = KEY_ID_NONE + 1; keys[keys_next].name != NULL;
+		 keys_next++) {
+		k = &keys[keys_next];
+		k->hash = hash(k->name, k->len);
+		slots[find(k->name, k->len, k->hash)] = keys_next;
+	}
+}
+
+uint32_t keys_id(const char* key, size_t len)
+{
+	uint32_t h, i;
+	char* name;
+
+	DEBUG_ASSERT(key != NULL);
+
+	if (keys_next == 0)
+		init();
+
+	if (len > KEYS_MAX_LEN)
+		return KEY_ID_UNINTERNED;
+
+	h = hash(key, len);
+	i = find(key, len, h);
+	if (slots[i] != KEY_ID_NONE)
+		return slots[i];
+
+	if (keys_next == KEYS_CAP)
+		return KEY_ID_UNINTERNED;
+
+	if ((name = malloc(len + 1)) == NULL) {
+		perror("malloc");
+		return KEY_ID_UNINTERNED;
+	}
+	memcpy(name, key, len);
+	name[len] = '\x00';
+
+	keys[keys_next] = (interned_t){name, len, h, false};
+	slots[i] = keys_next;
+
+	return keys_next++;
+}
+
+const char* keys_name(uint32_t id, size_t* len)
+{
+	DEBUG_ASSERT(id != KEY_ID_NONE && id < KEYS_CAP);
+	DEBUG_ASSERT(keys[id].name != NULL);
+
+	*len = keys[id].len;
+
+	return keys[id].name;
+}
+
+void keys_free()
+{
+	uint32_t id;
+
+	for (id = KEY_ID_NONE + 1; id < keys_next; id++) {
+		if (!keys[id].is_static) {
+			free((char*)keys[id].name);
+			keys[id].name = NULL;
+		}
+	}
+
+	memset(slots, 0, sizeof(slots));
+	keys_next = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef LOGD_KEYS_H
+#define LOGD_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Process wide registry that gives every distinct key a small id, so that
+ * keys can be compared as integers and bindings can cache what they make of
+ * them by id.
+ *
+ * The keys of log.h have fixed ids that scanners set without looking them up.
+ */
+#define KEY_ID_NONE 0
+#define KEY_ID_DATE 1
+#define KEY_ID_TIME 2
+#define KEY_ID_LEVEL 3
+#define KEY_ID_THREAD 4
+#define KEY_ID_CLASS 5
+#define KEY_ID_MESSAGE 6
+#define KEY_ID_CALLTYPE 7
+/* id of keys that did not fit in the registry */
+#define KEY_ID_UNINTERNED UINT32_MAX
+
+/* max number of ids and max length of interned keys */
+#define KEYS_CAP 1024
+#define KEYS_MAX_LEN 128
+
+/* keys_id returns the id of the len bytes at key, interning a copy of them
+ * if they were not seen yet, or KEY_ID_UNINTERNED if they do not fit */
+uint32_t keys_id(const char* key, size_t len);
+/* keys_name returns the NUL terminated key of id and sets len to its
+ * length */
+const char* keys_name(uint32_t id, size_t* len);
+void keys_free();
+
+#endif
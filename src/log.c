@@ -3,9 +3,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "keys.h"
 #include "log.h"
 #include "util.h"
 
+#define INDEX_MASK (LOG_INDEX_CAP - 1)
+/* index->len of indexes that have to be built before being used */
+#define INDEX_STALE -1
+/* index->len of logs that are searched linearly */
+#define INDEX_UNUSED -2
+
+#define PROP_KEY_EQ(p, hash, len, key)                                         \
+	((p)->khash == (hash) && (p)->klen == (len) &&                             \
+	  memcmp((p)->key, (key), (len)) == 0)
+
 log_t* log_create()
 {
 	log_t* l;
@@ -24,22 +35,268 @@ void log_init(log_t* l)
 {
 	DEBUG_ASSERT(l != NULL);
 	l->props = NULL;
+	l->index = NULL;
+	l->body = NULL;
 	// remains unchanged
 	// l->is_safe = false;
 }
 
-const char* log_get(log_t* l, const char* key)
+void log_set_index(log_t* l, log_index_t* index)
+{
+	DEBUG_ASSERT(l != NULL);
+	DEBUG_ASSERT(index != NULL);
+
+	l->index = index;
+	index->len = INDEX_STALE;
+}
+
+void log_reindex(log_t* l)
+{
+	DEBUG_ASSERT(l != NULL);
+
+	if (l->index != NULL)
+		l->index->len = INDEX_STALE;
+}
+
+void log_scan_body(log_t* l)
+{
+	log_body_t* body;
+	prop_t** next;
+
+	DEBUG_ASSERT(l != NULL);
+
+	if ((body = l->body) == NULL)
+		return;
+
+	l->body = NULL;
+
+	/* props set since the log was scanned stay in front */
+	for (next = &l->props; *next != body->at; next = &((*next)->next))
+		;
+	*next = body->scan(body);
+
+	log_reindex(l);
+}
+
+/* FNV-1a */
+uint32_t log_hash(const char* key, uint32_t* len)
+{
+	uint32_t hash = 2166136261u;
+	const char* c;
+
+	for (c = key; *c != '\0'; c++) {
+		hash ^= (unsigned char)*c;
+		hash *= 16777619u;
+	}
+	*len = c - key;
+
+	return hash;
+}
+
+/* FNV-1a of the len bytes at key, which may have NULs in them */
+static uint32_t hash_len(const char* key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* prop_hash sets the hash of the key of p and its length, keeping the one the
+ * scanner recorded if any */
+static void prop_hash(prop_t* p)
+{
+	p->klen = log_key_len(p);
+	p->khash = hash_len(p->key, p->klen);
+}
+
+/* index_find returns the slot of key or of the empty slot where it would go */
+static uint32_t index_find(
+  log_index_t* index, uint32_t hash, uint32_t len, const char* key)
+{
+	uint32_t i;
+
+	for (i = hash & INDEX_MASK; index->slots[i] != NULL;
+		 i = (i + 1) & INDEX_MASK) {
+		if (PROP_KEY_EQ(index->slots[i], hash, len, key))
+			break;
+	}
+
+	return i;
+}
+
+/* index_put makes prop the one found by its key if there is none yet or if
+ * replace is set. It returns false if the index is too full */
+static bool index_put(log_index_t* index, prop_t* prop, bool replace)
+{
+	uint32_t i = index_find(index, prop->khash, prop->klen, prop->key);
+
+	if (index->slots[i] != NULL) {
+		if (replace)
+			index->slots[i] = prop;
+		return true;
+	}
+
+	if (index->len >= LOG_INDEX_CAP / 2)
+		return false;
+
+	index->slots[i] = prop;
+	index->len++;
+
+	return true;
+}
+
+/* index_delete empties slot i and moves back the entries after it that would
+ * not be found otherwise */
+static void index_delete(log_index_t* index, uint32_t i)
+{
+	uint32_t j, home;
+
+	for (j = (i + 1) & INDEX_MASK; index->slots[j] != NULL;
+		 j = (j + 1) & INDEX_MASK) {
+		home = index->slots[j]->khash & INDEX_MASK;
+		if (((j - home) & INDEX_MASK) >= ((j - i) & INDEX_MASK)) {
+			index->slots[i] = index->slots[j];
+			i = j;
+		}
+	}
+
+	index->slots[i] = NULL;
+	index->len--;
+}
+
+static void index_build(log_t* l)
+{
+	log_index_t* index = l->index;
+	prop_t* p;
+	int n = 0;
+
+	for (p = l->props; p != NULL && n < LOG_INDEX_MIN; p = p->next)
+		n++;
+
+	index->len = INDEX_UNUSED;
+	if (n < LOG_INDEX_MIN)
+		return;
+
+	memset(index->slots, 0, sizeof(index->slots));
+	index->len = 0;
+
+	/* the first of the props with the same key is the one that is found */
+	for (p = l->props; p != NULL; p = p->next) {
+		if (p->key == NULL)
+			goto unused;
+		prop_hash(p);
+		if (!index_put(index, p, false))
+			goto unused;
+	}
+
+	return;
+unused:
+	index->len = INDEX_UNUSED;
+}
+
+bool log_indexed(log_t* l)
+{
+	DEBUG_ASSERT(l != NULL);
+
+	if (l->index == NULL)
+		return false;
+
+	if (l->index->len == INDEX_STALE)
+		index_build(l);
+
+	return l->index->len >= 0;
+}
+
+prop_t* log_get_prop(log_t* l, const char* key)
 {
+	uint32_t hash, len, i;
+
 	DEBUG_ASSERT(l != NULL);
 	DEBUG_ASSERT(key != NULL);
 
-	for (prop_t* next = l->props; next != NULL; next = next->next) {
-		DEBUG_ASSERT(next->key != NULL);
-		if (strcmp(key, next->key) == 0)
-			return next->value;
+	if (log_indexed(l)) {
+		hash = log_hash(key, &len);
+		i = index_find(l->index, hash, len, key);
+		if (l->index->slots[i] != NULL || l->body == NULL)
+			return l->index->slots[i];
+	} else {
+		for (prop_t* next = l->props; next != NULL; next = next->next) {
+			DEBUG_ASSERT(next->key != NULL);
+			if (strcmp(key, next->key) == 0)
+				return next;
+		}
 	}
 
-	return NULL;
+	if (l->body == NULL)
+		return NULL;
+
+	log_scan_body(l);
+
+	return log_get_prop(l, key);
+}
+
+prop_t* log_get_id(log_t* l, uint32_t id, const char* key, size_t len)
+{
+	prop_t* next;
+	uint32_t i;
+
+	DEBUG_ASSERT(l != NULL);
+	DEBUG_ASSERT(key != NULL);
+	DEBUG_ASSERT(id != KEY_ID_NONE && id != KEY_ID_UNINTERNED);
+
+	if (log_indexed(l)) {
+		i = index_find(l->index, hash_len(key, len), len, key);
+		if (l->index->slots[i] != NULL || l->body == NULL)
+			return l->index->slots[i];
+		log_scan_body(l);
+		return log_get_id(l, id, key, len);
+	}
+
+	for (next = l->props; next != NULL; next = next->next) {
+		if (next->kid != KEY_ID_NONE) {
+			if (next->kid == id)
+				return next;
+			continue;
+		}
+		if (log_key_len(next) == len && memcmp(next->key, key, len) == 0) {
+			next->kid = id;
+			return next;
+		}
+	}
+
+	if (l->body == NULL)
+		return NULL;
+
+	log_scan_body(l);
+
+	return log_get_id(l, id, key, len);
+}
+
+const char* log_get(log_t* l, const char* key)
+{
+	prop_t* prop = log_get_prop(l, key);
+
+	return prop != NULL ? prop->value : NULL;
+}
+
+size_t log_key_len(const prop_t* p)
+{
+	DEBUG_ASSERT(p != NULL);
+
+	return p->klen > 0 ? p->klen : strlen(p->key);
+}
+
+size_t log_value_len(const prop_t* p)
+{
+	DEBUG_ASSERT(p != NULL);
+
+	return p->vlen > 0 ? p->vlen : strlen(p->value);
 }
 
 prop_t* log_remove(log_t* l, const char* key)
@@ -48,16 +305,47 @@ prop_t* log_remove(log_t* l, const char* key)
 	DEBUG_ASSERT(key != NULL);
 
 	prop_t* ret = NULL;
+	prop_t* p;
+	uint32_t hash, len, i;
+
+	log_scan_body(l);
+
+	if (!log_indexed(l)) {
+		for (prop_t** next = &l->props; *next != NULL;
+			 next = &((*next)->next)) {
+			DEBUG_ASSERT((*next)->key != NULL);
+			if (strcmp(key, (*next)->key) == 0) {
+				ret = (*next);
+				(*next) = (*next)->next;
+				break;
+			}
+		}
+
+		return ret;
+	}
+
+	hash = log_hash(key, &len);
+	i = index_find(l->index, hash, len, key);
+	if ((ret = l->index->slots[i]) == NULL)
+		return NULL;
 
 	for (prop_t** next = &l->props; *next != NULL; next = &((*next)->next)) {
-		DEBUG_ASSERT((*next)->key != NULL);
-		if (strcmp(key, (*next)->key) == 0) {
-			ret = (*next);
-			(*next) = (*next)->next;
+		if (*next == ret) {
+			*next = ret->next;
 			break;
 		}
 	}
 
+	/* a prop further down with the same key is found from now on */
+	for (p = ret->next; p != NULL; p = p->next) {
+		if (PROP_KEY_EQ(p, hash, len, key)) {
+			l->index->slots[i] = p;
+			return ret;
+		}
+	}
+
+	index_delete(l->index, i);
+
 	return ret;
 }
 
@@ -68,9 +356,19 @@ void log_set(log_t* l, prop_t* prop, const char* key, const char* value)
 
 	prop->key = key;
 	prop->value = value;
+	prop->klen = 0;
+	prop->vlen = 0;
+	prop->kid = KEY_ID_NONE;
 
 	prop->next = l->props;
 	l->props = prop;
+
+	if (l->index == NULL || l->index->len < 0)
+		return;
+
+	prop_hash(prop);
+	if (!index_put(l->index, prop, true))
+		l->index->len = INDEX_UNUSED;
 }
 
 int log_size(log_t* l)
@@ -78,6 +376,7 @@ int log_size(log_t* l)
 	DEBUG_ASSERT(l != NULL);
 
 	int ret = 0;
+	log_scan_body(l);
 	for (prop_t* next = l->props; next != NULL; next = next->next)
 		ret++;
 
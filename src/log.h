@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #define KEY_THREAD "thread"
@@ -13,20 +14,82 @@
 #define KEY_MESSAGE "msg"
 #define KEY_CALLTYPE "callType"
 
+/* slots of a log index, a power of two. Logs with more than half as many
+ * properties, or with less than LOG_INDEX_MIN, are searched linearly */
+#define LOG_INDEX_CAP 256
+#define LOG_INDEX_MIN 16
+
+/* prop_t and log_t are mirrored by the FFI declarations of logdffi.lua, which
+ * have to be kept in sync */
 typedef struct prop_s {
 	struct prop_s* next;
 	const char* key;
 	const char* value;
+	/* lengths of key and value, or 0 if they were not recorded. Indexed logs
+	 * always have them for keys */
+	uint32_t klen;
+	uint32_t vlen;
+	/* hash of key, only set in indexed logs */
+	uint32_t khash;
+	/* id of key from keys.h, or KEY_ID_NONE if it was not looked up */
+	uint32_t kid;
 } prop_t;
 
+/* open addressing index of the properties of a log by key */
+typedef struct log_index_s {
+	/* number of indexed properties, or negative if not built or not used */
+	int len;
+	prop_t* slots[LOG_INDEX_CAP];
+} log_index_t;
+
+/* body of a log whose scanning was deferred until a property that is not in
+ * the header is needed, see log_scan_body */
+typedef struct log_body_s {
+	/* unscanned bytes of the body, which are followed by the line end */
+	char* start;
+	size_t len;
+	/* slab where the properties of the body go from pslab[pnext] on */
+	prop_t* pslab;
+	int pnext;
+	/* first property of the header, which the body goes before */
+	prop_t* at;
+	/* scan returns the properties of body, chained in front of at */
+	prop_t* (*scan)(struct log_body_s* body);
+} log_body_t;
+
 typedef struct log_s {
 	prop_t* props;
 	bool is_safe;
+	/* optional index that is built by the first lookup */
+	log_index_t* index;
+	/* body that is yet to be scanned, or NULL */
+	log_body_t* body;
 } log_t;
 
 log_t* log_create();
 void log_init(log_t* l);
+/* log_set_index lets l be indexed with index, which must outlive its use by l.
+ * Props that are changed other than with log_set and log_remove must be
+ * followed by a call to log_reindex, with klen reset if their key changed */
+void log_set_index(log_t* l, log_index_t* index);
+void log_reindex(log_t* l);
+/* log_indexed builds the index of l if needed and returns whether it is used,
+ * in which case props carry the hash and length of their keys */
+bool log_indexed(log_t* l);
+/* log_scan_body scans the deferred body of l, if any. Lookups that miss do it
+ * on their own, anything that walks props has to call it first */
+void log_scan_body(log_t* l);
+uint32_t log_hash(const char* key, uint32_t* len);
 const char* log_get(log_t* l, const char* key);
+prop_t* log_get_prop(log_t* l, const char* key);
+/* log_get_id is log_get_prop for the len bytes at key, which were interned
+ * with id. Props are compared by id if theirs is known, and remember it
+ * otherwise once they match */
+prop_t* log_get_id(log_t* l, uint32_t id, const char* key, size_t len);
+/* lengths of the key and the value of p, which can only have NULs in them if
+ * they were recorded in klen and vlen */
+size_t log_key_len(const prop_t* p);
+size_t log_value_len(const prop_t* p);
 prop_t* log_remove(log_t* l, const char* key);
 void log_set(log_t* l, prop_t* prop, const char* key, const char* value);
 int log_size(log_t* l);
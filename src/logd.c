@@ -1,15 +1,26 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <glob.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <slab/buf.h>
 
+#include "./checkpoint.h"
+#include "./filter.h"
+#include "./format.h"
+#include "./keys.h"
 #include "./lua.h"
+#include "./mirror.h"
+#include "./output.h"
+#include "./pipeline.h"
 #include "./scanner.h"
 #include "./tail.h"
+#include "./uring.h"
 #include "./util.h"
 
 #define OPT_DEFAULT_DEBUG false
@@ -19,14 +30,73 @@
 #define LOGD_HANDLE ((void*)"__LOGD_HANDLE")
 #define STAMP_HANDLE(handle) (handle)->data = LOGD_HANDLE;
 #define STDIN_INPUT_FILE "/dev/stdin"
+/* input owning the given embedded libuv handle */
+#define INPUT_OF(handle, member)                                               \
+	((input_t*)((char*)(handle)-offsetof(input_t, member)))
+/* max bytes of a backfilled file scanned per event loop iteration, which
+ * bounds the pages of it that are resident at once */
+#define BACKFILL_SLICE_LEN (8 * 1024 * 1024)
+#define LUA_NAME_MARK "mark"
+#define LUA_NAME_ACK "ack"
+#define LUA_NAME_STATS "stats"
+/* io_uring buffers shared by all inputs, URING_READER_DEPTH per input. What
+ * is left of a read always fits in an empty input buffer */
+#define URING_SLOTS 32
+#define URING_SLOT_LEN LOGD_BUF_INIT_CAP
+#define OVERSIZE_SKIP_STR "skip"
+#define OVERSIZE_TRUNCATE_STR "truncate"
+#define OVERSIZE_SPILL_STR "spill"
+/* properties added to logs that did not fit in the largest buffer */
+#define KEY_TRUNCATED "truncated"
+#define KEY_SPILL "spill"
+#define OVERSIZE_SKIP_ERROR                                                    \
+	"log line was skipped because it is more than " STR(LOGD_BUF_MAX_CAP)      \
+	" bytes"
+#define OUTPUT_BLOCK_STR "block"
+#define OUTPUT_DROP_NEWEST_STR "drop-newest"
+#define OUTPUT_DROP_OLDEST_STR "drop-oldest"
+
+/* what to do with logs that do not fit in LOGD_BUF_MAX_CAP bytes */
+enum oversize_e {
+	OVERSIZE_SKIP,
+	OVERSIZE_TRUNCATE,
+	OVERSIZE_SPILL,
+};
 
 struct args_s {
 	int reopen_delay;
 	const char* reopen_backoff;
 	int reopen_retries;
-	char* input_file;
+	/* paths or glob patterns */
+	char** input_files;
+	int input_files_len;
+	long long from_offset;
+	const char* checkpoint_dir;
+	int checkpoint_interval;
+	int manual_ack;
+	/* max bytes and reads per input readiness notification */
+	int read_budget_bytes;
+	int read_budget_reads;
+	int io_uring;
+	/* read and scan non regular inputs on a thread of their own */
+	int pipeline;
+	int ring_buffer;
+	/* quiet period after which input buffers shrink to fit recent logs */
+	int buf_shrink_delay;
+	enum oversize_e oversize;
+	/* bytes oversized logs are cut short to */
+	int truncate_bytes;
+	const char* spill_dir;
 	int help;
 	const char* dlscanner;
+	const char* format;
+	/* only scan the header of logs until the rest is needed */
+	int lazy;
+	const char* filter;
+	/* bytes of logd.print output buffered natively, or 0 to use io.write */
+	int output_buffer;
+	int output_flush;
+	enum output_overflow_e output_overflow;
 } args;
 
 enum input_state_e {
@@ -34,37 +104,177 @@ enum input_state_e {
 	OPENING_ISTATE,
 	READING_ISTATE,
 	EXIT_ISTATE,
-} input_state;
+};
+
+/* regular file mapped in memory and scanned in place before following it */
+struct backfill_s {
+	int done;
+	/* mapped file, checked for truncation before every slice */
+	int fd;
+	char* map;
+	size_t map_len;
+	/* file offset of map */
+	off_t map_offset;
+	/* pages of map before released were handed back to the kernel */
+	char* released;
+	char* log_start;
+	char* next_read;
+	char* last;
+	uv_idle_t idle;
+};
+
+/* every input has its own buffer and scanner and is multiplexed on the
+ * single event loop and lua state */
+typedef struct pending_mark_s {
+	off_t offset;
+	int acked;
+} pending_mark_t;
+
+typedef struct input_s {
+	char* file;
+	enum input_state_e state;
+	int is_reg;
+	uv_file fd;
+	tail_t* tail;
+	buf_t* b;
+	void* scanner;
+	char* log_start;
+	uv_poll_t poll;
+	uv_poll_cb poll_cb;
+	uv_idle_t pending;
+	uv_timer_t reopen_timer;
+	int reopen_retries;
+	struct backfill_s backfill;
+	/* index in inputs */
+	uint32_t id;
+	/* last acked position, only kept for regular files */
+	char* cp_path;
+	checkpoint_t cp;
+	int cp_valid;
+	int cp_dirty;
+	/* bumped when the followed file changes so that stale marks are ignored */
+	uint32_t cp_gen;
+	/* file offset right after the log being handled by lua or -1 */
+	off_t mark;
+	/* with --manual-ack, marks handed to lua from marks_head on, oldest
+	 * first. The checkpoint only moves past a mark once it and every mark
+	 * before it are acked */
+	pending_mark_t* marks;
+	size_t marks_head;
+	size_t marks_len;
+	size_t marks_cap;
+	/* largest logs since the last tick of shrink_timer and in the shrink
+	 * delay before it, which the buffer shrinks back to on every tick */
+	size_t buf_hwm;
+	size_t buf_hwm_prev;
+	uv_timer_t shrink_timer;
+	/* the rest of a log that did not fit in the buffer is being read past */
+	int oversize;
+	log_t* oversize_log;
+	prop_t oversize_props[2];
+	/* with --oversize=spill, the raw bytes of the line being read are kept
+	 * before the scanner overwrites its delimiters: the first
+	 * LOGD_BUF_INIT_CAP of them in raw and all of them in the file at
+	 * spill_path, or -1, once there are more */
+	char* raw;
+	size_t raw_len;
+	int spilling;
+	int spill_fd;
+	char* spill_path;
+	/* b points into a double mapped ring rather than a slab buffer */
+	int mirrored;
+#ifdef LOGD_MIRROR
+	mirror_t mirror;
+#endif
+	/* read via io_uring completions rather than poll readiness */
+	int uring;
+#ifdef LOGD_URING
+	uring_reader_t reader;
+	/* b points at view while a read is scanned in the io_uring buffer it was
+	 * read into, and the input buffer is kept in own meanwhile */
+	buf_t uring_view;
+	buf_t* uring_own;
+#endif
+	/* read and scanned by the reader thread of pipeline rather than here */
+	int pipelined;
+	pipeline_t pipeline;
+} input_t;
+
+/* opaque to lua: returned by logd.mark and passed back to logd.ack */
+typedef struct mark_s {
+	uint32_t input;
+	uint32_t gen;
+	int64_t offset;
+} mark_t;
 
 int pret;
 char* script;
-char* log_start;
-void* scanner;
 void* dlscanner_handle;
+format_t* format;
+/* logs that do not pass it are not handed to lua */
+filter_t* filter;
+/* stdout writer of logd.print when args.output_buffer is set */
+output_t output;
 lua_t* lstate;
-buf_t* b;
-uv_file infd;
-tail_t* tail;
-uv_poll_t uv_poll_in_req;
+input_t** inputs;
+size_t inputs_len;
+/* input whose log is being handled by lua */
+input_t* curr_input;
+uv_timer_t checkpoint_timer;
+#ifdef LOGD_URING
+uring_t* ring;
+uv_poll_t ring_poll;
+#endif
+
+/* counters exposed to lua via logd.stats */
+struct stats_s {
+	/* input readiness notifications handled */
+	uint64_t read_wakeups;
+	/* reads of input data, including those that found no data */
+	uint64_t read_calls;
+	uint64_t read_bytes;
+	/* notifications that yielded to the loop with input data likely left */
+	uint64_t read_budget_exhausted;
+	/* capacity of all input buffers */
+	uint64_t buf_bytes;
+	/* input buffer growths and shrinks */
+	uint64_t buf_reallocs;
+	/* bytes moved by buffer compaction, growth and shrinking */
+	uint64_t buf_copied_bytes;
+	/* logs that were and were not handed to lua by the filter */
+	uint64_t filter_passed;
+	uint64_t filter_dropped;
+} stats;
 uv_loop_t* loop;
-int curr_reopen_retries;
 int backoff;
-int input_is_reg;
 uv_signal_t sigusr1, sigusr2, sigint;
-uv_fs_t uv_open_in_req;
 
 scan_res_t (*scan_scanner)(
   void*, char*, size_t) = (scan_res_t(*)(void*, char*, size_t))(&scanner_scan);
 void (*free_scanner)(void*) = (void (*)(void*))(&scanner_free);
 void* (*create_scanner)() = (void* (*)())(&scanner_create);
 void (*reset_scanner)(void*) = (void (*)(void*))(&scanner_reset);
+void (*rebase_scanner)(void*, const char*, size_t, ptrdiff_t) =
+  (void (*)(void*, const char*, size_t, ptrdiff_t))(&scanner_rebase);
+size_t (*scan_batch_scanner)(void*, char*, size_t, scan_batch_t*) =
+  (size_t(*)(void*, char*, size_t, scan_batch_t*))(&scanner_scan_batch);
+void (*lazy_scanner)(void*, bool) = (void (*)(void*, bool))(&scanner_set_lazy);
+/* complete logs of the last call to scan_batch_scanner */
+scan_batch_t* batch;
 
 void on_read_skip(uv_poll_t* req, int status, int events);
 void on_read(uv_poll_t* req, int status, int events);
 void on_first_read(uv_poll_t* req, int status, int events);
-void input_close();
-static void input_reopen_open();
-int input_open(uv_loop_t*, tail_t*, char*);
+void on_poll_err(int ret);
+void on_read_err(int ret);
+void on_eof(input_t* in);
+void logd_reset_scanner(input_t* in);
+void call_on_error(input_t* in, const char* err, log_t* partial,
+  const char* at, off_t mark);
+static void backfill_stop(input_t* in);
+void input_close(input_t* in);
+static void input_reopen_open(input_t* in);
+int input_open(input_t* in);
 
 void print_version() { printf("logd %s\n", LOGD_VERSION); }
 
@@ -72,13 +282,65 @@ void print_usage(const char* exe)
 {
 	printf("usage: %s <script> [options]\n", exe);
 	printf("\noptions:\n");
-	printf(
-	  "  -f, --file=<path>		File to ingest appended data from [default: "
-	  "/dev/stdin]\n");
+	printf("  -f, --file=<path>		File or glob pattern to ingest appended "
+		   "data from, can be repeated [default: /dev/stdin]\n");
+	printf("  -s, --from-start		Scan regular file from its beginning "
+		   "before following it\n");
+	printf("  -o, --from-offset=<bytes>	Scan regular file from byte offset "
+		   "before following it\n");
+	printf("  -c, --checkpoint-dir=<dir>	Persist the position of the last "
+		   "acked log of each regular file in dir and resume from it\n");
+	printf("  -i, --checkpoint-interval	Checkpoint fsync interval in "
+		   "milliseconds [default: %d]\n",
+	  args.checkpoint_interval);
+	printf("  -a, --manual-ack		Only advance checkpoints on logd.ack "
+		   "instead of after each call to logd.on_log\n");
+	printf("  -B, --read-budget-bytes	Max bytes read from an input before "
+		   "yielding to other inputs [default: %d]\n",
+	  args.read_budget_bytes);
+	printf("  -N, --read-budget-reads	Max reads from an input before "
+		   "yielding to other inputs [default: %d]\n",
+	  args.read_budget_reads);
+	printf("  -u, --io-uring		Read pipes and other non regular inputs "
+		   "with io_uring when available\n");
+	printf("  -t, --pipeline		Read and scan pipes and other non "
+		   "regular inputs on a thread of their own while lua handles "
+		   "what was scanned before\n");
+	printf("  -R, --ring-buffer		Read into double mapped ring buffers "
+		   "so that logs wrapping around need no compaction\n");
+	printf("  -O, --oversize=<policy>	What to do with logs longer than "
+		   "%d bytes: 'skip' them with an error, 'truncate' them, or "
+		   "truncate them and 'spill' the whole line to a file "
+		   "[default: skip]\n",
+	  LOGD_BUF_MAX_CAP);
+	printf("  -T, --truncate-bytes=<bytes>	Bytes oversized logs are cut "
+		   "short to when they are truncated or spilled, at most %d "
+		   "[default: %d]\n",
+	  LOGD_BUF_MAX_CAP, args.truncate_bytes);
+	printf("  -P, --spill-dir=<dir>		Directory of spilled oversized logs "
+		   "[default: %s]\n",
+	  args.spill_dir);
+	printf("  -S, --buffer-shrink-delay	Milliseconds without long logs "
+		   "before an input buffer shrinks [default: %d]\n",
+	  args.buf_shrink_delay);
 	printf("  -p, --scanner=<scanner_so>	Load shared object "
 		   "scanner via dlopen [default: "
 		   "%s]\n",
 	  LOGD_BUILTIN_SCANNER);
+	printf("  -F, --format=<spec>		Scan logs laid out as spec instead, "
+		   "e.g. '%%date %%time [%%thread] %%level %%kv'\n");
+	printf("  -L, --lazy			Only scan the properties after the class "
+		   "of a log once one of them is needed\n");
+	printf("  -e, --filter=<expr>		Only hand logs that pass expr to lua, "
+		   "e.g. \"level in (WARN, ERROR) and class ^= com.acme\"\n");
+	printf("  -w, --output-buffer=<bytes>	Buffer the output of logd.print "
+		   "natively instead of writing it with io.write [default: 0]\n");
+	printf("  -W, --output-flush		Output buffer flush interval in "
+		   "milliseconds [default: %d]\n",
+	  args.output_flush);
+	printf("  -x, --output-overflow=<policy>	What to do with logd.print "
+		   "output that does not fit in the buffer: 'block' until stdout "
+		   "takes it, 'drop-newest' or 'drop-oldest' [default: block]\n");
 	printf("  -r, --reopen-retries		Reopen retries on EOF before giving up "
 		   "[default: %d]\n",
 	  args.reopen_retries);
@@ -96,9 +358,28 @@ void print_usage(const char* exe)
 char* args_init(int argc, char* argv[])
 {
 	/* set defaults for arguments */
-	args.input_file = STDIN_INPUT_FILE;
+	args.input_files_len = 0;
+	args.from_offset = -1;
+	args.checkpoint_dir = NULL;
+	args.checkpoint_interval = 1000; /* milliseconds */
+	args.manual_ack = 0;
+	args.read_budget_bytes = 4 * 1024 * 1024;
+	args.read_budget_reads = 64;
+	args.io_uring = 0;
+	args.pipeline = 0;
+	args.ring_buffer = 0;
+	args.buf_shrink_delay = 30000; /* milliseconds */
+	args.oversize = OVERSIZE_SKIP;
+	args.truncate_bytes = LOGD_BUF_MAX_CAP;
+	args.spill_dir = "/tmp";
 	args.help = 0;
 	args.dlscanner = NULL;
+	args.format = NULL;
+	args.lazy = 0;
+	args.filter = NULL;
+	args.output_buffer = 0;
+	args.output_flush = 100; /* milliseconds */
+	args.output_overflow = OUTPUT_BLOCK;
 	args.reopen_backoff = LINEAL_BACKOFF;
 	backoff = 1;
 	args.reopen_retries = 0;
@@ -109,13 +390,41 @@ char* args_init(int argc, char* argv[])
 	  {"reopen-retries", required_argument, 0, 'r'},
 	  {"reopen-delay", required_argument, 0, 'd'},
 	  {"file", required_argument, 0, 'f'}, {"help", no_argument, 0, 'h'},
-	  {"scanner", required_argument, 0, 'p'}, {"version", no_argument, 0, 'v'},
+	  {"from-start", no_argument, 0, 's'},
+	  {"from-offset", required_argument, 0, 'o'},
+	  {"checkpoint-dir", required_argument, 0, 'c'},
+	  {"checkpoint-interval", required_argument, 0, 'i'},
+	  {"manual-ack", no_argument, 0, 'a'},
+	  {"read-budget-bytes", required_argument, 0, 'B'},
+	  {"read-budget-reads", required_argument, 0, 'N'},
+	  {"io-uring", no_argument, 0, 'u'},
+	  {"pipeline", no_argument, 0, 't'},
+	  {"ring-buffer", no_argument, 0, 'R'},
+	  {"buffer-shrink-delay", required_argument, 0, 'S'},
+	  {"oversize", required_argument, 0, 'O'},
+	  {"truncate-bytes", required_argument, 0, 'T'},
+	  {"spill-dir", required_argument, 0, 'P'},
+	  {"scanner", required_argument, 0, 'p'},
+	  {"format", required_argument, 0, 'F'}, {"lazy", no_argument, 0, 'L'},
+	  {"filter", required_argument, 0, 'e'},
+	  {"output-buffer", required_argument, 0, 'w'},
+	  {"output-flush", required_argument, 0, 'W'},
+	  {"output-overflow", required_argument, 0, 'x'},
+	  {"version", no_argument, 0, 'v'},
 	  {0, 0, 0, 0}};
 
 	int option_index = 0;
 	int c = 0;
-	while ((c = getopt_long(
-			  argc, argv, "vp:f:hb:d:r:", long_options, &option_index)) != -1) {
+
+	/* there cannot be more input files than arguments */
+	if ((args.input_files = calloc(argc, sizeof(char*))) == NULL) {
+		perror("calloc");
+		return NULL;
+	}
+
+	while ((c = getopt_long(argc, argv,
+			  "vp:F:Le:w:W:x:f:hb:d:r:so:c:i:aB:N:utRS:O:T:P:", long_options,
+			  &option_index)) != -1) {
 		switch (c) {
 		case 'v':
 			print_version();
@@ -124,12 +433,127 @@ char* args_init(int argc, char* argv[])
 		case 'p':
 			args.dlscanner = optarg;
 			break;
+		case 'F':
+			args.format = optarg;
+			break;
+		case 'L':
+			args.lazy = 1;
+			break;
+		case 'e':
+			args.filter = optarg;
+			break;
+		case 'w':
+			if ((args.output_buffer = parse_non_negative_int(optarg)) == -1) {
+				perror("parse --output-buffer");
+				return NULL;
+			}
+			break;
+		case 'W':
+			if ((args.output_flush = parse_non_negative_int(optarg)) == -1 ||
+			  args.output_flush == 0) {
+				perror("parse --output-flush");
+				return NULL;
+			}
+			break;
+		case 'x':
+			if (strcmp(optarg, OUTPUT_BLOCK_STR) == 0) {
+				args.output_overflow = OUTPUT_BLOCK;
+			} else if (strcmp(optarg, OUTPUT_DROP_NEWEST_STR) == 0) {
+				args.output_overflow = OUTPUT_DROP_NEWEST;
+			} else if (strcmp(optarg, OUTPUT_DROP_OLDEST_STR) == 0) {
+				args.output_overflow = OUTPUT_DROP_OLDEST;
+			} else {
+				errno = EINVAL;
+				perror("--output-overflow");
+				return NULL;
+			}
+			break;
 		case 'f':
-			args.input_file = optarg;
+			args.input_files[args.input_files_len++] = optarg;
 			break;
 		case 'h':
 			args.help = 1;
 			break;
+		case 's':
+			args.from_offset = 0;
+			break;
+		case 'o':
+			if ((args.from_offset = parse_non_negative_llong(optarg)) == -1) {
+				perror("parse --from-offset");
+				return NULL;
+			}
+			break;
+		case 'c':
+			args.checkpoint_dir = optarg;
+			break;
+		case 'i':
+			if ((args.checkpoint_interval = parse_non_negative_int(optarg)) ==
+				-1 ||
+			  args.checkpoint_interval == 0) {
+				perror("parse --checkpoint-interval");
+				return NULL;
+			}
+			break;
+		case 'a':
+			args.manual_ack = 1;
+			break;
+		case 'u':
+			args.io_uring = 1;
+			break;
+		case 't':
+			args.pipeline = 1;
+			break;
+		case 'R':
+			args.ring_buffer = 1;
+			break;
+		case 'S':
+			if ((args.buf_shrink_delay = parse_non_negative_int(optarg)) ==
+			  -1) {
+				perror("parse --buffer-shrink-delay");
+				return NULL;
+			}
+			break;
+		case 'O':
+			if (strcmp(optarg, OVERSIZE_SKIP_STR) == 0) {
+				args.oversize = OVERSIZE_SKIP;
+			} else if (strcmp(optarg, OVERSIZE_TRUNCATE_STR) == 0) {
+				args.oversize = OVERSIZE_TRUNCATE;
+			} else if (strcmp(optarg, OVERSIZE_SPILL_STR) == 0) {
+				args.oversize = OVERSIZE_SPILL;
+			} else {
+				errno = EINVAL;
+				perror("--oversize");
+				return NULL;
+			}
+			break;
+		case 'T':
+			if ((args.truncate_bytes = parse_non_negative_int(optarg)) == -1 ||
+			  args.truncate_bytes == 0 ||
+			  args.truncate_bytes > LOGD_BUF_MAX_CAP) {
+				errno = EINVAL;
+				perror("parse --truncate-bytes");
+				return NULL;
+			}
+			break;
+		case 'P':
+			args.spill_dir = optarg;
+			break;
+		case 'B':
+			if ((args.read_budget_bytes = parse_non_negative_int(optarg)) ==
+				-1 ||
+			  args.read_budget_bytes == 0) {
+				perror("parse --read-budget-bytes");
+				return NULL;
+			}
+			break;
+		case 'N':
+			if ((args.read_budget_reads = parse_non_negative_int(optarg)) ==
+				-1 ||
+			  args.read_budget_reads == 0) {
+				perror("parse --read-budget-reads");
+				return NULL;
+			}
+			break;
 		case 'r':
 			if ((args.reopen_retries = parse_non_negative_int(optarg)) == -1) {
 				perror("parse --reopen-retries");
@@ -160,10 +584,30 @@ char* args_init(int argc, char* argv[])
 		}
 	}
 
+	if (args.input_files_len == 0)
+		args.input_files[args.input_files_len++] = STDIN_INPUT_FILE;
+
+	if (args.format != NULL && args.dlscanner != NULL) {
+		errno = EINVAL;
+		perror("--format and --scanner");
+		return NULL;
+	}
+
 	DEBUG_LOG("parsed args, reopen_delay: %d, reopen_backoff: %d, "
-			  "reopen_retries: %d, input_file: %s, dlscanner: %s ",
-	  args.reopen_delay, backoff, args.reopen_retries, args.input_file,
-	  args.dlscanner);
+			  "reopen_retries: %d, input_files: %d, from_offset: %lld, "
+			  "checkpoint_dir: %s, checkpoint_interval: %d, manual_ack: %d, "
+			  "read_budget_bytes: %d, read_budget_reads: %d, io_uring: %d, "
+			  "pipeline: %d, ring_buffer: %d, buf_shrink_delay: %d, "
+			  "oversize: %d, truncate_bytes: %d, spill_dir: %s, "
+			  "dlscanner: %s, format: %s, lazy: %d, filter: %s, "
+			  "output_buffer: %d, output_flush: %d, output_overflow: %d ",
+	  args.reopen_delay, backoff, args.reopen_retries, args.input_files_len,
+	  args.from_offset, args.checkpoint_dir, args.checkpoint_interval,
+	  args.manual_ack, args.read_budget_bytes, args.read_budget_reads,
+	  args.io_uring, args.pipeline, args.ring_buffer, args.buf_shrink_delay,
+	  args.oversize, args.truncate_bytes, args.spill_dir, args.dlscanner,
+	  args.format, args.lazy, args.filter, args.output_buffer,
+	  args.output_flush, args.output_overflow);
 
 	return argv[optind];
 }
@@ -184,302 +628,2032 @@ int scanner_dlload(const char* dlpath)
 		goto err;
 	}
 
-	free_scanner = dlsym(dlscanner_handle, "scanner_free");
-	if ((error = dlerror()) != NULL) {
-		fprintf(stderr, "dlsym(scanner_free): %s\n", error);
-		goto err;
+	free_scanner = dlsym(dlscanner_handle, "scanner_free");
+	if ((error = dlerror()) != NULL) {
+		fprintf(stderr, "dlsym(scanner_free): %s\n", error);
+		goto err;
+	}
+
+	create_scanner = dlsym(dlscanner_handle, "scanner_create");
+	if ((error = dlerror()) != NULL) {
+		fprintf(stderr, "dlsym(scanner_create): %s\n", error);
+		goto err;
+	}
+
+	reset_scanner = dlsym(dlscanner_handle, "scanner_reset");
+	if ((error = dlerror()) != NULL) {
+		fprintf(stderr, "dlsym(scanner_reset): %s\n", error);
+		goto err;
+	}
+
+	/* optional: without it partial logs are scanned again once they move */
+	if ((rebase_scanner = dlsym(dlscanner_handle, "scanner_rebase")) == NULL)
+		dlerror();
+
+	/* optional: without it logs are scanned one call at a time */
+	if ((scan_batch_scanner = dlsym(dlscanner_handle, "scanner_scan_batch")) ==
+	  NULL)
+		dlerror();
+
+	/* optional: without it --lazy has no effect */
+	if ((lazy_scanner = dlsym(dlscanner_handle, "scanner_set_lazy")) == NULL)
+		dlerror();
+
+	return 0;
+err:
+	errno = EINVAL;
+	return 1;
+}
+
+static void* format_create_scanner() { return format_scanner_create(format); }
+
+static void output_print(void* ctx, const char* line, size_t len)
+{
+	output_write(ctx, line, len);
+}
+
+/* filter_load compiles the filters of the command line and of the script,
+ * which logs have to pass both, for every new lua state */
+int filter_load()
+{
+	const char* script_filter = lua_filter(lstate);
+	char* expr;
+	int len;
+
+	filter_free(filter);
+	filter = NULL;
+
+	if (args.filter == NULL && script_filter == NULL)
+		return 0;
+
+	if (args.filter == NULL || script_filter == NULL) {
+		filter = filter_compile(
+		  args.filter != NULL ? args.filter : script_filter);
+	} else {
+		len = snprintf(NULL, 0, "(%s) and (%s)", args.filter, script_filter);
+		if ((expr = malloc(len + 1)) == NULL) {
+			perror("malloc");
+			return 1;
+		}
+		snprintf(expr, len + 1, "(%s) and (%s)", args.filter, script_filter);
+		filter = filter_compile(expr);
+		free(expr);
+	}
+
+	if (filter == NULL) {
+		errno = EINVAL;
+		return 1;
+	}
+
+	return 0;
+}
+
+int scanner_format_load(const char* spec)
+{
+	if ((format = format_compile(spec)) == NULL) {
+		errno = EINVAL;
+		return 1;
+	}
+
+	scan_scanner = &format_scanner_scan;
+	free_scanner = &format_scanner_free;
+	create_scanner = &format_create_scanner;
+	reset_scanner = &format_scanner_reset;
+	rebase_scanner = &format_scanner_rebase;
+	scan_batch_scanner = &format_scanner_scan_batch;
+	lazy_scanner = NULL;
+
+	return 0;
+}
+
+void on_close_lua_handle(uv_handle_t* handle)
+{
+	DEBUG_LOG("closed uv handle %p, handles: %d", handle, loop->active_handles);
+}
+
+static bool is_logd_handle(uv_handle_t* handle)
+{
+	size_t i;
+
+	if (handle->data == LOGD_HANDLE)
+		return true;
+
+	for (i = 0; i < inputs_len; i++) {
+		if (handle->data == inputs[i]->tail)
+			return true;
+	}
+
+	return false;
+}
+
+void uv_walk_close_lua_handles(uv_handle_t* handle, void* arg)
+{
+	if (is_logd_handle(handle) || uv_is_closing(handle)) {
+		DEBUG_LOG("skipping uv handle %p", handle);
+		return;
+	}
+
+	DEBUG_LOG("closing uv handle %p", handle);
+	uv_close(handle, on_close_lua_handle);
+}
+
+void close_lua_uv_handles() { uv_walk(loop, uv_walk_close_lua_handles, NULL); }
+
+static void uv_walk_close_handles(uv_handle_t* handle, void* arg)
+{
+	if (!uv_is_closing(handle))
+		uv_close(handle, NULL);
+}
+
+/* write dirty checkpoints and sync their directory once for the batch */
+static void checkpoints_flush()
+{
+	size_t i;
+	int saved = 0;
+
+	for (i = 0; i < inputs_len; i++) {
+		if (!inputs[i]->cp_dirty)
+			continue;
+
+		if (checkpoint_save(inputs[i]->cp_path, &inputs[i]->cp) != 0) {
+			perror("checkpoint_save");
+			continue;
+		}
+
+		inputs[i]->cp_dirty = 0;
+		saved++;
+	}
+
+	if (saved > 0 && checkpoint_sync_dir(args.checkpoint_dir) != 0)
+		perror("checkpoint_sync_dir");
+
+	DEBUG_LOG("flushed %d checkpoints", saved);
+}
+
+static void on_checkpoint_timer(uv_timer_t* timer) { checkpoints_flush(); }
+
+/* input_commit moves the checkpoint of in forward to offset */
+static void input_commit(input_t* in, off_t offset)
+{
+	if (offset < in->cp.offset)
+		return;
+
+	in->cp.offset = offset;
+	in->cp_dirty = 1;
+}
+
+/* input_hand_out records mark before the log it follows is handed to lua
+ * with --manual-ack. A mark that is not past the last one means the logs
+ * after it are being read again, so the marks they had before are dropped */
+static void input_hand_out(input_t* in, off_t mark)
+{
+	pending_mark_t* marks;
+	size_t cap;
+
+	if (!args.manual_ack || mark < 0)
+		return;
+
+	while (in->marks_len > 0 &&
+	  in->marks[in->marks_head + in->marks_len - 1].offset >= mark)
+		in->marks_len--;
+
+	if (in->marks_head + in->marks_len == in->marks_cap) {
+		if (in->marks_head > 0) {
+			memmove(in->marks, in->marks + in->marks_head,
+			  in->marks_len * sizeof(pending_mark_t));
+			in->marks_head = 0;
+		} else {
+			cap = in->marks_cap > 0 ? in->marks_cap * 2 : 64;
+			if ((marks = realloc(in->marks, cap * sizeof(pending_mark_t))) ==
+			  NULL) {
+				/* the checkpoint stays behind the log instead of skipping
+				 * it */
+				perror("realloc");
+				return;
+			}
+			in->marks = marks;
+			in->marks_cap = cap;
+		}
+	}
+
+	in->marks[in->marks_head + in->marks_len].offset = mark;
+	in->marks[in->marks_head + in->marks_len].acked = 0;
+	in->marks_len++;
+}
+
+/* input_find_mark returns the pending mark at offset, if any */
+static pending_mark_t* input_find_mark(input_t* in, off_t offset)
+{
+	size_t lo = in->marks_head, hi = in->marks_head + in->marks_len, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (in->marks[mid].offset == offset)
+			return &in->marks[mid];
+		if (in->marks[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+/* input_ack acks the logs up to offset. Logs are acked in order unless
+ * --manual-ack is given, in which case the checkpoint only advances to the
+ * end of the marks that are acked with all the ones before them, so that
+ * logs still being handled asynchronously are read again after a restart */
+static void input_ack(input_t* in, uint32_t gen, off_t offset)
+{
+	pending_mark_t* m;
+
+	if (offset < 0 || gen != in->cp_gen)
+		return;
+
+	if (!args.manual_ack) {
+		input_commit(in, offset);
+		return;
+	}
+
+	if ((m = input_find_mark(in, offset)) == NULL)
+		return;
+	m->acked = 1;
+
+	while (in->marks_len > 0 && in->marks[in->marks_head].acked) {
+		input_commit(in, in->marks[in->marks_head].offset);
+		in->marks_head++;
+		in->marks_len--;
+	}
+}
+
+/* file offset right after consumed bytes past the read position of the input
+ * buffer, or -1 if positions of this input are not tracked */
+static off_t input_mark(input_t* in, size_t consumed)
+{
+	off_t offset;
+
+	if (!in->cp_valid || (offset = tail_tell(in->tail)) < 0)
+		return -1;
+
+	offset -= in->b->next_write - in->b->next_read - consumed;
+
+	return offset < 0 ? -1 : offset;
+}
+
+/* filter_pass returns whether log passes the filter and counts it */
+static bool filter_pass(log_t* log)
+{
+	if (filter_match(filter, log)) {
+		stats.filter_passed++;
+		return true;
+	}
+
+	stats.filter_dropped++;
+	return false;
+}
+
+/* filter_logs moves the n logs that pass the filter to the front of logs and
+ * returns how many there are */
+static size_t filter_logs(log_t* logs, size_t n)
+{
+	size_t i, passed = 0;
+
+	for (i = 0; i < n; i++) {
+		if (filter_pass(&logs[i]))
+			logs[passed++] = logs[i];
+	}
+
+	return passed;
+}
+
+/* logs that are dropped by the filter are acked as if lua had handled them */
+static void input_call_on_log(input_t* in, log_t* log, off_t mark)
+{
+	input_hand_out(in, mark);
+
+	if (filter == NULL || filter_pass(log)) {
+		in->mark = mark;
+		curr_input = in;
+		log->is_safe = true;
+		lua_call_on_log(lstate, log, in->file);
+		log->is_safe = false;
+		curr_input = NULL;
+		if (args.manual_ack)
+			return;
+	}
+
+	input_ack(in, in->cp_gen, mark);
+}
+
+/* input_call_on_logs hands n logs to logd.on_logs at once. They are marked
+ * and acked as a whole, right after the last one */
+static void input_call_on_logs(input_t* in, log_t* logs, size_t n, off_t mark)
+{
+	size_t i;
+
+	input_hand_out(in, mark);
+
+	if (filter != NULL)
+		n = filter_logs(logs, n);
+
+	if (n > 0) {
+		in->mark = mark;
+		curr_input = in;
+		for (i = 0; i < n; i++)
+			logs[i].is_safe = true;
+		lua_call_on_logs(lstate, logs, n, in->file);
+		for (i = 0; i < n; i++)
+			logs[i].is_safe = false;
+		curr_input = NULL;
+		if (args.manual_ack)
+			return;
+	}
+
+	input_ack(in, in->cp_gen, mark);
+}
+
+void call_on_error(
+  input_t* in, const char* err, log_t* partial, const char* at, off_t mark)
+{
+	input_hand_out(in, mark);
+
+	if (lua_on_error_defined(lstate)) {
+		in->mark = mark;
+		curr_input = in;
+		partial->is_safe = true;
+		lua_call_on_error(lstate, err, partial, at, in->file);
+		partial->is_safe = false;
+		curr_input = NULL;
+		if (args.manual_ack)
+			return;
+	}
+
+	/* what lua did not see is acked as if it was handled */
+	input_ack(in, in->cp_gen, mark);
+}
+
+static int logd_mark(lua_State* L)
+{
+	mark_t mark;
+
+	if (curr_input == NULL) {
+		return luaL_error(L,
+		  "'" LUA_NAME_MARK "' can only be called from logd.on_log, "
+		  "logd.on_logs or logd.on_error");
+	}
+
+	mark.input = curr_input->id;
+	mark.gen = curr_input->cp_gen;
+	mark.offset = curr_input->mark;
+	lua_pushlstring(L, (const char*)&mark, sizeof(mark_t));
+
+	return 1;
+}
+
+static int logd_ack(lua_State* L)
+{
+	const char* str;
+	size_t len;
+	mark_t mark;
+
+	if (lua_isnoneornil(L, 1)) {
+		if (curr_input == NULL) {
+			return luaL_error(L,
+			  "'" LUA_NAME_ACK "' without a mark can only be called from "
+			  "logd.on_log, logd.on_logs or logd.on_error");
+		}
+		input_ack(curr_input, curr_input->cp_gen, curr_input->mark);
+		return 0;
+	}
+
+	str = luaL_checklstring(L, 1, &len);
+	if (len != sizeof(mark_t)) {
+		return luaL_argerror(
+		  L, 1, "must be a mark returned by '" LUA_NAME_MARK "'");
+	}
+
+	memcpy(&mark, str, sizeof(mark_t));
+	if (mark.input < inputs_len)
+		input_ack(inputs[mark.input], mark.gen, mark.offset);
+
+	return 0;
+}
+
+#define SET_STAT_FIELD(L, name)                                                \
+	lua_pushnumber(L, (lua_Number)stats.name);                                 \
+	lua_setfield(L, -2, #name);
+
+#define SET_OUTPUT_STAT_FIELD(L, name)                                         \
+	lua_pushnumber(L, (lua_Number)output.name);                                \
+	lua_setfield(L, -2, "output_" #name);
+
+static int logd_stats(lua_State* L)
+{
+	lua_createtable(L, 0, 12);
+	SET_STAT_FIELD(L, read_wakeups);
+	SET_STAT_FIELD(L, read_calls);
+	SET_STAT_FIELD(L, read_bytes);
+	SET_STAT_FIELD(L, read_budget_exhausted);
+	SET_STAT_FIELD(L, buf_bytes);
+	SET_STAT_FIELD(L, buf_reallocs);
+	SET_STAT_FIELD(L, buf_copied_bytes);
+	SET_STAT_FIELD(L, filter_passed);
+	SET_STAT_FIELD(L, filter_dropped);
+	SET_OUTPUT_STAT_FIELD(L, bytes);
+	SET_OUTPUT_STAT_FIELD(L, flushes);
+	SET_OUTPUT_STAT_FIELD(L, drops);
+
+	return 1;
+}
+
+static const struct luaL_Reg logd_daemon_functions[] = {
+  {LUA_NAME_MARK, &logd_mark}, {LUA_NAME_ACK, &logd_ack},
+  {LUA_NAME_STATS, &logd_stats}, {NULL, NULL}};
+
+void close_logd_uv_handles(
+  int status_code, enum exit_reason reason, const char* reason_str)
+{
+	size_t i;
+
+	DEBUG_LOG("closing logd libuv handles, handles: %d", loop->active_handles);
+
+	if (lua_on_exit_defined(lstate)) {
+		lua_call_on_exit(lstate, reason, reason_str);
+	}
+
+	pret = status_code;
+	for (i = 0; i < inputs_len; i++) {
+		uv_timer_stop(&inputs[i]->reopen_timer);
+		uv_timer_stop(&inputs[i]->shrink_timer);
+		input_close(inputs[i]);
+	}
+	uv_signal_stop(&sigusr1);
+	uv_signal_stop(&sigusr2);
+	uv_signal_stop(&sigint);
+#ifdef LOGD_URING
+	if (ring != NULL)
+		uv_poll_stop(&ring_poll);
+#endif
+
+	if (args.checkpoint_dir != NULL) {
+		uv_timer_stop(&checkpoint_timer);
+		checkpoints_flush();
+	}
+
+	/* prints from lua handles that are still open are written right away */
+	output_close(&output);
+
+	DEBUG_LOG("closed logd libuv handles, handles: %d", loop->active_handles);
+}
+
+void close_all(int status_code, enum exit_reason reason, const char* reason_str)
+{
+	size_t i;
+
+	DEBUG_LOG("closing all libuv handles, handles: %d", loop->active_handles);
+
+	close_logd_uv_handles(status_code, reason, reason_str);
+	close_lua_uv_handles();
+
+	for (i = 0; i < inputs_len; i++)
+		inputs[i]->state = EXIT_ISTATE;
+
+	DEBUG_LOG("closed all libuv handles, handles: %d", loop->active_handles);
+}
+
+static size_t inputs_active()
+{
+	size_t i, active = 0;
+
+	for (i = 0; i < inputs_len; i++) {
+		if (inputs[i]->state != EXIT_ISTATE)
+			active++;
+	}
+
+	return active;
+}
+
+/* stop reading from input for good: logd exits once all inputs are done */
+static void input_exit(input_t* in, int status_code, enum exit_reason reason,
+  const char* reason_str)
+{
+	DEBUG_LOG("input exit, input_file: %s, reason: %s", in->file, reason_str);
+
+	uv_timer_stop(&in->reopen_timer);
+	input_close(in);
+	in->state = EXIT_ISTATE;
+
+	if (inputs_active() == 0)
+		close_logd_uv_handles(status_code, reason, reason_str);
+}
+
+static void input_set_timeout(input_t* in, int timeout, uv_timer_cb func)
+{
+	uv_timer_start(&in->reopen_timer, func, timeout, 0);
+}
+
+static void input_reopen(input_t* in)
+{
+	DEBUG_LOG("trying to reopen file %s, current retries: %d", in->file,
+	  in->reopen_retries);
+
+	input_close(in);
+	input_reopen_open(in);
+}
+
+static void on_input_reopen(uv_timer_t* timer)
+{
+	input_reopen(INPUT_OF(timer, reopen_timer));
+}
+
+static void on_input_reopen_open(uv_timer_t* timer)
+{
+	input_reopen_open(INPUT_OF(timer, reopen_timer));
+}
+
+static void input_reopen_open(input_t* in)
+{
+	int ret;
+
+	in->reopen_retries += 1;
+	DEBUG_LOG("reopen attempt, input_file: %s, state: %d, current_try: %d",
+	  in->file, in->state, in->reopen_retries);
+
+	if ((ret = input_open(in)) != 0) {
+		perror("input_open");
+		if (in->reopen_retries <= args.reopen_retries) {
+			input_set_timeout(in,
+			  next_attempt_backoff(
+				args.reopen_delay, in->reopen_retries, backoff),
+			  on_input_reopen);
+		} else {
+			input_exit(in, 1, REASON_EOF, "exhausted reopen retries");
+		}
+	}
+}
+
+static void input_spill_open(input_t* in)
+{
+	size_t len = strlen(args.spill_dir) + sizeof("/logd.XXXXXX");
+
+	if ((in->spill_path = malloc(len)) == NULL) {
+		perror("malloc");
+		return;
+	}
+
+	snprintf(in->spill_path, len, "%s/logd.XXXXXX", args.spill_dir);
+	if ((in->spill_fd = mkstemp(in->spill_path)) == -1) {
+		perror("mkstemp");
+		free(in->spill_path);
+		in->spill_path = NULL;
+	}
+}
+
+static void input_spill_write(input_t* in, const char* data, size_t len)
+{
+	ssize_t ret;
+
+	while (in->spill_fd != -1 && len > 0) {
+		if ((ret = write(in->spill_fd, data, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("spill write");
+			close(in->spill_fd);
+			in->spill_fd = -1;
+			unlink(in->spill_path);
+			free(in->spill_path);
+			in->spill_path = NULL;
+			return;
+		}
+		data += ret;
+		len -= ret;
+	}
+}
+
+/* input_spill_reset forgets the line being spilled, which ended before it
+ * was too long to scan, and removes its file */
+static void input_spill_reset(input_t* in)
+{
+	if (in->spill_fd != -1) {
+		close(in->spill_fd);
+		in->spill_fd = -1;
+		unlink(in->spill_path);
+	}
+	free(in->spill_path);
+	in->spill_path = NULL;
+	in->spilling = 0;
+	in->raw_len = 0;
+}
+
+/* input_spill_tee keeps the len bytes just read at data for the line being
+ * read, before they are scanned. Lines end at newlines as oversized logs are
+ * read past up to the next one */
+static void input_spill_tee(input_t* in, const char* data, size_t len)
+{
+	const char* end = data + len;
+
+	/* only what follows the last newline belongs to the line being read */
+	while (end > data && end[-1] != '\n')
+		end--;
+	if (end > data) {
+		if (in->spilling)
+			input_spill_reset(in);
+		in->raw_len = 0;
+		len -= end - data;
+		data = end;
+	}
+
+	if (!in->spilling && in->raw_len + len <= LOGD_BUF_INIT_CAP) {
+		memcpy(in->raw + in->raw_len, data, len);
+		in->raw_len += len;
+		return;
+	}
+
+	if (!in->spilling) {
+		in->spilling = 1;
+		input_spill_open(in);
+		input_spill_write(in, in->raw, in->raw_len);
+		in->raw_len = 0;
+	}
+	input_spill_write(in, data, len);
+}
+
+/* input_oversize_start is called when a log does not fit in the largest
+ * buffer. The first args.truncate_bytes of the log are kept for lua while the
+ * rest of the buffer is reused to read until the end of the log, looking for
+ * a newline rather than scanning */
+static void input_oversize_start(input_t* in, log_t* log)
+{
+	buf_t* b = in->b;
+	char* cut = in->log_start + args.truncate_bytes;
+	size_t past = b->next_write - cut;
+	prop_t* prop;
+
+	DEBUG_ASSERT(cut > in->log_start && cut < b->next_write);
+
+	/* a lazy scanner stopped at the body and what is kept of it would be
+	 * lost, so the log is scanned again in full up to cut */
+	if (args.lazy && lazy_scanner != NULL) {
+		reset_scanner(in->scanner);
+		lazy_scanner(in->scanner, false);
+		log = scan_scanner(in->scanner, in->log_start, cut - in->log_start).log;
+		lazy_scanner(in->scanner, true);
+	}
+
+	/* the log ends at cut and anything the scanner found past it is about to
+	 * be overwritten */
+	*cut = '\x00';
+	for (prop = log->props; prop != NULL; prop = prop->next) {
+		if ((uintptr_t)prop->key - (uintptr_t)cut <= past)
+			prop->key = "";
+		/* a key that was not done may be left with the value of an older
+		 * log, which could be in a buffer that was grown since */
+		if ((uintptr_t)prop->value - (uintptr_t)in->log_start >=
+		  args.truncate_bytes)
+			prop->value = "";
+		/* what was recorded of keys and values may reach past cut */
+		prop->klen = 0;
+		prop->vlen = 0;
+		prop->kid = KEY_ID_NONE;
+	}
+	log_reindex(log);
+
+	in->oversize = 1;
+	in->oversize_log = log;
+	b->next_read = b->next_write = cut + 1;
+}
+
+/* input_oversize_end hands the oversized log to lua once its end is read:
+ * consumed is the length of what is left of it at the next read position,
+ * newline included */
+static void input_oversize_end(input_t* in, size_t consumed)
+{
+	buf_t* b = in->b;
+	log_t* log = in->oversize_log;
+	off_t mark = input_mark(in, consumed);
+	size_t len;
+
+	/* the spill file is kept for lua */
+	if (in->spill_fd != -1) {
+		close(in->spill_fd);
+		in->spill_fd = -1;
+	}
+
+	switch (args.oversize) {
+	case OVERSIZE_SKIP:
+		call_on_error(in, OVERSIZE_SKIP_ERROR, log, "", mark);
+		break;
+	case OVERSIZE_SPILL:
+		if (in->spill_path != NULL)
+			log_set(log, &in->oversize_props[1], KEY_SPILL, in->spill_path);
+		/* fallthrough */
+	case OVERSIZE_TRUNCATE:
+		log_set(log, &in->oversize_props[0], KEY_TRUNCATED, "true");
+		input_call_on_log(in, log, mark);
+		break;
+	}
+
+	free(in->spill_path);
+	in->spill_path = NULL;
+	in->spilling = 0;
+	in->oversize = 0;
+	in->oversize_log = NULL;
+
+	/* data read past the log goes back to the beginning of the buffer */
+	buf_ack(b, consumed);
+	len = buf_readable(b);
+	memmove(b->buf, b->next_read, len);
+	b->next_read = b->buf;
+	b->next_write = b->buf + len;
+	stats.buf_copied_bytes += len;
+	logd_reset_scanner(in);
+}
+
+/* input_oversize_abort drops the oversized log being read past, if any, and
+ * what was kept of the line being read for spilling */
+static void input_oversize_abort(input_t* in)
+{
+	input_spill_reset(in);
+	if (!in->oversize)
+		return;
+
+	in->oversize = 0;
+	in->oversize_log = NULL;
+
+	buf_reset_offsets(in->b);
+	logd_reset_scanner(in);
+}
+
+void input_close(input_t* in)
+{
+	uv_fs_t req_in_close;
+
+	DEBUG_LOG("input close attempt, input_file: %s, state: %d", in->file,
+	  in->state);
+
+	switch (in->state) {
+	case EXIT_ISTATE:
+	case CLOSED_ISTATE:
+		return;
+	case OPENING_ISTATE:
+		/* fallthrough */
+	case READING_ISTATE:
+		break;
+	}
+
+	DEBUG_LOG("closing input, fd: %d", in->fd);
+
+	if (uv_is_active((uv_handle_t*)&in->poll))
+		uv_poll_stop(&in->poll);
+	uv_idle_stop(&in->pending);
+	backfill_stop(in);
+	input_oversize_abort(in);
+#ifdef LOGD_URING
+	if (in->uring) {
+		uring_reader_stop(&in->reader);
+		in->uring = 0;
+	}
+#endif
+	if (in->pipelined) {
+		pipeline_stop(&in->pipeline);
+		in->pipelined = 0;
+		if (args.lazy && lazy_scanner != NULL)
+			lazy_scanner(in->scanner, true);
+	}
+
+	if (in->is_reg) {
+		tail_close(in->tail);
+	} else if (in->fd != -1) {
+		uv_fs_close(loop, &req_in_close, in->fd, NULL);
+		uv_fs_req_cleanup(&req_in_close);
+	}
+
+	DEBUG_LOG("closed input, fd: %d", in->fd);
+
+	in->fd = -1;
+	in->state = CLOSED_ISTATE;
+}
+
+void input_reopen_attempt(input_t* in, int exit_status)
+{
+	uv_timer_cb open_func;
+
+	DEBUG_LOG("input reopen attempt, input_file: %s, exit_status: %d, "
+			  "state: %d",
+	  in->file, exit_status, in->state);
+
+	switch (in->state) {
+	case OPENING_ISTATE:
+		DEBUG_LOG("reopen mechanism in-progress, current_retry: %d",
+		  in->reopen_retries);
+		/* falltrhough */
+	case EXIT_ISTATE:
+		return;
+	case CLOSED_ISTATE:
+		open_func = on_input_reopen_open;
+		break;
+	case READING_ISTATE:
+		open_func = on_input_reopen;
+		break;
+	}
+
+	if (args.reopen_retries != 0) {
+		in->state = OPENING_ISTATE;
+		input_set_timeout(in,
+		  next_attempt_backoff(args.reopen_delay, in->reopen_retries, backoff),
+		  open_func);
+	} else {
+		input_exit(in, 0, REASON_EOF,
+		  "reached EOF and reopen retries is configured to 0");
+	}
+}
+
+static void on_tail_exit(tail_t* tail, int exit_status)
+{
+	input_reopen_attempt(tail->data, exit_status);
+}
+
+int input_open_nonreg(uv_loop_t* loop, char* input_file)
+{
+	uv_fs_t uv_open_in_req;
+	int ret;
+
+	if ((ret = uv_fs_open(loop, &uv_open_in_req, input_file,
+		   O_NONBLOCK | O_RDONLY, 0, NULL)) < 0) {
+		errno = -ret;
+		perror("uv_fs_open");
+		ret = -1;
+		goto exit;
+	}
+
+	ret = uv_open_in_req.result;
+
+exit:
+	uv_fs_req_cleanup(&uv_open_in_req);
+	return ret;
+}
+
+static int input_poll_start(input_t* in, uv_poll_cb cb)
+{
+	in->poll_cb = cb;
+	if (in->uring)
+		return 0;
+
+	return uv_poll_start(&in->poll, UV_READABLE, cb);
+}
+
+/* regular files are followed via inotify which only signals changes to the
+ * file and io_uring inputs are only signaled when a read completes, so when
+ * reading stops short of EAGAIN there may be more data left: read again on
+ * the next loop iteration instead of waiting for a change */
+#define INPUT_NEEDS_NUDGE(in) ((in)->is_reg || (in)->uring)
+
+static void on_input_pending(uv_idle_t* handle)
+{
+	input_t* in = INPUT_OF(handle, pending);
+
+	uv_idle_stop(handle);
+	in->poll_cb(&in->poll, 0, UV_READABLE);
+}
+
+static ssize_t input_read(input_t* in, char* buf, size_t len)
+{
+	if (in->is_reg)
+		return tail_read(in->tail, buf, len);
+#ifdef LOGD_URING
+	if (in->uring)
+		return uring_reader_read(&in->reader, buf, len);
+#endif
+
+	return read(in->fd, buf, len);
+}
+
+#ifdef LOGD_URING
+static void on_ring_poll(uv_poll_t* req, int status, int events)
+{
+	if (status < 0) {
+		on_poll_err(status);
+		return;
+	}
+
+	if (uring_process(ring) != 0)
+		close_all(1, REASON_ERROR, "io_uring error");
+}
+
+static int ring_init()
+{
+	int ret;
+
+	if ((ring = uring_create(URING_SLOTS, URING_SLOT_LEN)) == NULL) {
+		perror("uring_create");
+		fprintf(stderr, "io_uring is not available, using poll instead\n");
+		return 0;
+	}
+
+	if ((ret = uv_poll_init(loop, &ring_poll, uring_fd(ring))) < 0 ||
+	  (ret = uv_poll_start(&ring_poll, UV_READABLE, on_ring_poll)) < 0) {
+		errno = -ret;
+		perror("uv_poll");
+		return 1;
+	}
+
+	STAMP_HANDLE((uv_handle_t*)&ring_poll);
+
+	return 0;
+}
+
+static void on_input_uring(uring_reader_t* reader)
+{
+	input_t* in = reader->data;
+
+	in->poll_cb(&in->poll, 0, UV_READABLE);
+}
+
+/* reads are queued to the kernel so that they complete while the scanner is
+ * busy with data that was already read */
+static int input_uring_start(input_t* in)
+{
+	if (ring == NULL)
+		return 1;
+
+	in->reader.cb = on_input_uring;
+	in->reader.data = in;
+	if (uring_reader_start(ring, &in->reader, in->fd) != 0) {
+		perror("uring_reader_start");
+		fprintf(stderr, "reading %s with poll instead of io_uring\n", in->file);
+		return 1;
+	}
+
+	in->uring = 1;
+	in->poll_cb = on_read;
+
+	return 0;
+}
+#endif
+
+/* input_call_pipelined hands n complete logs of a pipeline slot to lua. They
+ * borrow the indexes of the batch, LOGD_SCAN_BATCH_CAP logs at a time.
+ * Positions of non regular inputs are not tracked so they are not marked */
+static void input_call_pipelined(input_t* in, log_t* logs, size_t n)
+{
+	size_t i, len;
+
+	for (; n > 0; logs += len, n -= len) {
+		len = n < LOGD_SCAN_BATCH_CAP ? n : LOGD_SCAN_BATCH_CAP;
+		for (i = 0; batch != NULL && i < len; i++)
+			log_set_index(&logs[i], &batch->indexes[i]);
+
+		if (lua_on_logs_defined(lstate)) {
+			input_call_on_logs(in, logs, len, -1);
+			continue;
+		}
+
+		for (i = 0; i < len; i++)
+			input_call_on_log(in, &logs[i], -1);
+	}
+}
+
+/* the reader thread reads past the rest of oversized logs without keeping it,
+ * so they are never spilled */
+static void input_call_pipelined_oversize(input_t* in, log_t* log)
+{
+	if (args.oversize == OVERSIZE_SKIP) {
+		call_on_error(in, OVERSIZE_SKIP_ERROR, log, "", -1);
+		return;
+	}
+
+	log_set(log, &in->oversize_props[0], KEY_TRUNCATED, "true");
+	input_call_on_log(in, log, -1);
+}
+
+static void on_input_pipeline(pipeline_t* p, pipeline_slot_t* slot)
+{
+	input_t* in = p->data;
+	size_t i, j;
+
+	stats.read_wakeups++;
+	stats.read_calls += slot->reads;
+	stats.read_bytes += slot->bytes;
+	/* the reader got this far, even if it only found the end of the input */
+	in->reopen_retries = 0;
+	in->state = READING_ISTATE;
+
+	for (i = 0; i < slot->len; i = j + 1) {
+		for (j = i; j < slot->len && slot->res[j].type == PIPELINE_LOG; j++)
+			;
+		input_call_pipelined(in, &slot->logs[i], j - i);
+		if (j == slot->len)
+			break;
+
+		if (slot->res[j].type == PIPELINE_OVERSIZE) {
+			input_call_pipelined_oversize(in, &slot->logs[j]);
+			continue;
+		}
+
+		DEBUG_LOG("scan error: %s", slot->res[j].error);
+		call_on_error(
+		  in, slot->res[j].error, &slot->logs[j], slot->res[j].at, -1);
+	}
+
+	if (slot->error != 0) {
+		errno = slot->error;
+		on_read_err(-errno);
+	} else if (slot->eof) {
+		DEBUG_LOG("EOF while reading input file %d", in->fd);
+		on_eof(in);
+	}
+}
+
+/* the fd and the scanner of a pipelined input belong to its reader thread
+ * until input_close. Pipelines are only set up for the inputs that turn out
+ * not to be regular files */
+static int input_pipeline_start(input_t* in)
+{
+	pipeline_t* p = &in->pipeline;
+
+	if (p->cb == NULL) {
+		if (pipeline_init(p, loop, LOGD_BUF_INIT_CAP, LOGD_BUF_MAX_CAP) !=
+		  0) {
+			perror("pipeline_init");
+			pipeline_free(p);
+			return 1;
+		}
+		p->scan = scan_scanner;
+		p->reset = reset_scanner;
+		p->rebase = rebase_scanner;
+		p->truncate = args.truncate_bytes;
+		p->shrink_delay = args.buf_shrink_delay;
+		p->cb = on_input_pipeline;
+		p->data = in;
+		STAMP_HANDLE((uv_handle_t*)&p->async);
+	}
+
+	/* logs are copied out of the scanner, which leaves deferred bodies
+	 * behind */
+	if (lazy_scanner != NULL)
+		lazy_scanner(in->scanner, false);
+
+	if (pipeline_start(p, in->fd, in->scanner) != 0) {
+		perror("pipeline_start");
+		fprintf(stderr, "reading %s on the event loop instead\n", in->file);
+		if (args.lazy && lazy_scanner != NULL)
+			lazy_scanner(in->scanner, true);
+		return 1;
+	}
+
+	in->pipelined = 1;
+
+	return 0;
+}
+
+static int input_poll_init(input_t* in)
+{
+	int ret;
+
+	if (!in->is_reg && args.pipeline && input_pipeline_start(in) == 0)
+		return 0;
+
+#ifdef LOGD_URING
+	if (!in->is_reg && input_uring_start(in) == 0)
+		return 0;
+#endif
+
+	if ((ret = uv_poll_init(loop, &in->poll, in->fd)) ||
+	  (ret = input_poll_start(in, &on_read)) < 0) {
+		errno = -ret;
+		perror("uv_poll");
+		return 1;
+	}
+
+	STAMP_HANDLE((uv_handle_t*)&in->poll);
+
+	return 0;
+}
+
+/* start following a regular file from offset and read whatever is already
+ * there without waiting for the file to change */
+static int input_follow(input_t* in, off_t offset)
+{
+	if ((in->fd = tail_open_at(in->tail, offset, on_tail_exit)) < 0) {
+		perror("tail_open_at");
+		return 1;
+	}
+
+	if (input_poll_init(in) != 0)
+		return 1;
+
+	uv_idle_start(&in->pending, on_input_pending);
+
+	return 0;
+}
+
+static void backfill_stop(input_t* in)
+{
+	uv_idle_stop(&in->backfill.idle);
+
+	if (in->backfill.map != NULL) {
+		munmap(in->backfill.map, in->backfill.map_len);
+		in->backfill.map = NULL;
+	}
+	if (in->backfill.fd != -1) {
+		UNEINTR2(close(in->backfill.fd));
+		in->backfill.fd = -1;
+	}
+}
+
+/* backfill_follow stops backfilling and follows the input from offset */
+static void backfill_follow(input_t* in, off_t offset)
+{
+	DEBUG_LOG("finished backfill of %s, following from offset %lld", in->file,
+	  (long long)offset);
+
+	backfill_stop(in);
+	logd_reset_scanner(in);
+
+	if (input_follow(in, offset) != 0) {
+		perror("input_follow");
+		close_all(1, REASON_ERROR, "could not follow input after backfill");
+	}
+}
+
+/* backfill_release hands the pages before the log being scanned back to the
+ * kernel. Scanners write to the private mapping, which would otherwise keep
+ * a copy of every page of the file scanned so far */
+static void backfill_release(struct backfill_s* bf)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+	char* end = bf->map + (bf->log_start - bf->map) / pagesize * pagesize;
+
+	if (end <= bf->released)
+		return;
+
+	if (madvise(bf->released, end - bf->released, MADV_DONTNEED) != 0)
+		perror("madvise");
+	bf->released = end;
+}
+
+/* backfill_clamp keeps the slices within the file, which may have been
+ * truncated since it was mapped: pages past its end cannot be read. It
+ * returns 1 if the file no longer has the log being scanned */
+static int backfill_clamp(struct backfill_s* bf)
+{
+	struct stat st;
+	off_t end = bf->map_offset + (bf->last - bf->map);
+
+	if (fstat(bf->fd, &st) != 0) {
+		perror("fstat");
+		return 0;
+	}
+
+	if (st.st_size >= end)
+		return 0;
+
+	DEBUG_LOG("backfilled file shrank to %lld bytes", (long long)st.st_size);
+
+	if (st.st_size < bf->map_offset + (bf->next_read - bf->map))
+		return 1;
+
+	bf->last = bf->map + (st.st_size - bf->map_offset);
+	return 0;
+}
+
+/* file offset right after the last log scanned by backfill, if marked */
+static off_t backfill_mark(input_t* in)
+{
+	struct backfill_s* bf = &in->backfill;
+
+	return in->cp_valid ? bf->map_offset + (bf->next_read - bf->map) : -1;
+}
+
+/* backfill_call_batch hands the first n logs of the last batch to lua, in a
+ * single call if the script defines logd.on_logs */
+static void backfill_call_batch(input_t* in, size_t n)
+{
+	struct backfill_s* bf = &in->backfill;
+	size_t i;
+
+	if (n == 0)
+		return;
+
+	if (!lua_on_logs_defined(lstate)) {
+		for (i = 0; i < n; i++) {
+			bf->next_read += batch->res[i].consumed;
+			input_call_on_log(in, batch->res[i].log, backfill_mark(in));
+		}
+	} else {
+		for (i = 0; i < n; i++)
+			bf->next_read += batch->res[i].consumed;
+		input_call_on_logs(in, batch->logs, n, backfill_mark(in));
+	}
+
+	bf->log_start = bf->next_read;
+}
+
+static void on_backfill(uv_idle_t* handle)
+{
+	input_t* in = INPUT_OF(handle, backfill.idle);
+	struct backfill_s* bf = &in->backfill;
+	scan_res_t res;
+	size_t slice_len, n;
+	char* slice_last;
+
+	in->reopen_retries = 0;
+	in->state = READING_ISTATE;
+
+	/* a truncated file is read again from its start by the follower */
+	if (backfill_clamp(bf)) {
+		backfill_follow(in, 0);
+		return;
+	}
+	slice_len = bf->last - bf->next_read;
+	slice_last = bf->next_read +
+	  (slice_len > BACKFILL_SLICE_LEN ? BACKFILL_SLICE_LEN : slice_len);
+
+	/* the map does not move, so unlike input_scan a partial log is left to
+	 * the batch scanner to resume in the next slice */
+	while (bf->next_read < slice_last) {
+		if (scan_batch_scanner != NULL) {
+			n = scan_batch_scanner(
+			  in->scanner, bf->next_read, slice_last - bf->next_read, batch);
+			res = batch->res[n - 1];
+			backfill_call_batch(in, res.type == SCAN_COMPLETE ? n : n - 1);
+			if (res.type == SCAN_COMPLETE)
+				continue;
+		} else {
+			res = scan_scanner(
+			  in->scanner, bf->next_read, slice_last - bf->next_read);
+		}
+		bf->next_read += res.consumed;
+
+		switch (res.type) {
+		case SCAN_COMPLETE:
+			input_call_on_log(in, res.log, backfill_mark(in));
+			break;
+		case SCAN_ERROR:
+			DEBUG_LOG("backfill scan error: %s", res.error.msg);
+			call_on_error(
+			  in, res.error.msg, res.log, res.error.at, backfill_mark(in));
+			break;
+		case SCAN_PARTIAL:
+			continue;
+		}
+
+		reset_scanner(in->scanner);
+		bf->log_start = bf->next_read;
+	}
+
+	if (bf->next_read < bf->last) {
+		backfill_release(bf);
+		return;
+	}
+
+	/* re-read the trailing partial log, if any, through the follower */
+	backfill_follow(in, bf->map_offset + (bf->log_start - bf->map));
+}
+
+/* map the input file and scan it in place from offset, one slice per loop
+ * iteration, before following it like tail -f would */
+static int backfill_start(input_t* in, off_t offset)
+{
+	struct backfill_s* bf = &in->backfill;
+	struct stat st;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	int fd, ret = 0;
+
+	do {
+		errno = 0;
+		fd = open(in->file, O_RDONLY | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1) {
+		perror("open");
+		return 1;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		perror("fstat");
+		ret = 1;
+		goto exit;
+	}
+
+	if (offset >= st.st_size) {
+		ret = input_follow(in, st.st_size);
+		goto exit;
+	}
+
+	bf->map_offset = offset - offset % pagesize;
+	bf->map_len = st.st_size - bf->map_offset;
+
+	/* private and writable: scanners null-terminate tokens in place */
+	bf->map = mmap(NULL, bf->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+	  bf->map_offset);
+	if (bf->map == MAP_FAILED) {
+		perror("mmap");
+		bf->map = NULL;
+		ret = input_follow(in, offset);
+		goto exit;
+	}
+
+	if (madvise(bf->map, bf->map_len, MADV_SEQUENTIAL) != 0)
+		perror("madvise");
+
+	bf->released = bf->map;
+	bf->log_start = bf->map + (offset - bf->map_offset);
+	bf->next_read = bf->log_start;
+	bf->last = bf->map + bf->map_len;
+	bf->fd = fd;
+	fd = -1;
+
+	DEBUG_LOG("backfilling %zu bytes of %s from offset %lld", bf->map_len,
+	  in->file, (long long)offset);
+
+	uv_idle_start(&bf->idle, on_backfill);
+
+exit:
+	if (fd != -1)
+		UNEINTR2(close(fd));
+	return ret;
+}
+
+/* offset to start reading a regular file from. --from-start and
+ * --from-offset only apply the first time it is opened, and a checkpoint of
+ * the same file takes precedence over them */
+static off_t input_start_offset(input_t* in, const uv_stat_t* st)
+{
+	off_t offset = TAIL_OFFSET_END;
+
+	if (!in->backfill.done && args.from_offset != -1)
+		offset = args.from_offset;
+	in->backfill.done = 1;
+
+	if (in->cp_path == NULL)
+		return offset;
+
+	if (in->cp_valid && in->cp.dev == st->st_dev &&
+	  in->cp.ino == st->st_ino && in->cp.offset <= (off_t)st->st_size) {
+		DEBUG_LOG("resuming %s from checkpoint at offset %lld", in->file,
+		  (long long)in->cp.offset);
+		return in->cp.offset;
+	}
+
+	/* the file was rotated or truncated since it was checkpointed: read all
+	 * of it so that nothing written to it meanwhile is lost */
+	if (in->cp_valid)
+		offset = 0;
+	else if (offset == TAIL_OFFSET_END)
+		offset = st->st_size;
+
+	in->cp_gen++;
+	in->marks_head = in->marks_len = 0;
+	in->cp_valid = 1;
+	in->cp_dirty = 1;
+	in->cp.dev = st->st_dev;
+	in->cp.ino = st->st_ino;
+	in->cp.offset = offset;
+
+	return offset;
+}
+
+int input_open(input_t* in)
+{
+	uv_fs_t uv_stat_in_req;
+	off_t offset;
+	int ret, mode;
+
+	DEBUG_LOG("input open, input_file: %s, state: %d", in->file, in->state);
+
+	switch (in->state) {
+	case EXIT_ISTATE:
+		/* fallthrough */
+	case READING_ISTATE:
+		return 0;
+	case OPENING_ISTATE: // only reached when called from reopen mechanism
+		/* fallthrough */
+	case CLOSED_ISTATE:
+		break;
+	}
+
+	if ((ret = uv_fs_stat(loop, &uv_stat_in_req, in->file, NULL)) < 0) {
+		errno = -ret;
+		perror("uv_fs_stat");
+		return 1;
+	}
+
+	mode = uv_stat_in_req.statbuf.st_mode;
+	if (S_ISDIR(mode)) {
+		errno = EINVAL;
+		perror("args_init: --file, -f");
+		return 1;
+	}
+	uv_fs_req_cleanup(&uv_stat_in_req);
+
+	if ((in->is_reg = S_ISREG(mode)) &&
+	  (offset = input_start_offset(in, &uv_stat_in_req.statbuf)) !=
+		TAIL_OFFSET_END) {
+		if (backfill_start(in, offset) != 0) {
+			perror("backfill_start");
+			return 1;
+		}
+		in->state = OPENING_ISTATE;
+		return 0;
+	}
+
+	if (in->is_reg) {
+		if ((in->fd = tail_open(in->tail, on_tail_exit)) < 0) {
+			perror("tail_open");
+			return 1;
+		}
+	} else if ((in->fd = input_open_nonreg(loop, in->file)) < 0) {
+		perror("input_open_nonreg");
+		return 1;
+	}
+
+	if (input_poll_init(in) != 0)
+		return 1;
+
+	in->state = OPENING_ISTATE;
+
+	return 0;
+}
+
+/* logd_rebase_scanner lets the scanner resume where it left off after the len
+ * bytes of the partial log at start moved delta bytes. Scanners without
+ * scanner_rebase start over from the beginning of the log */
+static void logd_rebase_scanner(
+  input_t* in, const char* start, size_t len, ptrdiff_t delta)
+{
+	if (rebase_scanner != NULL) {
+		rebase_scanner(in->scanner, start, len, delta);
+		return;
 	}
 
-	create_scanner = dlsym(dlscanner_handle, "scanner_create");
-	if ((error = dlerror()) != NULL) {
-		fprintf(stderr, "dlsym(scanner_create): %s\n", error);
-		goto err;
-	}
+	reset_scanner(in->scanner);
+	in->b->next_read = in->log_start;
+}
 
-	reset_scanner = dlsym(dlscanner_handle, "scanner_reset");
-	if ((error = dlerror()) != NULL) {
-		fprintf(stderr, "dlsym(scanner_reset): %s\n", error);
-		goto err;
-	}
-	return 0;
-err:
-	errno = EINVAL;
-	return 1;
+#ifdef LOGD_MIRROR
+/* the window of a mirrored buffer always starts at the log being scanned so it
+ * never needs compaction: data past the end of the ring wraps around to its
+ * beginning */
+static void mirror_buf_slide(input_t* in)
+{
+	buf_t* b = in->b;
+	size_t shift = 0;
+
+	/* keep the window within the ring and its mirror. This is only done
+	 * between logs, when the scanner holds no pointers into the buffer */
+	if (in->log_start >= in->mirror.base + in->mirror.cap)
+		shift = in->mirror.cap;
+
+	b->next_read -= shift;
+	b->next_write -= shift;
+	in->log_start -= shift;
+	b->buf = in->log_start;
+	b->last = b->buf + b->cap;
 }
 
-void on_close_lua_handle(uv_handle_t* handle)
+static int mirror_buf_reserve(input_t* in, size_t add)
 {
-	DEBUG_LOG("closed uv handle %p, handles: %d", handle, loop->active_handles);
+	buf_t* b = in->b;
+	char* start = in->log_start;
+	size_t len = b->next_write - start;
+	char* data;
+
+	/* pages are remapped rather than copied */
+	if ((data = mirror_grow(&in->mirror, start, len, add)) == NULL)
+		return -1;
+
+	stats.buf_bytes += in->mirror.cap - b->cap;
+	stats.buf_reallocs++;
+
+	b->next_read = data + (b->next_read - start);
+	b->next_write = data + len;
+	in->log_start = data;
+	b->cap = in->mirror.cap;
+	b->buf = data;
+	b->last = b->buf + b->cap;
+
+	logd_rebase_scanner(in, start, len, (intptr_t)data - (intptr_t)start);
+
+	return 0;
 }
+#endif
 
-void uv_walk_close_lua_handles(uv_handle_t* handle, void* arg)
+int logd_buf_reserve(input_t* in)
 {
-	if (handle->data == LOGD_HANDLE || handle->data == tail ||
-	  uv_is_closing(handle)) {
-		DEBUG_LOG("skipping uv handle %p", handle);
-		return;
-	}
+	char* start = in->log_start;
+	char* buf = in->b->buf;
+	size_t len = in->b->next_write - start;
+	size_t add = in->b->cap;
+
+	/* grow geometrically so that a long log is not copied over and over,
+	 * without going much further than the max */
+	if (in->b->cap + add > LOGD_BUF_MAX_CAP)
+		add = in->b->cap < LOGD_BUF_MAX_CAP ? LOGD_BUF_MAX_CAP - in->b->cap : 0;
+	if (add < LOGD_BUF_INIT_CAP)
+		add = LOGD_BUF_INIT_CAP;
+
+#ifdef LOGD_MIRROR
+	if (in->mirrored)
+		return mirror_buf_reserve(in, add);
+#endif
+
+	if (buf_reserve(in->b, add) != 0)
+		return -1;
+
+	stats.buf_bytes += add;
+	stats.buf_reallocs++;
+	stats.buf_copied_bytes += in->b->next_write - in->b->buf;
+
+	in->log_start = in->b->buf + (start - buf);
+	logd_rebase_scanner(
+	  in, start, len, (intptr_t)in->b->buf - (intptr_t)buf);
 
-	DEBUG_LOG("closing uv handle %p", handle);
-	uv_close(handle, on_close_lua_handle);
+	return 0;
 }
 
-void close_lua_uv_handles() { uv_walk(loop, uv_walk_close_lua_handles, NULL); }
+/* logd_buf_track records the length of a log that was scanned from the input
+ * buffer to size the buffer after it */
+static void logd_buf_track(input_t* in, size_t len)
+{
+	if (len > in->buf_hwm)
+		in->buf_hwm = len;
+}
 
-void close_logd_uv_handles(
-  int status_code, enum exit_reason reason, const char* reason_str)
+#ifdef LOGD_MIRROR
+/* mirror_buf_shrink moves the readable data of a mirrored buffer to a new
+ * ring of cap bytes */
+static int mirror_buf_shrink(input_t* in, size_t cap)
 {
-	DEBUG_LOG("closing logd libuv handles, handles: %d", loop->active_handles);
+	buf_t* b = in->b;
+	size_t len = buf_readable(b);
+	mirror_t m;
 
-	if (lua_on_exit_defined(lstate)) {
-		lua_call_on_exit(lstate, reason, reason_str);
+	if (mirror_init(&m, cap) != 0)
+		return -1;
+
+	/* rings are made of whole pages */
+	if (m.cap >= b->cap) {
+		mirror_free(&m);
+		return 0;
 	}
 
-	pret = status_code;
-	input_close();
-	uv_signal_stop(&sigusr1);
-	uv_signal_stop(&sigusr2);
-	uv_signal_stop(&sigint);
+	memcpy(m.base, b->next_read, len);
+	mirror_free(&in->mirror);
+	in->mirror = m;
+	stats.buf_bytes -= b->cap - m.cap;
+	stats.buf_reallocs++;
+	stats.buf_copied_bytes += len;
+	DEBUG_LOG("shrunk ring buffer of %s from %zu to %zu bytes", in->file,
+	  b->cap, m.cap);
+
+	b->cap = m.cap;
+	b->buf = m.base;
+	b->last = b->buf + b->cap;
+	b->next_read = b->buf;
+	b->next_write = b->buf + len;
+	in->log_start = b->buf;
 
-	DEBUG_LOG("closed logd libuv handles, handles: %d", loop->active_handles);
+	return 0;
 }
-
-void close_all(int status_code, enum exit_reason reason, const char* reason_str)
+#endif
+
+/* logd_buf_shrink gives memory back once the logs that made the buffer grow
+ * are gone. It is called every buffer shrink delay, even if nothing was read
+ * meanwhile, and sizes the buffer down to twice the largest log seen in the
+ * last two delays so that a long log is remembered for at least one full
+ * delay */
+static int logd_buf_shrink(input_t* in)
 {
-	DEBUG_LOG("closing all libuv handles, handles: %d", loop->active_handles);
+	buf_t* b = in->b;
+	buf_t* nb;
+	size_t cap = LOGD_BUF_INIT_CAP;
+	size_t len = b->next_write - in->log_start;
+	size_t hwm;
+
+	hwm = in->buf_hwm > in->buf_hwm_prev ? in->buf_hwm : in->buf_hwm_prev;
+	while (cap < 2 * hwm)
+		cap *= 2;
+	in->buf_hwm_prev = in->buf_hwm;
+	in->buf_hwm = 0;
+
+	if (cap >= b->cap || len > cap)
+		return 0;
 
-	close_logd_uv_handles(status_code, reason, reason_str);
-	close_lua_uv_handles();
+	/* the scanner holds pointers into the log it is scanning, which is
+	 * scanned again from its start instead */
+	if (b->next_read != in->log_start) {
+		reset_scanner(in->scanner);
+		b->next_read = in->log_start;
+	}
 
-	input_state = EXIT_ISTATE;
+#ifdef LOGD_MIRROR
+	if (in->mirrored)
+		return mirror_buf_shrink(in, cap);
+#endif
 
-	DEBUG_LOG("closed all libuv handles, handles: %d", loop->active_handles);
+	if ((nb = buf_create(cap)) == NULL)
+		return -1;
+
+	memcpy(nb->buf, b->next_read, len);
+	buf_extend(nb, len);
+	stats.buf_bytes -= b->cap - nb->cap;
+	stats.buf_reallocs++;
+	stats.buf_copied_bytes += len;
+	DEBUG_LOG("shrunk input buffer of %s from %zu to %zu bytes", in->file,
+	  b->cap, nb->cap);
+
+	buf_free(b);
+	in->b = nb;
+	in->log_start = nb->next_read;
+
+	return 0;
 }
 
-// NOTE: only used one at a time during input reopening mechanism
-static void set_timeout(int timeout, void (*func)(uv_timer_t*))
+void logd_reset_scanner(input_t* in)
 {
-	static uv_timer_t timer;
+	reset_scanner(in->scanner);
+	in->log_start = in->b->next_read;
 
-	uv_timer_init(loop, &timer);
-	uv_timer_start(&timer, func, timeout, 0);
+#ifdef LOGD_MIRROR
+	if (in->mirrored)
+		mirror_buf_slide(in);
+#endif
 }
 
-// TODO should clean timer
-static void input_reopen()
+/* buffers of pipelined inputs are not used: their slots shrink on the reader
+ * thread. Neither is a buffer shrunk while the rest of an oversized log is
+ * read past into it, nor during backfill whose partial log is in the map */
+static void on_shrink_timer(uv_timer_t* timer)
 {
-	DEBUG_LOG(
-	  "trying to reopen file, current retries: %d", curr_reopen_retries);
+	input_t* in = INPUT_OF(timer, shrink_timer);
 
-	input_close();
-	input_reopen_open();
+	if (in->pipelined || in->oversize || in->backfill.map != NULL)
+		return;
+
+	if (logd_buf_shrink(in) != 0)
+		perror("logd_buf_shrink");
 }
 
-static void input_reopen_open()
+bool logd_buf_compact(input_t* in)
 {
-	int ret;
+	buf_t* b = in->b;
+
+	if (b->buf == in->log_start)
+		return 0;
 
-	curr_reopen_retries += 1;
-	DEBUG_LOG("reopen attempt, state: %d, current_try: %d", input_state,
-	  curr_reopen_retries);
+	char* start = in->log_start;
+	int moved = in->log_start - b->buf;
+	int len = b->next_write - in->log_start;
+	in->log_start = memmove(b->buf, in->log_start, len);
+	b->next_write = b->buf + len;
+	b->next_read = b->next_read - moved;
+	stats.buf_copied_bytes += len;
+	logd_rebase_scanner(in, start, len, -moved);
 
-	if ((ret = input_open(loop, tail, args.input_file)) != 0) {
-		perror("input_open");
-		if (curr_reopen_retries <= args.reopen_retries) {
-			set_timeout(next_attempt_backoff(
-						  args.reopen_delay, curr_reopen_retries, backoff),
-			  input_reopen);
-		} else {
-			close_logd_uv_handles(1, REASON_EOF, "exhausted reopen retries");
-		}
-	}
+	return 1;
 }
 
-void input_close()
+static buf_t* input_buf_create(input_t* in)
 {
-	uv_fs_t req_in_close;
+	buf_t* b;
+
+#ifdef LOGD_MIRROR
+	if (args.ring_buffer) {
+		if (mirror_init(&in->mirror, LOGD_BUF_INIT_CAP) != 0) {
+			perror("mirror_init");
+			fprintf(stderr, "using a regular buffer for %s\n", in->file);
+			goto regular;
+		}
 
-	DEBUG_LOG("input close attempt, state: %d", input_state);
+		if ((b = calloc(1, sizeof(buf_t))) == NULL) {
+			mirror_free(&in->mirror);
+			errno = ENOMEM;
+			return NULL;
+		}
 
-	switch (input_state) {
-	case EXIT_ISTATE:
-	case CLOSED_ISTATE:
-		return;
-	case OPENING_ISTATE:
-		/* fallthrough */
-	case READING_ISTATE:
-		break;
+		b->cap = in->mirror.cap;
+		b->buf = in->mirror.base;
+		b->last = b->buf + b->cap;
+		buf_reset_offsets(b);
+		in->mirrored = 1;
+		stats.buf_bytes += b->cap;
+
+		return b;
 	}
+regular:
+#else
+	if (args.ring_buffer)
+		fprintf(stderr, "ring buffers are not supported, using a regular "
+						"buffer for %s\n",
+		  in->file);
+#endif
+
+	if ((b = buf_create(LOGD_BUF_INIT_CAP)) != NULL)
+		stats.buf_bytes += b->cap;
+
+	return b;
+}
 
-	DEBUG_LOG("closing input, fd: %d", infd);
+static void input_buf_free(input_t* in)
+{
+	if (in->b == NULL)
+		return;
 
-	if (input_is_reg) {
-		tail_close(tail);
-	} else {
-		uv_fs_close(loop, &req_in_close, infd, NULL);
-		uv_fs_req_cleanup(&req_in_close);
+	stats.buf_bytes -= in->b->cap;
+
+#ifdef LOGD_MIRROR
+	if (in->mirrored) {
+		free(in->b);
+		mirror_free(&in->mirror);
+		return;
 	}
+#endif
 
-	uv_poll_stop(&uv_poll_in_req);
+	buf_free(in->b);
+}
 
-	input_state = CLOSED_ISTATE;
+static void input_free(input_t* in)
+{
+	if (in == NULL)
+		return;
 
-	DEBUG_LOG("closed input, fd: %d", infd);
+	tail_free(in->tail);
+	input_buf_free(in);
+	if (in->pipeline.cb != NULL)
+		pipeline_free(&in->pipeline);
+	if (in->scanner)
+		free_scanner(in->scanner);
+	free(in->raw);
+	free(in->marks);
+	free(in->cp_path);
+	free(in->file);
+	free(in);
 }
 
-void input_reopen_attempt(int exit_status)
+static input_t* input_create(const char* file)
 {
-	void (*open_func)(uv_timer_t*);
+	input_t* in;
 
-	DEBUG_LOG("input reopen attempt, exit_status: %d, state: %d", exit_status,
-	  input_state);
+	if ((in = calloc(1, sizeof(input_t))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
 
-	switch (input_state) {
-	case OPENING_ISTATE:
-		DEBUG_LOG("reopen mechanism in-progress, current_retry: %d",
-		  curr_reopen_retries);
-		/* falltrhough */
-	case EXIT_ISTATE:
-		return;
-	case CLOSED_ISTATE:
-		open_func = input_reopen_open;
-		break;
-	case READING_ISTATE:
-		open_func = input_reopen;
-		break;
+	if ((in->file = strdup(file)) == NULL) {
+		errno = ENOMEM;
+		goto error;
 	}
 
-	if (args.reopen_retries != 0) {
-		input_state = OPENING_ISTATE;
-		set_timeout(
-		  next_attempt_backoff(args.reopen_delay, curr_reopen_retries, backoff),
-		  open_func);
-	} else {
-		close_logd_uv_handles(
-		  0, REASON_EOF, "reached EOF and reopen retries is configured to 0");
+	if ((in->scanner = create_scanner()) == NULL) {
+		perror("scanner_create");
+		goto error;
 	}
-}
+	if (args.lazy && lazy_scanner != NULL)
+		lazy_scanner(in->scanner, true);
 
-int input_open_nonreg(uv_loop_t* loop, char* input_file)
-{
-	int ret;
+	if ((in->b = input_buf_create(in)) == NULL) {
+		perror("input_buf_create");
+		goto error;
+	}
 
-	if ((ret = uv_fs_open(loop, &uv_open_in_req, input_file,
-		   O_NONBLOCK | O_RDONLY, 0, NULL)) < 0) {
-		errno = -ret;
-		perror("uv_fs_open");
-		ret = -1;
-		goto exit;
+	if (args.oversize == OVERSIZE_SPILL &&
+	  (in->raw = malloc(LOGD_BUF_INIT_CAP)) == NULL) {
+		errno = ENOMEM;
+		goto error;
 	}
 
-	ret = uv_open_in_req.result;
+	if ((in->tail = tail_create(loop, in->file)) == NULL) {
+		perror("tail_create");
+		goto error;
+	}
+	in->tail->data = in;
 
-exit:
-	uv_fs_req_cleanup(&uv_open_in_req);
-	return ret;
+	if (args.checkpoint_dir != NULL) {
+		if ((in->cp_path = checkpoint_path(args.checkpoint_dir, file)) ==
+		  NULL) {
+			perror("checkpoint_path");
+			goto error;
+		}
+
+		if (checkpoint_load(in->cp_path, &in->cp) == 0) {
+			in->cp_valid = 1;
+		} else if (errno != ENOENT) {
+			perror("checkpoint_load");
+			fprintf(stderr, "ignoring checkpoint %s\n", in->cp_path);
+		}
+	}
+
+	in->fd = -1;
+	in->spill_fd = -1;
+	in->mark = -1;
+	in->backfill.fd = -1;
+	in->state = CLOSED_ISTATE;
+	logd_reset_scanner(in);
+
+	uv_idle_init(loop, &in->pending);
+	uv_idle_init(loop, &in->backfill.idle);
+	uv_timer_init(loop, &in->reopen_timer);
+	uv_timer_init(loop, &in->shrink_timer);
+	STAMP_HANDLE((uv_handle_t*)&in->pending);
+	STAMP_HANDLE((uv_handle_t*)&in->backfill.idle);
+	STAMP_HANDLE((uv_handle_t*)&in->reopen_timer);
+	STAMP_HANDLE((uv_handle_t*)&in->shrink_timer);
+
+	/* buffers shrink even if the input goes quiet after a long log */
+	uv_timer_start(&in->shrink_timer, on_shrink_timer, args.buf_shrink_delay,
+	  args.buf_shrink_delay > 0 ? args.buf_shrink_delay : 1);
+	uv_unref((uv_handle_t*)&in->shrink_timer);
+
+	return in;
+
+error:
+	input_free(in);
+	return NULL;
 }
 
-int input_open(uv_loop_t* loop, tail_t* tail, char* input_file)
+static int inputs_add(const char* file)
 {
-	uv_fs_t uv_stat_in_req;
-	int ret, mode;
+	input_t** grown;
+	size_t i;
 
-	DEBUG_LOG("input open, input_file: %s, state: %d", input_file, input_state);
-
-	switch (input_state) {
-	case EXIT_ISTATE:
-		/* fallthrough */
-	case READING_ISTATE:
-		return 0;
-	case OPENING_ISTATE: // only reached when called from reopen mechanism
-		/* fallthrough */
-	case CLOSED_ISTATE:
-		break;
+	for (i = 0; i < inputs_len; i++) {
+		if (strcmp(inputs[i]->file, file) == 0)
+			return 0;
 	}
 
-	if ((ret = uv_fs_stat(loop, &uv_stat_in_req, input_file, NULL)) < 0) {
-		errno = -ret;
-		perror("uv_fs_stat");
+	if ((grown = realloc(inputs, (inputs_len + 1) * sizeof(input_t*))) ==
+	  NULL) {
+		errno = ENOMEM;
 		return 1;
 	}
+	inputs = grown;
 
-	mode = uv_stat_in_req.statbuf.st_mode;
-	if (S_ISDIR(mode)) {
-		errno = EINVAL;
-		perror("args_init: --file, -f");
+	if ((inputs[inputs_len] = input_create(file)) == NULL)
 		return 1;
-	}
-	uv_fs_req_cleanup(&uv_stat_in_req);
+	inputs[inputs_len]->id = inputs_len;
 
-	if ((input_is_reg = S_ISREG(mode))) {
-		if ((infd = tail_open(tail, input_reopen_attempt)) < 0) {
-			perror("tail_open");
+	DEBUG_LOG("added input %s", file);
+	inputs_len++;
+
+	return 0;
+}
+
+/* expand --file patterns into inputs. Patterns that match nothing are added
+ * verbatim so they go through the same open and reopen logic as a path */
+static int inputs_glob()
+{
+	glob_t g;
+	size_t j;
+	int i, ret;
+
+	for (i = 0; i < args.input_files_len; i++) {
+		if ((ret = glob(args.input_files[i], GLOB_NOCHECK, NULL, &g)) != 0) {
+			errno = ret == GLOB_NOSPACE ? ENOMEM : EINVAL;
+			perror("glob");
 			return 1;
 		}
-	} else if ((infd = input_open_nonreg(loop, input_file)) < 0) {
-		perror("input_open_nonreg");
-		return 1;
-	}
 
-	if ((ret = uv_poll_init(loop, &uv_poll_in_req, infd)) ||
-	  (ret = uv_poll_start(&uv_poll_in_req, UV_READABLE, &on_read)) < 0) {
-		errno = -ret;
-		perror("uv_poll");
-		return 1;
-	}
+		for (j = 0; j < g.gl_pathc; j++) {
+			if (inputs_add(g.gl_pathv[j]) != 0) {
+				perror("inputs_add");
+				globfree(&g);
+				return 1;
+			}
+		}
 
-	STAMP_HANDLE((uv_handle_t*)&uv_poll_in_req);
-	input_state = OPENING_ISTATE;
+		globfree(&g);
+	}
 
 	return 0;
 }
 
-int logd_buf_reserve()
+#define CALL_ON_LOG(in, res)                                                   \
+	logd_buf_track(in, (in)->b->next_read + res.consumed - (in)->log_start);   \
+	input_call_on_log(in, res.log, input_mark(in, res.consumed));              \
+	buf_consume((in)->b, res.consumed);                                        \
+	logd_reset_scanner(in);
+
+/* input_call_batch hands the first n logs of the last batch to lua, in a
+ * single call if the script defines logd.on_logs */
+static void input_call_batch(input_t* in, size_t n)
 {
-	int ret;
-	int offset = log_start - b->buf;
-	ret = buf_reserve(b, LOGD_BUF_INIT_CAP);
-	reset_scanner(scanner);
-	log_start = b->buf + offset;
+	scan_res_t* res;
+	size_t i, consumed = 0;
 
-	return ret;
+	if (n == 0)
+		return;
+
+	if (!lua_on_logs_defined(lstate)) {
+		for (i = 0; i < n; i++) {
+			res = &batch->res[i];
+			logd_buf_track(
+			  in, in->b->next_read + res->consumed - in->log_start);
+			input_call_on_log(in, res->log, input_mark(in, res->consumed));
+			buf_consume(in->b, res->consumed);
+			in->log_start = in->b->next_read;
+		}
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		consumed += batch->res[i].consumed;
+		logd_buf_track(in, in->b->next_read + consumed - in->log_start);
+		in->log_start = in->b->next_read + consumed;
+	}
+
+	input_call_on_logs(in, batch->logs, n, input_mark(in, consumed));
+	buf_consume(in->b, consumed);
 }
 
-void logd_reset_scanner()
+/* input_scan returns the next scan result of the readable data of in. With a
+ * batch scanner, complete logs are handled here so that the scanner is called
+ * once per batch instead of once per log, and only errors and partial logs are
+ * returned */
+static scan_res_t input_scan(input_t* in)
 {
-	reset_scanner(scanner);
-	log_start = b->next_read;
+	scan_res_t res;
+	size_t n;
+
+	if (scan_batch_scanner == NULL)
+		return scan_scanner(in->scanner, in->b->next_read, buf_readable(in->b));
+
+scan:
+	n = scan_batch_scanner(
+	  in->scanner, in->b->next_read, buf_readable(in->b), batch);
+	res = batch->res[n - 1];
+
+	/* the buffer cannot move until the whole batch is handled */
+	if (res.type == SCAN_COMPLETE) {
+		input_call_batch(in, n);
+		logd_reset_scanner(in);
+		goto scan;
+	}
+
+	input_call_batch(in, n - 1);
+	if (n == 1 || res.type != SCAN_PARTIAL)
+		return res;
+
+	/* the partial log is scanned again once a mirrored buffer had the chance
+	 * to slide, which happens between logs */
+	logd_reset_scanner(in);
+	return scan_scanner(in->scanner, in->b->next_read, buf_readable(in->b));
 }
 
-bool logd_buf_compact()
+#ifdef LOGD_URING
+/* input_uring_lend has a read that starts with a new log scanned in the
+ * io_uring buffer it was read into rather than copied to the input buffer
+ * first. It returns the bytes read, or 0 to read into the input buffer */
+static ssize_t input_uring_lend(input_t* in)
 {
-	if (b->buf == log_start)
+	buf_t* view = &in->uring_view;
+	char* data;
+	ssize_t n;
+
+	if (!in->uring || in->mirrored || buf_readable(in->b) > 0)
 		return 0;
 
-	int moved = log_start - b->buf;
-	int len = b->last - log_start;
-	log_start = memmove(b->buf, log_start, len);
-	b->next_write = b->buf + len;
-	b->next_read = b->next_read - moved;
+	/* end of file and errors are left to input_read */
+	if ((n = uring_reader_peek(&in->reader, &data)) <= 0)
+		return 0;
 
-	return 1;
+	stats.read_calls++;
+	stats.read_bytes += n;
+
+	view->buf = view->next_read = data;
+	view->next_write = view->last = data + n;
+	view->cap = n;
+	in->uring_own = in->b;
+	in->b = view;
+	in->log_start = data;
+
+	return n;
 }
 
-void call_on_error(lua_t* l, const char* err, log_t* partial, const char* at)
+/* input_uring_return copies what is left of the read that was scanned in
+ * place, the beginning of a log, to the input buffer and hands the io_uring
+ * buffer back */
+static void input_uring_return(input_t* in)
 {
-	partial->is_safe = true;
-	lua_call_on_error(lstate, err, partial, at);
-	partial->is_safe = false;
-}
+	buf_t* view = in->b;
+	buf_t* b = in->uring_own;
+	char* start = in->log_start;
+	size_t len = view->next_write - start;
+
+	buf_reset_offsets(b);
+	memcpy(b->buf, start, len);
+	b->next_read = b->buf + (view->next_read - start);
+	b->next_write = b->buf + len;
+	in->b = b;
+	in->uring_own = NULL;
+	in->log_start = b->buf;
+	stats.buf_copied_bytes += len;
 
-#define CALL_ON_LOG(lstate, res)                                               \
-	res.log->is_safe = true;                                                   \
-	lua_call_on_log(lstate, res.log);                                          \
-	buf_consume(b, res.consumed);                                              \
-	logd_reset_scanner();                                                      \
-	res.log->is_safe = false;
+	logd_rebase_scanner(in, start, len, (intptr_t)b->buf - (intptr_t)start);
+	uring_reader_ack(&in->reader, view->cap);
+}
+#endif
 
-void on_eof() { input_reopen_attempt(0); }
+void on_eof(input_t* in) { input_reopen_attempt(in, 0); }
 
 void on_poll_err(int ret)
 {
@@ -495,34 +2669,33 @@ void on_read_err(int ret)
 	close_all(1, REASON_ERROR, uv_strerror(ret));
 }
 
-void on_read_eof()
+void on_read_eof(input_t* in)
 {
 	scan_res_t res;
-	DEBUG_LOG("EOF while reading input file %d", infd);
+	DEBUG_LOG("EOF while reading input file %d", in->fd);
 
 scan:
-	res = scan_scanner(scanner, b->next_read, buf_readable(b));
+	res = scan_scanner(in->scanner, in->b->next_read, buf_readable(in->b));
 	switch (res.type) {
 	case SCAN_COMPLETE:
-		CALL_ON_LOG(lstate, res);
+		CALL_ON_LOG(in, res);
 		goto scan;
 	case SCAN_ERROR:
 		DEBUG_LOG("EOF scan error: %s", res.error.msg);
-		buf_ack(b, res.consumed);
-		if (lua_on_error_defined(lstate)) {
-			call_on_error(lstate, res.error.msg, res.log, res.error.at);
-		}
-		logd_reset_scanner();
+		buf_ack(in->b, res.consumed);
+		call_on_error(
+		  in, res.error.msg, res.log, res.error.at, input_mark(in, 0));
+		logd_reset_scanner(in);
 		goto scan;
 	case SCAN_PARTIAL:
-		on_eof();
+		on_eof(in);
 		break;
 	}
 
 	return;
 }
 
-#define READ(req, status, read_len, on_eof_h)                                  \
+#define READ(in, status, read_len, on_eof_h)                                   \
 	if (status < 0) {                                                          \
 		on_poll_err(status);                                                   \
 		return;                                                                \
@@ -530,12 +2703,13 @@ scan:
                                                                                \
 	call:                                                                      \
 	errno = 0;                                                                 \
-	int ret = read(infd, b->next_write, read_len);                             \
+	stats.read_calls++;                                                        \
+	int ret = input_read(in, in->b->next_write, read_len);                     \
 	if (ret < 0) {                                                             \
 		if (errno == EINTR)                                                    \
 			goto call;                                                         \
 		if (errno == EAGAIN) {                                                 \
-			DEBUG_LOG("input not ready: %d", infd);                            \
+			DEBUG_LOG("input not ready: %d", in->fd);                          \
 			return;                                                            \
 		}                                                                      \
 		on_read_err(-errno);                                                   \
@@ -543,110 +2717,145 @@ scan:
 	}                                                                          \
                                                                                \
 	if (ret == 0 && read_len != 0) {                                           \
-		on_eof_h();                                                            \
+		on_eof_h(in);                                                          \
 		return;                                                                \
 	}                                                                          \
-	buf_extend(b, ret);
+	stats.read_bytes += ret;                                                   \
+	buf_extend(in->b, ret);
 
 void on_read_skip(uv_poll_t* req, int status, int events)
 {
-	scan_res_t res;
+	input_t* in = INPUT_OF(req, poll);
+	buf_t* b = in->b;
+	char* nl;
 
-	READ(req, status, buf_writable(b), on_eof);
+	READ(in, status, buf_writable(b), on_eof);
 
-	res = scan_scanner(scanner, b->next_read, buf_readable(b));
-	if (res.type == SCAN_PARTIAL) {
-		buf_reset_offsets(b);
+	if ((nl = memchr(b->next_read, '\n', buf_readable(b))) == NULL) {
+		input_spill_write(in, b->next_read, buf_readable(b));
+		b->next_write = b->next_read;
+		if (INPUT_NEEDS_NUDGE(in))
+			uv_idle_start(&in->pending, on_input_pending);
 		return;
 	}
 
-	if (lua_on_error_defined(lstate)) {
-		call_on_error(lstate,
-		  "log line was skipped because it is more than " STR(
-			LOGD_BUF_MAX_CAP) " bytes",
-		  res.log, "");
-	}
-	buf_ack(b, res.consumed);
+	input_spill_write(in, b->next_read, nl - b->next_read);
+	input_oversize_end(in, nl + 1 - b->next_read);
+	if (in->raw != NULL)
+		input_spill_tee(in, b->next_read, buf_readable(b));
 	DEBUG_LOG("successfully skipped line: buffer has now %zu readable bytes "
 			  "and %zu writable bytes",
-	  buf_readable(b), buf_writable(b));
-	logd_reset_scanner();
+	  buf_readable(in->b), buf_writable(in->b));
 
-	if ((ret = uv_poll_stop(&uv_poll_in_req)) < 0 ||
-	  (ret = uv_poll_start(&uv_poll_in_req, UV_READABLE, &on_read)) < 0) {
+	/* restarting an active poll handle only swaps its callback */
+	if ((ret = input_poll_start(in, &on_read)) < 0)
 		on_poll_err(ret);
-	}
 }
 
 void on_read(uv_poll_t* req, int status, int events)
 {
+	input_t* in = INPUT_OF(req, poll);
 	scan_res_t res;
-
-	READ(req, status, buf_writable(b), on_read_eof);
-
-	curr_reopen_retries = 0;
-	input_state = READING_ISTATE;
+	int budget_bytes = args.read_budget_bytes;
+	int budget_reads = args.read_budget_reads;
+	ssize_t n;
+
+	stats.read_wakeups++;
+
+	/* keep reading until the input would block or the budget runs out: the
+	 * poll backend is level-triggered so anything left is picked up on a
+	 * later loop iteration, after other inputs had their turn */
+drain:
+#ifdef LOGD_URING
+	if (status == 0 && (n = input_uring_lend(in)) > 0)
+		goto lent;
+#endif
+	READ(in, status, buf_writable(in->b), on_read_eof);
+	n = ret;
+#ifdef LOGD_URING
+lent:
+#endif
+	if (in->raw != NULL)
+		input_spill_tee(in, in->b->next_write - n, n);
+
+	budget_bytes -= n;
+	budget_reads--;
+	in->reopen_retries = 0;
+	in->state = READING_ISTATE;
 
 scan:
-	res = scan_scanner(scanner, b->next_read, buf_readable(b));
+	res = input_scan(in);
 	switch (res.type) {
 
 	case SCAN_COMPLETE:
 		// DEBUG_LOG("scanned new log: %p", &res.log);
-		CALL_ON_LOG(lstate, res);
+		CALL_ON_LOG(in, res);
 		goto scan;
 
 	case SCAN_ERROR:
 		DEBUG_LOG("scan error: %s", res.error.msg);
-		buf_ack(b, res.consumed);
-		if (lua_on_error_defined(lstate)) {
-			call_on_error(lstate, res.error.msg, res.log, res.error.at);
-		}
-		logd_reset_scanner();
+		buf_ack(in->b, res.consumed);
+		logd_buf_track(in, in->b->next_read - in->log_start);
+		call_on_error(
+		  in, res.error.msg, res.log, res.error.at, input_mark(in, 0));
+		logd_reset_scanner(in);
 		goto scan;
 
 	case SCAN_PARTIAL:
-		if (!buf_full(b)) {
-			buf_ack(b, res.consumed);
+		/* scanning resumes from here even if the log has to be moved */
+		buf_ack(in->b, res.consumed);
+#ifdef LOGD_URING
+		if (in->uring_own != NULL)
+			input_uring_return(in);
+#endif
+		if (!buf_full(in->b))
 			goto read;
-		}
 
 		/* compact if we have data from previous log in buffer */
-		if (logd_buf_compact()) {
+		if (logd_buf_compact(in)) {
 			DEBUG_LOG(
-			  "compacted buffer: now writable %zd bytes", buf_writable(b));
-			reset_scanner(scanner);
+			  "compacted buffer: now writable %zd bytes", buf_writable(in->b));
 			goto read;
 		}
 
-		/* we have allocated too much memory, start skipping data */
-		if (b->cap > LOGD_BUF_MAX_CAP) {
+		/* we have allocated too much memory, read past the rest of the log
+		 * and handle it as configured with --oversize */
+		if (in->b->cap > LOGD_BUF_MAX_CAP) {
 			DEBUG_LOG("log is too long (more than %d bytes). skipping data...",
 			  LOGD_BUF_MAX_CAP);
-			buf_reset_offsets(b);
+			input_oversize_start(in, res.log);
 			goto skip;
 		}
 
 		/* complete log doesn't fit buffer so reserve more space */
-		/* do not ack so we re-scan with the re-allocated buffer */
-		if (logd_buf_reserve() != 0) {
+		if (logd_buf_reserve(in) != 0) {
 			perror("buf_reserve");
 			fprintf(stderr, "error reserving more space in input buffer\n");
 			pret = 1;
 			return;
 		}
 
-		DEBUG_LOG("reserved more space in input buffer: now %zd bytes", b->cap);
+		DEBUG_LOG(
+		  "reserved more space in input buffer: now %zd bytes", in->b->cap);
 		goto read;
 	}
 
 read:
+	if (in->state != READING_ISTATE)
+		return;
+
+	if (budget_bytes > 0 && budget_reads > 0)
+		goto drain;
+
+	stats.read_budget_exhausted++;
+	if (INPUT_NEEDS_NUDGE(in))
+		uv_idle_start(&in->pending, on_input_pending);
 	return;
 skip:
-	if ((ret = uv_poll_stop(&uv_poll_in_req)) < 0 ||
-	  (ret = uv_poll_start(&uv_poll_in_req, UV_READABLE, &on_read_skip)) < 0) {
+	if ((ret = input_poll_start(in, &on_read_skip)) < 0)
 		on_poll_err(ret);
-	}
+	if (INPUT_NEEDS_NUDGE(in))
+		uv_idle_start(&in->pending, on_input_pending);
 	return;
 }
 
@@ -659,9 +2868,18 @@ void rel_cfg_sig_h(uv_signal_t* handle, int signum)
 
 void rel_log_sig_h(uv_signal_t* handle, int signum)
 {
+	size_t i;
+
 	DEBUG_LOG("Received signal %d. Re-opening input files ...", signum);
-	input_state = OPENING_ISTATE;
-	input_reopen();
+
+	/* pick up files that started matching a pattern since the last time */
+	if (inputs_glob() != 0)
+		perror("inputs_glob");
+
+	for (i = 0; i < inputs_len; i++) {
+		inputs[i]->state = OPENING_ISTATE;
+		input_reopen(inputs[i]);
+	}
 }
 
 void shutdown_sig_h(uv_signal_t* handle, int signum)
@@ -742,21 +2960,37 @@ error:
 
 void free_all()
 {
+	size_t i;
+
 	if (loop) {
+		/* let the loop go of the handles embedded in inputs and tails, and
+		 * run their close callbacks, before they are freed */
+		uv_walk(loop, uv_walk_close_handles, NULL);
+		uv_run(loop, UV_RUN_NOWAIT);
 		uv_loop_close(loop);
 		free(loop);
 	}
+#ifdef LOGD_URING
+	uring_free(ring);
+#endif
 	lua_free(lstate);
-	tail_free(tail);
-	buf_free(b);
-	free_scanner(scanner);
+	for (i = 0; i < inputs_len; i++)
+		input_free(inputs[i]);
+	free(inputs);
+	free(args.input_files);
 	if (dlscanner_handle) {
 		dlclose(dlscanner_handle);
 	}
+	output_free(&output);
+	format_free(format);
+	filter_free(filter);
+	free(batch);
+	keys_free();
 }
 
 int main(int argc, char* argv[])
 {
+	size_t i;
 
 	if ((script = args_init(argc, argv)) == NULL || args.help) {
 		print_usage(argv[0]);
@@ -770,20 +3004,19 @@ int main(int argc, char* argv[])
 		goto exit;
 	}
 
-	if ((scanner = create_scanner()) == NULL) {
-		perror("scanner_create");
-		pret = 1;
+	if (args.format != NULL &&
+	  (pret = scanner_format_load(args.format)) != 0) {
+		perror("scanner_format_load");
 		goto exit;
 	}
 
-	if ((b = buf_create(LOGD_BUF_INIT_CAP)) == NULL) {
-		perror("buf_create");
+	if (scan_batch_scanner != NULL &&
+	  (batch = malloc(sizeof(scan_batch_t))) == NULL) {
+		perror("malloc");
 		pret = 1;
 		goto exit;
 	}
 
-	logd_reset_scanner();
-
 	if ((pret = loop_create()) != 0) {
 		perror("loop_create");
 		goto exit;
@@ -794,35 +3027,71 @@ int main(int argc, char* argv[])
 		goto exit;
 	}
 
-	if ((tail = tail_create(loop, args.input_file)) == NULL) {
-		perror("tail_create");
+	if ((pret = inputs_glob()) != 0) {
+		perror("inputs_glob");
 		goto exit;
 	}
 
-	input_state = CLOSED_ISTATE;
-	curr_reopen_retries = 0;
-	if (args.reopen_retries != 0) {
-		input_reopen_open();
-	} else if ((pret = input_open(loop, tail, args.input_file)) != 0) {
-		perror("input_open");
-		goto exit;
+	if (args.io_uring) {
+#ifdef LOGD_URING
+		if ((pret = ring_init()) != 0) {
+			perror("ring_init");
+			goto exit;
+		}
+#else
+		fprintf(stderr, "io_uring is not supported, using poll instead\n");
+#endif
+	}
+
+	if (args.checkpoint_dir != NULL) {
+		uv_timer_init(loop, &checkpoint_timer);
+		STAMP_HANDLE((uv_handle_t*)&checkpoint_timer);
+		uv_timer_start(&checkpoint_timer, on_checkpoint_timer,
+		  args.checkpoint_interval, args.checkpoint_interval);
+	}
+
+	for (i = 0; i < inputs_len; i++) {
+		if (args.reopen_retries != 0) {
+			input_reopen_open(inputs[i]);
+		} else if ((pret = input_open(inputs[i])) != 0) {
+			perror("input_open");
+			goto exit;
+		}
 	}
 
 	if ((pret = signals_init(loop)) != 0)
 		goto exit;
 
+	if (args.output_buffer > 0 &&
+	  (pret = output_init(&output, loop, STDOUT_FILENO, args.output_buffer,
+		 args.output_flush, args.output_overflow)) != 0) {
+		perror("output_init");
+		goto exit;
+	}
+	STAMP_HANDLE((uv_handle_t*)&output.timer);
+	STAMP_HANDLE((uv_handle_t*)&output.poll);
+
 	/* sigusr1 signal handler calls uv_stop but leaves non-lua uv handles open
 	 */
 	do {
 		DEBUG_LOG("creating new lua state prev is %p", lstate);
 
 		lua_free(lstate);
-		if ((lstate = lua_create(loop, script)) == NULL) {
+		if ((lstate = lua_create(loop, script, logd_daemon_functions)) ==
+		  NULL) {
 			perror("lua_create");
 			pret = 1;
 			goto exit;
 		}
 
+		if ((pret = filter_load()) != 0) {
+			perror("filter_load");
+			goto exit;
+		}
+
+		if (args.output_buffer > 0)
+			lua_set_print_writer(lstate->state, &output_print, &output);
+
 	} while (uv_run(loop, UV_RUN_DEFAULT));
 
 	DEBUG_ASSERT(uv_loop_alive(loop) == 0);
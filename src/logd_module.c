@@ -6,10 +6,15 @@
 #include <lualib.h>
 
 #include "config.h"
+#include "encode.h"
+#include "keys.h"
 #include "log.h"
 #include "logd_module.h"
 #include "util.h"
 
+/* the following header is auto-generated by xxd */
+#include "logdffi.lua.h"
+
 #define LUA_NAME_PRINT "print"
 #define LUA_LEGACY_NAME_DEBUG "debug"
 #define LUA_NAME_LOG_GET "log_get"
@@ -19,36 +24,133 @@
 #define LUA_NAME_TABLE_TO_LOGPTR "to_logptr"
 #define LUA_NAME_LOG_TO_TABLE "to_table"
 #define LUA_NAME_LOG_TO_STR "to_str"
+#define LUA_NAME_LOG_TO_JSON "to_json"
+#define LUA_NAME_LOG_TO_LOGFMT "to_logfmt"
+#define LUA_NAME_LOG_TO_MSGPACK "to_msgpack"
 #define LUA_LEGACY_NAME_LOG_STRING "log_string"
 #define LUA_NAME_LOG_CLONE "log_clone"
 
+#define LUA_NAME_LOG_PAIRS "log_pairs"
+
+#define LUA_NAME_MODULE_STATE_METATABLE "logd.state.meta"
+
 #define TO_LOG_PTR(L, var, idx, fn_name)                                       \
 	switch (lua_type(L, idx)) {                                                \
 	case LUA_TLIGHTUSERDATA:                                                   \
-	case LUA_TUSERDATA:                                                        \
 		var = (log_t*)lua_touserdata(L, idx);                                  \
-		if (!var->is_safe) {                                                   \
-			luaL_error(L,                                                      \
-			  "it is not safe to use a logptr outside of logd.on_log's "       \
-			  "calling thread's context. Clone first with `logd.clone`'");      \
-		}                                                                      \
+		break;                                                                 \
+	case LUA_TUSERDATA:                                                        \
+		var = ((logptr_t*)lua_touserdata(L, idx))->log;                        \
 		break;                                                                 \
 	default:                                                                   \
 		luaL_error(L,                                                          \
 		  "1st argument must be a logptr in call to '" fn_name "': found %s",  \
 		  lua_typename(L, lua_type(L, idx)));                                  \
 		return 0;                                                              \
+	}                                                                          \
+	if (!var->is_safe) {                                                       \
+		luaL_error(L,                                                          \
+		  "it is not safe to use a logptr outside of logd.on_log's "           \
+		  "calling thread's context. Clone first with `logd.clone`'");          \
 	}
 
+/* table that the functions of the module share with the Lua strings of the
+ * keys in keys.h by id, and their ids by string */
+#define KEYS_UPVALUE lua_upvalueindex(1)
+/* module_t of the lua state, which is also in the registry */
+#define MODULE_UPVALUE lua_upvalueindex(2)
+
+typedef struct module_s {
+	/* buffer that logs are serialized into */
+	encode_buf_t buf;
+	/* where logd.print writes to instead of io.write, if set */
+	lua_print_writer_t writer;
+	void* writer_ctx;
+} module_t;
+
 #define GET_USERDATA_PROPS(log) ((prop_t*)((log) + 1))
-#define NEW_USERDATA_LOG(L, size)                                              \
-	((log_t*)lua_newuserdata((L), sizeof(log_t) + (size) * sizeof(prop_t)))
+
+logptr_t* lua_new_logptr(lua_State* L, log_t* log)
+{
+	logptr_t* ptr = lua_newuserdata(L, sizeof(logptr_t));
+	ptr->log = log;
+	luaL_getmetatable(L, LUA_NAME_LOGPTR_METATABLE);
+	lua_setmetatable(L, -2);
+
+	return ptr;
+}
+
+/* new_userdata_log pushes a logptr that owns its log and the room for size
+ * props that follows it */
+static log_t* new_userdata_log(lua_State* L, int size)
+{
+	logptr_t* ptr = lua_newuserdata(
+	  L, sizeof(logptr_t) + sizeof(log_t) + size * sizeof(prop_t));
+	ptr->log = (log_t*)(ptr + 1);
+	luaL_getmetatable(L, LUA_NAME_LOGPTR_METATABLE);
+	lua_setmetatable(L, -2);
+
+	return ptr->log;
+}
+
+/* cache_key adds the string at idx, which is the key of id, to the keys
+ * upvalue */
+static void cache_key(lua_State* L, int idx, uint32_t id)
+{
+	lua_pushvalue(L, idx);
+	lua_rawseti(L, KEYS_UPVALUE, id);
+	lua_pushvalue(L, idx);
+	lua_pushinteger(L, id);
+	lua_rawset(L, KEYS_UPVALUE);
+}
+
+/* push_key pushes the key of prop, which is made into a Lua string only once
+ * if its id is known */
+static void push_key(lua_State* L, prop_t* prop)
+{
+	const char* name;
+	size_t len;
+
+	if (prop->kid == KEY_ID_NONE) {
+		lua_pushlstring(L, prop->key, log_key_len(prop));
+		return;
+	}
+
+	lua_rawgeti(L, KEYS_UPVALUE, prop->kid);
+	if (!lua_isnil(L, -1))
+		return;
+
+	lua_pop(L, 1);
+	name = keys_name(prop->kid, &len);
+	lua_pushlstring(L, name, len);
+	cache_key(L, lua_gettop(L), prop->kid);
+}
+
+/* key_id returns the id of the string key at idx, or KEY_ID_UNINTERNED */
+static uint32_t key_id(lua_State* L, int idx, const char* key, size_t len)
+{
+	uint32_t id;
+
+	lua_pushvalue(L, idx);
+	lua_rawget(L, KEYS_UPVALUE);
+	id = lua_isnil(L, -1) ? KEY_ID_NONE : (uint32_t)lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	if (id != KEY_ID_NONE)
+		return id;
+
+	if ((id = keys_id(key, len)) != KEY_ID_UNINTERNED)
+		cache_key(L, idx, id);
+
+	return id;
+}
 
 static void table_to_log(
   lua_State* L, int idx, prop_t* props, int props_len, log_t* log)
 {
 	const char* key;
 	const char* value;
+	size_t vlen;
 	int added_props = 0;
 	bool level_added = false;
 	bool time_added = false;
@@ -78,6 +180,7 @@ static void table_to_log(
 		else if (!date_added && strcmp(key, KEY_DATE) == 0)
 			date_added = true;
 
+		vlen = 0;
 		switch (lua_type(L, -1)) {
 		case LUA_TNONE:
 		case LUA_TNIL:
@@ -88,7 +191,7 @@ static void table_to_log(
 			break;
 		case LUA_TNUMBER:
 		case LUA_TSTRING:
-			value = lua_tostring(L, -1);
+			value = lua_tolstring(L, -1, &vlen);
 			break;
 		case LUA_TTABLE:
 			value = "<table>";
@@ -108,7 +211,10 @@ static void table_to_log(
 		}
 
 		DEBUG_ASSERT(added_props < props_len);
-		log_set(log, &props[added_props++], key, value);
+		log_set(log, &props[added_props], key, value);
+		if (vlen <= UINT32_MAX)
+			props[added_props].vlen = vlen;
+		added_props++;
 
 		lua_pop(L, 1);
 	}
@@ -139,7 +245,7 @@ static int table_to_logptr(lua_State* L, int idx)
 
 	switch (lua_type(L, idx)) {
 	case LUA_TTABLE:
-		log = NEW_USERDATA_LOG(L, LOGD_PRINT_MAX_KEYS);
+		log = new_userdata_log(L, LOGD_PRINT_MAX_KEYS);
 		props = GET_USERDATA_PROPS(log);
 		log_init(log);
 		log->is_safe = true;
@@ -158,18 +264,41 @@ static int table_to_logptr(lua_State* L, int idx)
 
 static int logd_table_to_logptr(lua_State* L) { return table_to_logptr(L, 1); }
 
-static char* force_snprintl(lua_State* L, log_t* log)
+typedef char* (*encode_fn)(encode_buf_t*, log_t*, size_t*);
+
+/* push_encoded pushes log serialized by encode into the buffer of the module */
+static int push_encoded(lua_State* L, log_t* log, encode_fn encode)
 {
-	int size = snprintl(NULL, 0, log);
-	int strlen = size + 1;
-	char* str = malloc(strlen);
-	if (str == NULL) {
-		luaL_error(L, "force_snprintl: ENOMEM");
-		return NULL; /* unreachable */
-	}
-	snprintl(str, strlen, log);
+	module_t* m = lua_touserdata(L, MODULE_UPVALUE);
+	size_t len;
+	char* str;
 
-	return str;
+	if ((str = encode(&m->buf, log, &len)) == NULL)
+		return luaL_error(L, "encode: ENOMEM");
+
+	lua_pushlstring(L, str, len);
+
+	return 1;
+}
+
+static int module_gc(lua_State* L)
+{
+	module_t* m = lua_touserdata(L, 1);
+	encode_buf_free(&m->buf);
+
+	return 0;
+}
+
+void lua_set_print_writer(lua_State* L, lua_print_writer_t writer, void* ctx)
+{
+	module_t* m;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_NAME_MODULE_STATE);
+	m = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	m->writer = writer;
+	m->writer_ctx = ctx;
 }
 
 static int logd_log_to_str(lua_State* L)
@@ -177,11 +306,31 @@ static int logd_log_to_str(lua_State* L)
 	log_t* log;
 	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_TO_STR);
 
-	char* str = force_snprintl(L, log);
-	lua_pushstring(L, str);
-	free(str);
+	return push_encoded(L, log, &encode_str);
+}
 
-	return 1;
+static int logd_log_to_json(lua_State* L)
+{
+	log_t* log;
+	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_TO_JSON);
+
+	return push_encoded(L, log, &encode_json);
+}
+
+static int logd_log_to_logfmt(lua_State* L)
+{
+	log_t* log;
+	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_TO_LOGFMT);
+
+	return push_encoded(L, log, &encode_logfmt);
+}
+
+static int logd_log_to_msgpack(lua_State* L)
+{
+	log_t* log;
+	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_TO_MSGPACK);
+
+	return push_encoded(L, log, &encode_msgpack);
 }
 
 static int logd_log_to_table(lua_State* L)
@@ -191,11 +340,12 @@ static int logd_log_to_table(lua_State* L)
 
 	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_TO_TABLE);
 
+	log_scan_body(log);
 	lua_newtable(L);
 
 	for (prop = log->props; prop != NULL; prop = prop->next) {
-		lua_pushstring(L, prop->key);
-		lua_pushstring(L, prop->value);
+		push_key(L, prop);
+		lua_pushlstring(L, prop->value, log_value_len(prop));
 		lua_settable(L, 2);
 	}
 
@@ -204,19 +354,28 @@ static int logd_log_to_table(lua_State* L)
 
 int lua_print_log(lua_State* L, int idx)
 {
+	module_t* m = lua_touserdata(L, MODULE_UPVALUE);
 	log_t* log;
+	size_t len;
+	char* str;
+
 	TO_LOG_PTR(L, log, idx, LUA_NAME_PRINT);
 
-	char* str = force_snprintl(L, log);
+	if (m->writer != NULL) {
+		if ((str = encode_str(&m->buf, log, &len)) == NULL)
+			return luaL_error(L, "encode: ENOMEM");
+		m->writer(m->writer_ctx, str, len);
+		return 0;
+	}
+
 	lua_getglobal(L, "io");
 	lua_getfield(L, -1, "write");
-	lua_pushstring(L, str);
+	push_encoded(L, log, &encode_str);
 	lua_call(L, 1, 0);
 	lua_getfield(L, -1, "write");
 	lua_pushliteral(L, "\n");
 	lua_call(L, 1, 0);
 	lua_pop(L, 1);
-	free(str);
 
 	return 0;
 }
@@ -261,13 +420,18 @@ static int logd_log_clone(lua_State* L)
 
 	int size = log_size(orig);
 
-	clone = NEW_USERDATA_LOG(L, size);
+	clone = new_userdata_log(L, size);
 	clone_props = GET_USERDATA_PROPS(clone);
 	log_init(clone);
 	clone->is_safe = true;
 
-	for (prop_t* next = orig->props; next != NULL; next = next->next)
-		log_set(clone, clone_props++, next->key, next->value);
+	for (prop_t* next = orig->props; next != NULL; next = next->next) {
+		log_set(clone, clone_props, next->key, next->value);
+		clone_props->klen = next->klen;
+		clone_props->vlen = next->vlen;
+		clone_props->kid = next->kid;
+		clone_props++;
+	}
 
 	return 1;
 }
@@ -284,7 +448,8 @@ static int logd_log_set(lua_State* L)
 		  "': found %s",
 		  lua_typename(L, lua_type(L, 2)));
 	}
-	const char* value = lua_tostring(L, 3);
+	size_t vlen;
+	const char* value = lua_tolstring(L, 3, &vlen);
 	if (value == NULL) {
 		luaL_error(L,
 		  "3rd argument must be a string in call to '" LUA_NAME_LOG_SET
@@ -296,6 +461,8 @@ static int logd_log_set(lua_State* L)
 	// the log->is_safe check.
 	prop_t* prop = lua_newuserdata(L, sizeof(prop_t));
 	log_set(log, prop, key, value);
+	if (vlen <= UINT32_MAX)
+		prop->vlen = vlen;
 	return 1;
 }
 
@@ -321,22 +488,74 @@ static int logd_log_get(lua_State* L)
 	log_t* log;
 	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_GET);
 
-	const char* key = lua_tostring(L, 2);
+	size_t len;
+	uint32_t id;
+	prop_t* prop;
+	const char* key = lua_tolstring(L, 2, &len);
 	if (key == NULL) {
 		luaL_error(L,
 		  "2nd argument must be a string in call to '" LUA_NAME_LOG_GET
 		  "': found %s",
 		  lua_typename(L, lua_type(L, 2)));
 	}
-	const char* value = log_get(log, key);
-	if (value != NULL)
-		lua_pushstring(L, value);
+	if ((id = key_id(L, 2, key, len)) != KEY_ID_UNINTERNED)
+		prop = log_get_id(log, id, key, len);
+	else
+		prop = log_get_prop(log, key);
+	if (prop != NULL)
+		lua_pushlstring(L, prop->value, log_value_len(prop));
 	else
 		lua_pushnil(L);
 
 	return 1;
 }
 
+static int logd_log_len(lua_State* L)
+{
+	log_t* log;
+	TO_LOG_PTR(L, log, 1, "__len");
+
+	lua_pushinteger(L, log_size(log));
+
+	return 1;
+}
+
+/* log_next is the iterator of logd.log_pairs. The prop that it returned last
+ * is kept in an upvalue so that it does not have to look for it */
+static int log_next(lua_State* L)
+{
+	log_t* log;
+	prop_t* prop;
+	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_PAIRS);
+
+	prop = lua_touserdata(L, lua_upvalueindex(2));
+	prop = prop == NULL ? log->props : prop->next;
+	if (prop == NULL)
+		return 0;
+
+	lua_pushlightuserdata(L, prop);
+	lua_replace(L, lua_upvalueindex(2));
+	push_key(L, prop);
+	lua_pushlstring(L, prop->value, log_value_len(prop));
+
+	return 2;
+}
+
+static int logd_log_pairs(lua_State* L)
+{
+	log_t* log;
+	TO_LOG_PTR(L, log, 1, LUA_NAME_LOG_PAIRS);
+
+	log_scan_body(log);
+	lua_pushvalue(L, KEYS_UPVALUE);
+	lua_pushlightuserdata(L, NULL);
+	lua_pushcclosure(L, log_next, 2);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+
+	return 3;
+}
+
 static int logd_log_reset(lua_State* L)
 {
 	log_t* log;
@@ -351,15 +570,64 @@ static const struct luaL_Reg logd_functions[] = {{LUA_NAME_PRINT, &logd_print},
   {LUA_LEGACY_NAME_DEBUG, &logd_print},
   {LUA_NAME_TABLE_TO_LOGPTR, &logd_table_to_logptr},
   {LUA_NAME_LOG_TO_STR, &logd_log_to_str},
+  {LUA_NAME_LOG_TO_JSON, &logd_log_to_json},
+  {LUA_NAME_LOG_TO_LOGFMT, &logd_log_to_logfmt},
+  {LUA_NAME_LOG_TO_MSGPACK, &logd_log_to_msgpack},
   {LUA_NAME_LOG_TO_TABLE, &logd_log_to_table},
   {LUA_NAME_LOG_CLONE, &logd_log_clone},
   {LUA_LEGACY_NAME_LOG_STRING, &logd_log_to_str},
   {LUA_NAME_LOG_GET, &logd_log_get}, {LUA_NAME_LOG_SET, &logd_log_set},
   {LUA_NAME_LOG_REMOVE, &logd_log_remove},
-  {LUA_NAME_LOG_RESET, &logd_log_reset}, {NULL, NULL}};
+  {LUA_NAME_LOG_RESET, &logd_log_reset},
+  {LUA_NAME_LOG_PAIRS, &logd_log_pairs}, {NULL, NULL}};
+
+static int luaopen_logd_ffi(lua_State* L)
+{
+	if (luaL_loadbuffer(L, (const char*)logdffi_lua, logdffi_lua_len,
+		  LUA_NAME_LOGD_FFI_MODULE) != 0)
+		return lua_error(L);
+
+	lua_call(L, 0, 1);
+
+	return 1;
+}
 
 LUALIB_API int luaopen_logd(lua_State* L)
 {
-	luaL_register(L, LUA_NAME_LOGD_MODULE, logd_functions);
+	module_t* m;
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "preload");
+	lua_pushcfunction(L, luaopen_logd_ffi);
+	lua_setfield(L, -2, LUA_NAME_LOGD_FFI_MODULE);
+	lua_pop(L, 2);
+
+	lua_newtable(L);
+
+	/* logptrs can be indexed like the tables of logd.to_table */
+	luaL_newmetatable(L, LUA_NAME_LOGPTR_METATABLE);
+	lua_pushvalue(L, -2);
+	lua_pushcclosure(L, logd_log_get, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, logd_log_len);
+	lua_setfield(L, -2, "__len");
+	lua_pushvalue(L, -2);
+	lua_pushcclosure(L, logd_log_pairs, 1);
+	lua_setfield(L, -2, "__pairs");
+	lua_pop(L, 1);
+
+	/* logs are serialized into a buffer that is freed with the state */
+	m = lua_newuserdata(L, sizeof(module_t));
+	encode_buf_init(&m->buf);
+	m->writer = NULL;
+	m->writer_ctx = NULL;
+	luaL_newmetatable(L, LUA_NAME_MODULE_STATE_METATABLE);
+	lua_pushcfunction(L, module_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_NAME_MODULE_STATE);
+
+	luaL_openlib(L, LUA_NAME_LOGD_MODULE, logd_functions, 2);
 	return 1;
 }
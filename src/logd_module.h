@@ -3,10 +3,17 @@
 
 #include <lua.h>
 
+#include "log.h"
+
 #define LUA_NAME_ON_LOG "on_log"
+#define LUA_NAME_ON_LOGS "on_logs"
 #define LUA_NAME_ON_EXIT "on_exit"
 #define LUA_NAME_ON_ERROR "on_error"
+#define LUA_NAME_FILTER "filter"
 #define LUA_NAME_LOGD_MODULE "logd"
+#define LUA_NAME_LOGD_FFI_MODULE "logd.ffi"
+#define LUA_NAME_LOGPTR_METATABLE "logd.logptr"
+#define LUA_NAME_MODULE_STATE "logd.state"
 
 enum exit_reason {
 	REASON_ERROR = 0,
@@ -14,6 +21,21 @@ enum exit_reason {
 	REASON_EOF = 2,
 };
 
+/* logptrs are full userdata that point to the log that they give access to,
+ * so that the same userdata can be pointed to another log on every call */
+typedef struct logptr_s {
+	log_t* log;
+} logptr_t;
+
 LUALIB_API int luaopen_logd(lua_State* L);
+/* lua_new_logptr pushes a logptr to log with the metatable of logptrs */
+logptr_t* lua_new_logptr(lua_State* L, log_t* log);
+
+/* lua_print_writer_t writes a line printed by logd.print, without its
+ * newline */
+typedef void (*lua_print_writer_t)(void* ctx, const char* line, size_t len);
+/* lua_set_print_writer makes logd.print write to writer instead of io.write
+ * in the lua state L, which must have opened the logd module */
+void lua_set_print_writer(lua_State* L, lua_print_writer_t writer, void* ctx);
 
 #endif
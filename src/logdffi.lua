@@ -0,0 +1,122 @@
+-- logd.ffi is a LuaJIT FFI view of logptrs: their properties can be walked
+-- and compared as cdata, without the C function calls and the Lua strings of
+-- logd.log_get, so that logd.on_log can stay in compiled traces.
+--
+-- The layouts below mirror logptr_t in src/logd_module.h and log_t and prop_t
+-- in src/log.h. Lengths are 0 when the scanner did not record them.
+local ffi = require('ffi')
+
+ffi.cdef[[
+typedef struct logd_prop_s {
+	struct logd_prop_s* next;
+	const char* key;
+	const char* value;
+	uint32_t klen;
+	uint32_t vlen;
+	uint32_t khash;
+	uint32_t kid;
+} logd_prop_t;
+
+typedef struct logd_log_s {
+	logd_prop_t* props;
+	bool is_safe;
+	void* index;
+	void* body;
+} logd_log_t;
+
+typedef struct logd_logptr_s {
+	logd_log_t* log;
+} logd_logptr_t;
+]]
+
+-- scripts may have declared these already
+pcall(ffi.cdef, [[
+size_t strlen(const char* s);
+int memcmp(const void* s1, const void* s2, size_t n);
+]])
+
+local C = ffi.C
+local logptr_t = ffi.typeof('logd_logptr_t*')
+
+local M = {}
+
+-- M.log casts a logptr into a logd_log_t*, which must not be used once the
+-- logptr is not safe to use anymore
+function M.log(logptr)
+	local log = ffi.cast(logptr_t, logptr).log
+	if not log.is_safe then
+		error("it is not safe to use a logptr outside of logd.on_log's " ..
+			"calling thread's context. Clone first with `logd.clone`'")
+	end
+	-- the length of a logptr is taken after scanning the body that --lazy
+	-- left behind
+	if log.body ~= nil then
+		local _ = #logptr
+	end
+	return log
+end
+
+local function len(s, n)
+	if n > 0 then
+		return n
+	end
+	return tonumber(C.strlen(s))
+end
+
+function M.key(prop)
+	return ffi.string(prop.key, len(prop.key, prop.klen))
+end
+
+function M.value(prop)
+	return ffi.string(prop.value, len(prop.value, prop.vlen))
+end
+
+-- M.key_eq and M.value_eq compare properties with strings without making
+-- strings of them
+function M.key_eq(prop, s)
+	local n = len(prop.key, prop.klen)
+	return n == #s and C.memcmp(prop.key, s, n) == 0
+end
+
+function M.value_eq(prop, s)
+	local n = len(prop.value, prop.vlen)
+	return n == #s and C.memcmp(prop.value, s, n) == 0
+end
+
+local function next_prop(log, prop)
+	if prop == nil then
+		prop = log.props
+	else
+		prop = prop.next
+	end
+	if prop ~= nil then
+		return prop
+	end
+end
+
+-- for prop in M.props(log) walks the properties of log, latest set first
+function M.props(log)
+	return next_prop, log, nil
+end
+
+-- M.find returns the property of log with key like logd.log_get, or nil
+function M.find(log, key)
+	local prop = log.props
+	while prop ~= nil do
+		if M.key_eq(prop, key) then
+			return prop
+		end
+		prop = prop.next
+	end
+	return nil
+end
+
+function M.get(log, key)
+	local prop = M.find(log, key)
+	if prop == nil then
+		return nil
+	end
+	return M.value(prop)
+end
+
+return M
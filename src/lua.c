@@ -24,6 +24,11 @@
 #include "luvipath.lua.h"
 
 #define ON_LOG_INTERNAL "__logd_on_log"
+#define ON_LOGS_INTERNAL "__logd_on_logs"
+#define ON_LOGS_BATCH_INTERNAL "__logd_on_logs_batch"
+#define ON_LOG_LOGPTR_INTERNAL "__logd_on_log_logptr"
+#define ON_LOGS_LOGPTRS_INTERNAL "__logd_on_logs_logptrs"
+#define ON_ERROR_LOGPTR_INTERNAL "__logd_on_error_logptr"
 
 static int lua_load_init_modules(lua_t* l)
 {
@@ -74,6 +79,11 @@ static int lua_load_libs(lua_t* l, uv_loop_t* loop)
 {
 	luaopen_logd(l->state);
 
+	if (l->funcs != NULL) {
+		luaL_register(l->state, LUA_NAME_LOGD_MODULE, l->funcs);
+		lua_pop(l->state, 1);
+	}
+
 	if (luaopen_luv_loop(l->state, loop) < 0)
 		return 1;
 
@@ -140,7 +150,8 @@ static void lua_push_on_exit(lua_State* state)
 	lua_getfield(state, -1, LUA_NAME_ON_EXIT);
 }
 
-lua_t* lua_create(uv_loop_t* loop, const char* script)
+lua_t* lua_create(
+  uv_loop_t* loop, const char* script, const luaL_Reg* funcs)
 {
 	lua_t* l = NULL;
 
@@ -149,7 +160,7 @@ lua_t* lua_create(uv_loop_t* loop, const char* script)
 		goto error;
 	}
 
-	if (lua_init(l, loop, script) == -1) {
+	if (lua_init(l, loop, script, funcs) == -1) {
 		goto error;
 	}
 
@@ -161,12 +172,15 @@ error:
 	return NULL;
 }
 
-int lua_init(lua_t* l, uv_loop_t* loop, const char* script)
+int lua_init(
+  lua_t* l, uv_loop_t* loop, const char* script, const luaL_Reg* funcs)
 {
 	char* run_str = NULL;
 	int lerrno;
 
 	l->loop = loop;
+	l->funcs = funcs;
+	l->filter = NULL;
 	l->state = luaL_newstate();
 	if (l->state == NULL) {
 		errno = ENOMEM;
@@ -199,16 +213,54 @@ int lua_init(lua_t* l, uv_loop_t* loop, const char* script)
 	}
 
 	lua_getglobal(l->state, LUA_NAME_LOGD_MODULE);
+	lua_getfield(l->state, -1, LUA_NAME_ON_LOGS);
+	l->on_logs = lua_isfunction(l->state, -1);
+	l->on_logs_len = 0;
+	lua_setglobal(l->state, ON_LOGS_INTERNAL);
+
 	lua_getfield(l->state, -1, LUA_NAME_ON_LOG);
-	if (!lua_isfunction(l->state, -1)) {
+	if (!l->on_logs && !lua_isfunction(l->state, -1)) {
 		fprintf(stderr,
 		  "Couldn not find '" LUA_NAME_LOGD_MODULE "." LUA_NAME_ON_LOG
+		  "' or '" LUA_NAME_LOGD_MODULE "." LUA_NAME_ON_LOGS
 		  "' function in loaded script\n");
 		errno = EINVAL;
 		goto error;
 	}
 
 	lua_setglobal(l->state, ON_LOG_INTERNAL);
+
+	/* the array of logptrs passed to logd.on_logs is reused */
+	lua_newtable(l->state);
+	lua_setglobal(l->state, ON_LOGS_BATCH_INTERNAL);
+
+	/* and so are the logptrs, which are pointed to the logs of every call */
+	lua_new_logptr(l->state, NULL);
+	lua_setglobal(l->state, ON_LOG_LOGPTR_INTERNAL);
+	lua_new_logptr(l->state, NULL);
+	lua_setglobal(l->state, ON_ERROR_LOGPTR_INTERNAL);
+	lua_newtable(l->state);
+	lua_setglobal(l->state, ON_LOGS_LOGPTRS_INTERNAL);
+	l->logptrs_len = 0;
+
+	lua_getfield(l->state, -1, LUA_NAME_FILTER);
+	switch (lua_type(l->state, -1)) {
+	case LUA_TNIL:
+		break;
+	case LUA_TSTRING:
+		if ((l->filter = strdup(lua_tostring(l->state, -1))) == NULL) {
+			perror("strdup");
+			goto error;
+		}
+		break;
+	default:
+		fprintf(stderr,
+		  "'" LUA_NAME_LOGD_MODULE "." LUA_NAME_FILTER
+		  "' must be a string in loaded script\n");
+		errno = EINVAL;
+		goto error;
+	}
+	lua_pop(l->state, 1);
 	/* pop logd module */
 	lua_pop(l->state, 1);
 
@@ -225,14 +277,60 @@ error:
 	return -1;
 }
 
-void lua_call_on_log(lua_t* l, log_t* log)
+void lua_call_on_log(lua_t* l, log_t* log, const char* source)
 {
+	if (l->on_logs) {
+		lua_call_on_logs(l, log, 1, source);
+		return;
+	}
+
 	lua_getglobal(l->state, ON_LOG_INTERNAL);
 	DEBUG_ASSERT(lua_isfunction(l->state, -1));
 
-	lua_pushlightuserdata(l->state, log);
+	lua_getglobal(l->state, ON_LOG_LOGPTR_INTERNAL);
+	((logptr_t*)lua_touserdata(l->state, -1))->log = log;
+	lua_pushstring(l->state, source);
 
-	lua_call(l->state, 1, 0);
+	lua_call(l->state, 2, 0);
+}
+
+bool lua_on_logs_defined(lua_t* l) { return l->on_logs; }
+
+const char* lua_filter(lua_t* l) { return l->filter; }
+
+void lua_call_on_logs(lua_t* l, log_t* logs, size_t n, const char* source)
+{
+	size_t i;
+
+	lua_getglobal(l->state, ON_LOGS_INTERNAL);
+	DEBUG_ASSERT(lua_isfunction(l->state, -1));
+
+	lua_getglobal(l->state, ON_LOGS_LOGPTRS_INTERNAL);
+	lua_getglobal(l->state, ON_LOGS_BATCH_INTERNAL);
+	for (i = 0; i < n; i++) {
+		if (i < l->logptrs_len) {
+			lua_rawgeti(l->state, -2, i + 1);
+			((logptr_t*)lua_touserdata(l->state, -1))->log = &logs[i];
+		} else {
+			lua_new_logptr(l->state, &logs[i]);
+			lua_pushvalue(l->state, -1);
+			lua_rawseti(l->state, -4, i + 1);
+			l->logptrs_len++;
+		}
+		lua_rawseti(l->state, -2, i + 1);
+	}
+	/* logptrs of previous calls must not be mistaken for logs */
+	for (; i < l->on_logs_len; i++) {
+		lua_pushnil(l->state);
+		lua_rawseti(l->state, -2, i + 1);
+	}
+	l->on_logs_len = n;
+	lua_remove(l->state, -2);
+
+	lua_pushinteger(l->state, n);
+	lua_pushstring(l->state, source);
+
+	lua_call(l->state, 3, 0);
 }
 
 bool lua_on_error_defined(lua_t* l)
@@ -246,17 +344,19 @@ bool lua_on_error_defined(lua_t* l)
 	return ret;
 }
 
-void lua_call_on_error(
-  lua_t* l, const char* err, log_t* partial, const char* at)
+void lua_call_on_error(lua_t* l, const char* err, log_t* partial,
+  const char* at, const char* source)
 {
 	lua_push_on_error(l->state);
 	DEBUG_ASSERT(lua_isfunction(l->state, -1));
 
 	lua_pushstring(l->state, err);
-	lua_pushlightuserdata(l->state, partial);
+	lua_getglobal(l->state, ON_ERROR_LOGPTR_INTERNAL);
+	((logptr_t*)lua_touserdata(l->state, -1))->log = partial;
 	lua_pushstring(l->state, at);
+	lua_pushstring(l->state, source);
 
-	lua_call(l->state, 3, 0);
+	lua_call(l->state, 4, 0);
 	lua_pop(l->state, 1); // logd module
 }
 
@@ -286,6 +386,7 @@ void lua_free(lua_t* l)
 {
 	if (l) {
 		lua_close(l->state);
+		free(l->filter);
 		free(l);
 	}
 }
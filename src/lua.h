@@ -5,20 +5,39 @@
 
 #include "log.h"
 #include "logd_module.h"
+#include <lauxlib.h>
 #include <lua.h>
 #include <uv.h>
 
 typedef struct lua_s {
 	lua_State* state;
 	uv_loop_t* loop;
+	/* daemon functions added to the logd module */
+	const luaL_Reg* funcs;
+	/* the script defines logd.on_logs */
+	bool on_logs;
+	/* number of logptrs in the array last passed to logd.on_logs */
+	size_t on_logs_len;
+	/* number of logptrs recycled for the logs passed to logd.on_logs */
+	size_t logptrs_len;
+	/* copy of the logd.filter of the script, or NULL */
+	char* filter;
 } lua_t;
 
-lua_t* lua_create(uv_loop_t* loop, const char* script);
-int lua_init(lua_t* l, uv_loop_t* loop, const char* script);
-void lua_call_on_log(lua_t*, log_t* log);
+lua_t* lua_create(
+  uv_loop_t* loop, const char* script, const luaL_Reg* funcs);
+int lua_init(
+  lua_t* l, uv_loop_t* loop, const char* script, const luaL_Reg* funcs);
+/* source is the path of the input the log was read from */
+void lua_call_on_log(lua_t*, log_t* log, const char* source);
+bool lua_on_logs_defined(lua_t*);
+/* logs is an array of n logs */
+void lua_call_on_logs(lua_t*, log_t* logs, size_t n, const char* source);
+/* lua_filter returns the filter expression set by the script, or NULL */
+const char* lua_filter(lua_t*);
 bool lua_on_error_defined(lua_t*);
-void lua_call_on_error(
-  lua_t*, const char* err, log_t* partial, const char* remaining);
+void lua_call_on_error(lua_t*, const char* err, log_t* partial,
+  const char* remaining, const char* source);
 bool lua_on_exit_defined(lua_t*);
 void lua_call_on_exit(
   lua_t* l, enum exit_reason reason, const char* reason_str);
@@ -0,0 +1,168 @@
+#include "./mirror.h"
+
+#ifdef LOGD_MIRROR
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "./util.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#define ROUND_UP(n, m) (((n) + (m)-1) / (m) * (m))
+
+static size_t page_size()
+{
+	static size_t pg;
+
+	if (pg == 0)
+		pg = sysconf(_SC_PAGESIZE);
+
+	return pg;
+}
+
+/* map ring pages at addr, coalescing pages that are contiguous in the memfd */
+static int mirror_map(int fd, const size_t* pages, size_t npages, char* addr)
+{
+	size_t i, run, pg = page_size();
+
+	for (i = 0; i < npages; i += run) {
+		for (run = 1; i + run < npages && pages[i + run] == pages[i] + run;
+			 run++)
+			;
+
+		if (mmap(addr + i * pg, run * pg, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_FIXED, fd, pages[i] * pg) == MAP_FAILED)
+			return 1;
+	}
+
+	return 0;
+}
+
+static char* mirror_map_ring(int fd, const size_t* pages, size_t npages)
+{
+	size_t len = npages * page_size();
+	char* base;
+
+	/* reserve address space for both mappings so that they are adjacent */
+	if ((base = mmap(NULL, 2 * len, PROT_NONE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED)
+		return NULL;
+
+	if (mirror_map(fd, pages, npages, base) != 0 ||
+	  mirror_map(fd, pages, npages, base + len) != 0) {
+		munmap(base, 2 * len);
+		return NULL;
+	}
+
+	return base;
+}
+
+int mirror_init(mirror_t* m, size_t cap)
+{
+	size_t i;
+
+	m->base = NULL;
+	m->pages = NULL;
+	m->cap = ROUND_UP(cap, page_size());
+	m->file_pages = m->cap / page_size();
+
+	if ((m->fd = syscall(__NR_memfd_create, "logd", MFD_CLOEXEC)) == -1)
+		return 1;
+
+	if (ftruncate(m->fd, m->cap) != 0)
+		goto error;
+
+	if ((m->pages = malloc(m->file_pages * sizeof(size_t))) == NULL) {
+		errno = ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < m->file_pages; i++)
+		m->pages[i] = i;
+
+	if ((m->base = mirror_map_ring(m->fd, m->pages, m->file_pages)) == NULL)
+		goto error;
+
+	DEBUG_LOG("mapped mirrored ring, base: %p, cap: %zu", m->base, m->cap);
+
+	return 0;
+
+error:
+	mirror_free(m);
+	return 1;
+}
+
+char* mirror_grow(mirror_t* m, char* data, size_t len, size_t add)
+{
+	size_t pg = page_size();
+	size_t npages = m->cap / pg;
+	size_t add_pages = ROUND_UP(add, pg) / pg;
+	size_t start = (data - m->base) % m->cap;
+	size_t first = start / pg;
+	size_t offset = start - first * pg;
+	size_t *pages, i;
+	char* base;
+
+	if (add_pages == 0 || len > m->cap) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((pages = malloc((npages + add_pages) * sizeof(size_t))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* rotate the ring so that it starts at the page data starts in and append
+	 * new pages to it */
+	for (i = 0; i < npages; i++)
+		pages[i] = m->pages[(first + i) % npages];
+	for (i = 0; i < add_pages; i++)
+		pages[npages + i] = m->file_pages + i;
+
+	if (ftruncate(m->fd, (m->file_pages + add_pages) * pg) != 0 ||
+	  (base = mirror_map_ring(m->fd, pages, npages + add_pages)) == NULL) {
+		free(pages);
+		return NULL;
+	}
+
+	/* data that wrapped around into the page it starts in is now at the
+	 * beginning of the ring: move it after the rotated pages. This is less
+	 * than a page */
+	if (offset + len > m->cap)
+		memcpy(base + m->cap, base, offset + len - m->cap);
+
+	munmap(m->base, 2 * m->cap);
+	free(m->pages);
+	m->pages = pages;
+	m->base = base;
+	m->cap += add_pages * pg;
+	m->file_pages += add_pages;
+
+	DEBUG_LOG("grew mirrored ring, base: %p, cap: %zu", m->base, m->cap);
+
+	return base + offset;
+}
+
+void mirror_free(mirror_t* m)
+{
+	int lerrno = errno;
+
+	if (m->base != NULL) {
+		munmap(m->base, 2 * m->cap);
+		m->base = NULL;
+	}
+	if (m->fd != -1) {
+		UNEINTR2(close(m->fd));
+		m->fd = -1;
+	}
+	free(m->pages);
+	m->pages = NULL;
+
+	errno = lerrno;
+}
+#endif
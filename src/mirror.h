@@ -0,0 +1,36 @@
+#ifndef LOGD_MIRROR_H
+#define LOGD_MIRROR_H
+
+#include <stddef.h>
+#include <sys/syscall.h>
+
+/* ring buffers backed by a memfd whose pages are mapped twice, back to back,
+ * so that data wrapping around the end of the ring is contiguous in memory */
+#ifdef __NR_memfd_create
+#define LOGD_MIRROR
+#endif
+
+#ifdef LOGD_MIRROR
+typedef struct mirror_s {
+	/* first of the two mappings of the ring */
+	char* base;
+	/* size of the ring, a multiple of the page size */
+	size_t cap;
+	int fd;
+	/* memfd page of each ring page, in ring order */
+	size_t* pages;
+	size_t file_pages;
+} mirror_t;
+
+/* mirror_init maps a ring of at least cap bytes. Any address in
+ * [base, base + cap) can be followed by up to cap bytes of ring data */
+int mirror_init(mirror_t* m, size_t cap);
+/* mirror_grow makes the ring at least add bytes bigger by remapping its pages
+ * rather than copying them. The len bytes at data, with len no bigger than
+ * the ring, stay contiguous: their new address is returned, or NULL on error
+ * in which case the ring is left untouched */
+char* mirror_grow(mirror_t* m, char* data, size_t len, size_t add);
+void mirror_free(mirror_t* m);
+#endif
+
+#endif
@@ -0,0 +1,325 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "./output.h"
+#include "./util.h"
+
+/* output owning the given embedded libuv handle */
+#define OUTPUT_OF(handle, member)                                              \
+	((output_t*)((char*)(handle)-offsetof(output_t, member)))
+
+/* AT is the address of the byte off bytes after the head of the ring */
+#define AT(o, off) (&(o)->buf[((o)->head + (off)) % (o)->cap])
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* output_writev is writev on fd, without blocking if it is a socket */
+static ssize_t output_writev(output_t* o, struct iovec* iov, int iovcnt)
+{
+	struct msghdr msg;
+
+	if (!o->sock)
+		return writev(o->fd, iov, iovcnt);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+
+	return sendmsg(o->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void consume(output_t* o, size_t n)
+{
+	o->head = (o->head + n) % o->cap;
+	o->len -= n;
+
+	if (o->len == 0) {
+		o->head = 0;
+		o->partial = 0;
+	} else {
+		o->partial = *AT(o, o->cap - 1) != '\n';
+	}
+}
+
+/* flush_some writes as much of the buffer as fd takes without blocking. On
+ * errors other than EAGAIN the buffer is dropped and 1 is returned */
+static int flush_some(output_t* o)
+{
+	struct iovec iov[2];
+	size_t first;
+	ssize_t n;
+	int iovcnt;
+
+	while (o->len > 0) {
+		first = o->cap - o->head;
+		iov[0].iov_base = o->buf + o->head;
+		if (first >= o->len) {
+			iov[0].iov_len = o->len;
+			iovcnt = 1;
+		} else {
+			iov[0].iov_len = first;
+			iov[1].iov_base = o->buf;
+			iov[1].iov_len = o->len - first;
+			iovcnt = 2;
+		}
+
+		if ((n = output_writev(o, iov, iovcnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			perror("writev");
+			consume(o, o->len);
+			return 1;
+		}
+
+		o->bytes += n;
+		o->flushes++;
+		consume(o, n);
+	}
+
+	return 0;
+}
+
+static int wait_writable(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+
+	UNEINTR(poll(&pfd, 1, -1));
+
+	return 0;
+}
+
+/* flush_all writes all of the buffer, blocking until fd takes it */
+static void flush_all(output_t* o)
+{
+	while (o->len > 0) {
+		if (flush_some(o) != 0 || (o->len > 0 && wait_writable(o->fd) != 0))
+			return;
+	}
+}
+
+static void on_writable(uv_poll_t* handle, int status, int events);
+
+/* flush flushes what fd takes and waits for it to be writable again to
+ * flush the rest */
+static void flush(output_t* o)
+{
+	flush_some(o);
+
+	if (o->blocking || o->closed)
+		return;
+
+	if (o->len > 0)
+		uv_poll_start(&o->poll, UV_WRITABLE, on_writable);
+	else
+		uv_poll_stop(&o->poll);
+}
+
+static void on_writable(uv_poll_t* handle, int status, int events)
+{
+	flush(OUTPUT_OF(handle, poll));
+}
+
+static void on_flush_timer(uv_timer_t* timer)
+{
+	flush(OUTPUT_OF(timer, timer));
+}
+
+/* drop_oldest drops the oldest whole lines until want bytes fit. The rest of
+ * a partially written line is kept ahead of the remaining ones so that the
+ * output does not get a line cut in half. It returns whether want fits */
+static bool drop_oldest(output_t* o, size_t want)
+{
+	size_t keep = 0, drop, i;
+
+	if (o->partial) {
+		while (keep < o->len && *AT(o, keep) != '\n')
+			keep++;
+		keep++;
+	}
+
+	if (keep + want > o->cap)
+		return false;
+
+	for (drop = keep; o->cap - o->len + (drop - keep) < want; drop++) {
+		while (*AT(o, drop) != '\n')
+			drop++;
+		o->drops++;
+	}
+
+	/* the kept bytes move forward over the dropped ones */
+	for (i = keep; i > 0; i--)
+		*AT(o, drop - keep + i - 1) = *AT(o, i - 1);
+	o->head = (o->head + drop - keep) % o->cap;
+	o->len -= drop - keep;
+
+	return true;
+}
+
+/* write_through writes line and its newline straight to fd, blocking until
+ * it takes them */
+static void write_through(output_t* o, const char* line, size_t len)
+{
+	struct iovec iov[2] = {{.iov_base = (char*)line, .iov_len = len},
+	  {.iov_base = "\n", .iov_len = 1}};
+	struct iovec* next = iov;
+	int iovcnt = 2;
+	ssize_t n;
+
+	while (iovcnt > 0) {
+		if ((n = output_writev(o, next, iovcnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+			  wait_writable(o->fd) == 0)
+				continue;
+			perror("writev");
+			return;
+		}
+
+		o->bytes += n;
+		o->flushes++;
+		for (; iovcnt > 0 && (size_t)n >= next->iov_len; iovcnt--)
+			n -= (next++)->iov_len;
+		if (iovcnt > 0) {
+			next->iov_base = (char*)next->iov_base + n;
+			next->iov_len -= n;
+		}
+	}
+}
+
+int output_init(output_t* o, uv_loop_t* loop, int fd, size_t cap, int interval,
+  enum output_overflow_e overflow)
+{
+	char path[32];
+	struct stat st;
+	int flags;
+
+	memset(o, 0, sizeof(output_t));
+	o->loop = loop;
+	o->fd = fd;
+	o->cap = cap;
+	o->overflow = overflow;
+	o->blocking = 1;
+
+	if ((o->buf = malloc(cap)) == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		return 1;
+	}
+
+	/* sockets cannot be reopened but each send can be made non blocking.
+	 * uv_poll_init sets O_NONBLOCK on the open file description that other
+	 * writers of fd share, so its flags are put back */
+	if (S_ISSOCK(st.st_mode)) {
+		if ((flags = fcntl(fd, F_GETFL)) == -1) {
+			perror("fcntl");
+			return 1;
+		}
+		o->sock = 1;
+		o->blocking = 0;
+		uv_poll_init(loop, &o->poll, o->fd);
+		uv_unref((uv_handle_t*)&o->poll);
+		if (fcntl(fd, F_SETFL, flags) == -1)
+			perror("fcntl");
+	} else if (!S_ISREG(st.st_mode)) {
+		/* a new open file description has its own O_NONBLOCK flag */
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+		if ((o->fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) == -1) {
+			DEBUG_LOG("could not reopen output %d, errno: %d", fd, errno);
+			o->fd = fd;
+		} else {
+			o->owned = 1;
+			o->blocking = 0;
+			uv_poll_init(loop, &o->poll, o->fd);
+			uv_unref((uv_handle_t*)&o->poll);
+		}
+	}
+
+	/* pending lines alone do not keep the loop alive: they are written by
+	 * output_close or output_free */
+	uv_timer_init(loop, &o->timer);
+	uv_timer_start(&o->timer, on_flush_timer, interval, interval);
+	uv_unref((uv_handle_t*)&o->timer);
+
+	return 0;
+}
+
+void output_write(output_t* o, const char* line, size_t len)
+{
+	size_t want = len + 1, tail, first;
+
+	if (o->len + want > o->cap)
+		flush(o);
+
+	if (o->len + want > o->cap) {
+		switch (o->overflow) {
+		case OUTPUT_BLOCK:
+			flush_all(o);
+			if (want > o->cap) {
+				write_through(o, line, len);
+				return;
+			}
+			break;
+		case OUTPUT_DROP_NEWEST:
+			o->drops++;
+			return;
+		case OUTPUT_DROP_OLDEST:
+			if (!drop_oldest(o, want)) {
+				o->drops++;
+				return;
+			}
+			break;
+		}
+	}
+
+	tail = (o->head + o->len) % o->cap;
+	first = o->cap - tail < len ? o->cap - tail : len;
+	memcpy(o->buf + tail, line, first);
+	memcpy(o->buf, line + first, len - first);
+	*AT(o, o->len + len) = '\n';
+	o->len += want;
+
+	if (o->closed)
+		flush_all(o);
+}
+
+void output_close(output_t* o)
+{
+	if (o->buf == NULL || o->closed)
+		return;
+
+	flush_all(o);
+	uv_timer_stop(&o->timer);
+	if (!o->blocking)
+		uv_poll_stop(&o->poll);
+	o->closed = 1;
+}
+
+void output_free(output_t* o)
+{
+	if (o->buf == NULL)
+		return;
+
+	flush_all(o);
+	if (o->owned)
+		close(o->fd);
+	free(o->buf);
+	o->buf = NULL;
+}
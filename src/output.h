@@ -0,0 +1,64 @@
+#ifndef LOGD_OUTPUT_H
+#define LOGD_OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+
+/* what to do with lines that do not fit in the buffer of an output that
+ * cannot be written to right away */
+enum output_overflow_e {
+	/* wait for the output, stalling the event loop like blocking writes */
+	OUTPUT_BLOCK,
+	/* drop the line being written */
+	OUTPUT_DROP_NEWEST,
+	/* drop the oldest buffered lines until it fits */
+	OUTPUT_DROP_OLDEST,
+};
+
+/* lines written to a file descriptor through a bounded ring buffer that is
+ * flushed with writev when it fills up and on every flush interval. Pipes,
+ * terminals and sockets are written without blocking and flushed again once
+ * libuv reports them writable */
+typedef struct output_s {
+	uv_loop_t* loop;
+	int fd;
+	/* fd was reopened by output_init to be written without blocking */
+	int owned;
+	/* fd is written with blocking writes, as regular files */
+	int blocking;
+	/* fd is a socket, written with sendmsg and MSG_DONTWAIT */
+	int sock;
+	/* ring of cap bytes with len pending bytes from head */
+	char* buf;
+	size_t cap;
+	size_t head;
+	size_t len;
+	/* the line at head was partially written and has to be completed */
+	int partial;
+	enum output_overflow_e overflow;
+	uv_timer_t timer;
+	uv_poll_t poll;
+	/* handles are stopped: lines are flushed as soon as they are written */
+	int closed;
+	/* bytes that were written to fd, writev calls that wrote any and lines
+	 * that were dropped */
+	uint64_t bytes;
+	uint64_t flushes;
+	uint64_t drops;
+} output_t;
+
+/* output_init buffers up to cap bytes of lines for fd, which are flushed at
+ * least every interval milliseconds. Non regular files other than sockets are
+ * reopened so that they can be made non blocking without affecting other
+ * writers of fd */
+int output_init(output_t* o, uv_loop_t* loop, int fd, size_t cap, int interval,
+  enum output_overflow_e overflow);
+/* output_write buffers the len bytes of line followed by a newline */
+void output_write(output_t* o, const char* line, size_t len);
+/* output_close writes what is buffered, blocking if needed, and stops the
+ * handles of o, whose lines are written right away from then on */
+void output_close(output_t* o);
+void output_free(output_t* o);
+
+#endif
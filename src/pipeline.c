@@ -0,0 +1,534 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./pipeline.h"
+#include "./util.h"
+
+/* pipeline owning the given embedded libuv handle */
+#define PIPELINE_OF(handle, member)                                            \
+	((pipeline_t*)((char*)(handle)-offsetof(pipeline_t, member)))
+
+#define SLOT_AT(p, i) (&(p)->slots[(i) % PIPELINE_SLOTS])
+
+#define STOPPED(p) __atomic_load_n(&(p)->stop, __ATOMIC_ACQUIRE)
+
+static int grow(void** ptr, size_t* cap, size_t want, size_t size)
+{
+	size_t ncap = *cap > 0 ? *cap : 64;
+	void* grown;
+
+	while (ncap < want)
+		ncap *= 2;
+
+	if ((grown = realloc(*ptr, ncap * size)) == NULL) {
+		errno = ENOMEM;
+		return 1;
+	}
+
+	*ptr = grown;
+	*cap = ncap;
+
+	return 0;
+}
+
+/* slot_add appends a result to s with a copy of the props of log, which are
+ * only valid until the scanner is reset */
+static int slot_add(pipeline_slot_t* s, enum pipeline_res_e type,
+  const scan_res_t* res, log_t* log)
+{
+	prop_t *prop, *old = s->props;
+	size_t i, n = 0, cap = s->res_cap;
+
+	for (prop = log->props; prop != NULL; prop = prop->next)
+		n++;
+
+	if (s->len == s->res_cap &&
+	  (grow((void**)&s->logs, &cap, s->len + 1, sizeof(log_t)) != 0 ||
+		grow((void**)&s->res, &s->res_cap, s->len + 1,
+		  sizeof(pipeline_res_t)) != 0))
+		return 1;
+
+	if (s->props_len + n > s->props_cap) {
+		if (grow((void**)&s->props, &s->props_cap, s->props_len + n,
+			  sizeof(prop_t)) != 0)
+			return 1;
+
+		/* logs that were added before point into the old props */
+		for (i = 0; i < s->props_len; i++) {
+			if (s->props[i].next != NULL)
+				s->props[i].next = s->props + (s->props[i].next - old);
+		}
+		for (i = 0; i < s->len; i++) {
+			if (s->logs[i].props != NULL)
+				s->logs[i].props = s->props + (s->logs[i].props - old);
+		}
+	}
+
+	log_init(&s->logs[s->len]);
+	s->logs[s->len].props = n > 0 ? &s->props[s->props_len] : NULL;
+	for (prop = log->props; prop != NULL; prop = prop->next) {
+		s->props[s->props_len] = *prop;
+		s->props[s->props_len].next =
+		  prop->next != NULL ? &s->props[s->props_len + 1] : NULL;
+		s->props_len++;
+	}
+
+	s->res[s->len].type = type;
+	s->res[s->len].error = res->error.msg;
+	s->res[s->len].at = res->error.at;
+	s->len++;
+
+	return 0;
+}
+
+/* slot_add_oversize adds the partial log that fills bytes start to end of s,
+ * cut short to p->truncate bytes */
+static int slot_add_oversize(
+  pipeline_t* p, pipeline_slot_t* s, log_t* partial, size_t start, size_t end)
+{
+	scan_res_t res = {.error = {.msg = NULL, .at = ""}};
+	log_t log;
+	prop_t* prop;
+	size_t from = s->len;
+	/* a log that fills the slot gives up its last byte to the terminator */
+	size_t cut = end - start > p->truncate ? start + p->truncate : end - 1;
+	char* at = s->buf + cut;
+
+	*at = '\x00';
+	log_init(&log);
+	if (partial != NULL)
+		log.props = partial->props;
+
+	if (slot_add(s, PIPELINE_OVERSIZE, &res, &log) != 0)
+		return 1;
+
+	/* what was recorded of keys and values may reach past the cut */
+	for (prop = s->logs[from].props; prop != NULL; prop = prop->next) {
+		if ((uintptr_t)prop->key - (uintptr_t)at <= end - cut)
+			prop->key = "";
+		/* and a key that was not done may be left with the value of an older
+		 * log, which could be in a slot that was reused since */
+		if ((uintptr_t)prop->value - (uintptr_t)(s->buf + start) >= cut - start)
+			prop->value = "";
+		prop->klen = 0;
+		prop->vlen = 0;
+		prop->kid = KEY_ID_NONE;
+	}
+
+	return 0;
+}
+
+/* pipeline_fit returns the cap that slots are shrunk to, which is worked out
+ * again every shrink delay */
+static size_t pipeline_fit(pipeline_t* p)
+{
+	uint64_t now = uv_hrtime();
+	size_t hwm;
+
+	if (now - p->hwm_time < p->shrink_delay * 1000000)
+		return p->fit;
+
+	hwm = p->hwm > p->hwm_prev ? p->hwm : p->hwm_prev;
+	p->fit = p->init_cap;
+	while (p->fit < 2 * hwm)
+		p->fit *= 2;
+	p->hwm_prev = p->hwm;
+	p->hwm = 0;
+	p->hwm_time = now;
+
+	return p->fit;
+}
+
+/* pipeline_track records the length of a log to size slots after it */
+static void pipeline_track(pipeline_t* p, size_t len)
+{
+	if (len > p->hwm)
+		p->hwm = len;
+}
+
+/* slot_fit sizes s for the next len bytes: it grows like the slot before it
+ * did, but not beyond what the recent logs need */
+static int slot_fit(pipeline_t* p, pipeline_slot_t* s, size_t cap, size_t len)
+{
+	size_t fit = pipeline_fit(p);
+	size_t want = cap < fit ? cap : fit;
+	char* buf;
+
+	if (want < len)
+		want = len;
+
+	if (s->cap < want)
+		return grow((void**)&s->buf, &s->cap, want, 1);
+	if (s->cap == want || s->cap <= fit)
+		return 0;
+
+	if ((buf = realloc(s->buf, want)) == NULL) {
+		errno = ENOMEM;
+		return 1;
+	}
+	s->buf = buf;
+	s->cap = want;
+
+	return 0;
+}
+
+/* slot_acquire waits for slot i to be handed back by the loop, or returns
+ * NULL if the pipeline is being stopped */
+static pipeline_slot_t* slot_acquire(pipeline_t* p, size_t i)
+{
+	pipeline_slot_t* s;
+
+	uv_sem_wait(&p->free);
+	if (STOPPED(p))
+		return NULL;
+
+	s = SLOT_AT(p, i);
+	s->len = 0;
+	s->props_len = 0;
+	s->reads = 0;
+	s->bytes = 0;
+	s->eof = 0;
+	s->error = 0;
+
+	return s;
+}
+
+/* slot_publish hands slot i to the loop */
+static void slot_publish(pipeline_t* p, size_t i)
+{
+	__atomic_store_n(&p->tail, i + 1, __ATOMIC_RELEASE);
+	uv_async_send(&p->async);
+}
+
+/* pipeline_rebase lets the scanner resume on the len bytes at from that were
+ * moved to to, and returns where scanning resumes from relative to to */
+static size_t pipeline_rebase(
+  pipeline_t* p, const char* from, size_t len, char* to, size_t scanned)
+{
+	if (p->rebase != NULL) {
+		p->rebase(p->scanner, from, len, to - from);
+		return scanned;
+	}
+
+	p->reset(p->scanner);
+	return 0;
+}
+
+/* pipeline_read reads fd, waiting for it to be readable. It fails with
+ * ECANCELED once the pipeline is being stopped */
+static ssize_t pipeline_read(pipeline_t* p, char* buf, size_t len)
+{
+	struct pollfd pfds[2] = {{.fd = p->fd, .events = POLLIN},
+	  {.fd = p->wake[0], .events = POLLIN}};
+	ssize_t n;
+
+	for (;;) {
+		if (STOPPED(p)) {
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if ((n = read(p->fd, buf, len)) >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+
+		if (poll(pfds, 2, -1) == -1 && errno != EINTR)
+			return -1;
+	}
+}
+
+/*
+ * pipeline_run is the body of the reader thread. Bytes of the slot being
+ * filled are laid out as:
+ *
+ *   [0, start) logs that were scanned
+ *   [start, next) the beginning of the log being scanned
+ *   [next, end) bytes that are yet to be scanned
+ *
+ * A slot is published after every read that completed any log, and what is
+ * left from start on is moved to the next slot first. Only a partial log can
+ * fill a slot up then: it grows up to max_cap and is cut short past that. The
+ * next slot is sized after it, or shrunk back once long logs are gone.
+ */
+static void pipeline_run(void* arg)
+{
+	pipeline_t* p = arg;
+	pipeline_slot_t *s, *t;
+	size_t tail = p->tail, start = 0, next = 0, end = 0, want;
+	log_t* partial = NULL;
+	scan_res_t res;
+	int skip = 0;
+	ssize_t n;
+	char *nl, *old;
+
+	if ((s = slot_acquire(p, tail)) == NULL)
+		return;
+
+	for (;;) {
+		if (s->len > 0) {
+			/* move the rest to the next slot before handing this one over */
+			if ((t = slot_acquire(p, tail + 1)) == NULL)
+				return;
+			if (slot_fit(p, t, s->cap, end - start) != 0) {
+				s->error = errno;
+				break;
+			}
+			memcpy(t->buf, s->buf + start, end - start);
+			if (skip)
+				next = 0;
+			else
+				next = pipeline_rebase(
+				  p, s->buf + start, end - start, t->buf, next - start);
+			end -= start;
+			start = 0;
+			slot_publish(p, tail++);
+			s = t;
+		}
+
+		if (end == s->cap && start > 0) {
+			/* a log found past skipped data gets the whole slot */
+			memmove(s->buf, s->buf + start, end - start);
+			next = pipeline_rebase(
+			  p, s->buf + start, end - start, s->buf, next - start);
+			end -= start;
+			start = 0;
+		}
+
+		if (end == s->cap && s->cap < p->max_cap) {
+			old = s->buf;
+			want = s->cap * 2 < p->max_cap ? s->cap * 2 : p->max_cap;
+			if (grow((void**)&s->buf, &s->cap, want, 1) != 0) {
+				s->error = errno;
+				break;
+			}
+			next = pipeline_rebase(p, old, end, s->buf, next);
+		} else if (end == s->cap) {
+			DEBUG_LOG("log is too long (more than %zu bytes). skipping data...",
+			  p->max_cap);
+			pipeline_track(p, end - start);
+			if (slot_add_oversize(p, s, partial, start, end) != 0) {
+				s->error = errno;
+				break;
+			}
+			p->reset(p->scanner);
+			partial = NULL;
+			skip = 1;
+			start = next = end;
+			continue;
+		}
+
+		if ((n = pipeline_read(p, s->buf + end, s->cap - end)) <= 0) {
+			if (n == -1 && errno == ECANCELED)
+				return;
+			s->eof = n == 0;
+			s->error = n == 0 ? 0 : errno;
+			break;
+		}
+
+		s->reads++;
+		s->bytes += n;
+		end += n;
+
+		if (skip) {
+			if ((nl = memchr(s->buf + next, '\n', end - next)) == NULL) {
+				start = next = end = 0;
+				continue;
+			}
+			start = next = nl + 1 - s->buf;
+			skip = 0;
+		}
+
+		while (next < end) {
+			res = p->scan(p->scanner, s->buf + next, end - next);
+			next += res.consumed;
+			if (res.type == SCAN_PARTIAL) {
+				partial = res.log;
+				break;
+			}
+
+			if (slot_add(s,
+				  res.type == SCAN_COMPLETE ? PIPELINE_LOG : PIPELINE_ERROR,
+				  &res, res.log) != 0) {
+				s->error = errno;
+				goto publish;
+			}
+			pipeline_track(p, next - start);
+			p->reset(p->scanner);
+			partial = NULL;
+			start = next;
+		}
+	}
+
+publish:
+	slot_publish(p, tail);
+}
+
+static void on_pipeline_async(uv_async_t* handle)
+{
+	pipeline_drain(PIPELINE_OF(handle, async));
+}
+
+/* pipe2 is not portable, so the wake pipe gets its flags one by one */
+static int set_flags(int fd)
+{
+	int flags;
+
+	if ((flags = fcntl(fd, F_GETFL)) == -1 ||
+	  fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+	  fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		return 1;
+
+	return 0;
+}
+
+int pipeline_init(pipeline_t* p, uv_loop_t* loop, size_t cap, size_t max_cap)
+{
+	size_t i;
+	int ret;
+
+	memset(p, 0, sizeof(pipeline_t));
+	p->max_cap = max_cap;
+	p->truncate = max_cap;
+	p->init_cap = cap;
+	p->wake[0] = p->wake[1] = -1;
+
+	for (i = 0; i < PIPELINE_SLOTS; i++) {
+		if ((p->slots[i].buf = malloc(cap)) == NULL) {
+			errno = ENOMEM;
+			return 1;
+		}
+		p->slots[i].cap = cap;
+	}
+
+	if (pipe(p->wake) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	if (set_flags(p->wake[0]) != 0 || set_flags(p->wake[1]) != 0) {
+		perror("fcntl");
+		return 1;
+	}
+
+	if ((ret = uv_async_init(loop, &p->async, on_pipeline_async)) < 0) {
+		errno = -ret;
+		perror("uv_async_init");
+		return 1;
+	}
+	/* the async handle only keeps the loop alive while the reader runs */
+	uv_unref((uv_handle_t*)&p->async);
+
+	return 0;
+}
+
+int pipeline_start(pipeline_t* p, int fd, void* scanner)
+{
+	int ret, flags;
+
+	if (p->running)
+		return 0;
+
+	/* reads wait in poll so that pipeline_stop can interrupt them */
+	if ((flags = fcntl(fd, F_GETFL)) == -1 ||
+	  fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		perror("fcntl");
+		return 1;
+	}
+
+	p->fd = fd;
+	p->scanner = scanner;
+	p->head = p->tail = 0;
+	p->stop = 0;
+	p->reset(p->scanner);
+	p->fit = SIZE_MAX;
+	p->hwm = p->hwm_prev = 0;
+	p->hwm_time = uv_hrtime();
+
+	if ((ret = uv_sem_init(&p->free, PIPELINE_SLOTS)) < 0) {
+		errno = -ret;
+		perror("uv_sem_init");
+		return 1;
+	}
+
+	if ((ret = uv_thread_create(&p->thread, pipeline_run, p)) < 0) {
+		errno = -ret;
+		perror("uv_thread_create");
+		uv_sem_destroy(&p->free);
+		return 1;
+	}
+
+	p->running = 1;
+	uv_ref((uv_handle_t*)&p->async);
+
+	return 0;
+}
+
+/* pipeline_join waits for the reader to return, interrupting it */
+static void pipeline_join(pipeline_t* p)
+{
+	char drain[16];
+
+	__atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+	while (write(p->wake[1], "", 1) == -1 && errno == EINTR)
+		;
+	uv_sem_post(&p->free);
+	uv_thread_join(&p->thread);
+
+	while (read(p->wake[0], drain, sizeof(drain)) > 0)
+		;
+	uv_sem_destroy(&p->free);
+	p->running = 0;
+}
+
+void pipeline_stop(pipeline_t* p)
+{
+	if (!p->running)
+		return;
+
+	pipeline_join(p);
+	uv_unref((uv_handle_t*)&p->async);
+	p->reset(p->scanner);
+}
+
+void pipeline_drain(pipeline_t* p)
+{
+	size_t tail = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+
+	while (p->running && p->head != tail) {
+		p->cb(p, SLOT_AT(p, p->head));
+		/* cb may have stopped the pipeline */
+		if (!p->running)
+			return;
+		p->head++;
+		uv_sem_post(&p->free);
+	}
+}
+
+void pipeline_free(pipeline_t* p)
+{
+	size_t i;
+
+	/* the loop may be gone already, so the async handle is left alone */
+	if (p->running)
+		pipeline_join(p);
+
+	for (i = 0; i < PIPELINE_SLOTS; i++) {
+		free(p->slots[i].buf);
+		free(p->slots[i].res);
+		free(p->slots[i].logs);
+		free(p->slots[i].props);
+	}
+
+	if (p->wake[0] != -1) {
+		close(p->wake[0]);
+		close(p->wake[1]);
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef LOGD_PIPELINE_H
+#define LOGD_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "log.h"
+#include "scanner.h"
+
+/* slots a reader can fill ahead of the loop before it waits for one to be
+ * handled, a power of two */
+#define PIPELINE_SLOTS 8
+
+enum pipeline_res_e {
+	/* a complete log */
+	PIPELINE_LOG,
+	/* the scanner failed with error at at, log is what it scanned */
+	PIPELINE_ERROR,
+	/* log is the beginning of a log that did not fit in max_cap bytes: it
+	 * was cut short there and the rest of its line was read past */
+	PIPELINE_OVERSIZE,
+};
+
+typedef struct pipeline_res_s {
+	enum pipeline_res_e type;
+	const char* error;
+	const char* at;
+} pipeline_res_t;
+
+/* results of one read, in input order, together with the bytes their logs
+ * point into */
+typedef struct pipeline_slot_s {
+	char* buf;
+	size_t cap;
+	/* res[i] is the result of logs[i], whose props are in props */
+	pipeline_res_t* res;
+	log_t* logs;
+	size_t len;
+	size_t res_cap;
+	prop_t* props;
+	size_t props_len;
+	size_t props_cap;
+	/* reads that filled the slot and the bytes they read */
+	uint64_t reads;
+	uint64_t bytes;
+	/* the input ended after the results, or reading it failed with errno
+	 * error */
+	int eof;
+	int error;
+} pipeline_slot_t;
+
+/* a thread that reads a non regular input and scans it while the loop thread
+ * handles the logs it scanned before. Filled slots go through a single
+ * producer single consumer ring to the loop, which is woken up by an async
+ * handle and hands slots back once they are handled */
+typedef struct pipeline_s {
+	int fd;
+	void* scanner;
+	/* scanner functions, rebase is optional */
+	scan_res_t (*scan)(void*, char*, size_t);
+	void (*reset)(void*);
+	void (*rebase)(void*, const char*, size_t, ptrdiff_t);
+	/* max bytes of a log, and bytes longer logs are cut short to, which is
+	 * max_cap unless clients set it lower */
+	size_t max_cap;
+	size_t truncate;
+	/* milliseconds after which slots shrink back to twice the largest log of
+	 * the last two delays, like input buffers do. A slot is only shrunk when
+	 * the reader takes it to fill it, so slots of a quiet input stay as they
+	 * are until it is read again */
+	uint64_t shrink_delay;
+	pipeline_slot_t slots[PIPELINE_SLOTS];
+	/* the reader publishes slots at tail and the loop handles them from
+	 * head. Both only grow and are taken modulo PIPELINE_SLOTS */
+	size_t head;
+	size_t tail;
+	/* slots the reader may fill */
+	uv_sem_t free;
+	uv_async_t async;
+	uv_thread_t thread;
+	/* pipe that interrupts the reader when it waits for input */
+	int wake[2];
+	/* used by the reader only: cap that slots shrink to and the largest logs
+	 * since hwm_time and in the delay before it */
+	size_t init_cap;
+	size_t fit;
+	size_t hwm;
+	size_t hwm_prev;
+	uint64_t hwm_time;
+	int stop;
+	int running;
+	/* called on the loop thread for every filled slot, in order. The slot
+	 * and its logs are reused once cb returns */
+	void (*cb)(struct pipeline_s* p, pipeline_slot_t* slot);
+	/* free for clients to use */
+	void* data;
+} pipeline_t;
+
+/* pipeline_init gets p ready for slots of cap bytes that grow up to max_cap
+ * bytes for long logs. Clients set the scanner functions and cb before
+ * calling pipeline_start */
+int pipeline_init(pipeline_t* p, uv_loop_t* loop, size_t cap, size_t max_cap);
+/* pipeline_start starts a thread that reads fd until end of file or an error,
+ * scanning it with scanner. Neither is to be used by anyone else until
+ * pipeline_stop returns */
+int pipeline_start(pipeline_t* p, int fd, void* scanner);
+/* pipeline_stop stops the thread and drops the slots that were not handled.
+ * It can be called from cb */
+void pipeline_stop(pipeline_t* p);
+/* pipeline_drain calls cb for the slots that are filled */
+void pipeline_drain(pipeline_t* p);
+void pipeline_free(pipeline_t* p);
+
+#endif
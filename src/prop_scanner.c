@@ -1,5 +1,6 @@
 #include "log.h"
 #include "scanner.h"
+#include "simd.h"
 #include "stdio.h"
 #include "string.h"
 #include "util.h"
@@ -38,6 +39,8 @@ typedef enum jstate_s {
 typedef struct prop_scanner_s {
 	jstate_t state;
 	log_t result;
+	log_index_t index;
+	log_body_t body;
 	prop_t* pslab;
 	int pnext, tnext;
 	char token;
@@ -59,6 +62,18 @@ void scanner_reset(void* _p)
 	LOGD_SCANNER_RESET(p);
 }
 
+void scanner_rebase(void* _p, const char* start, size_t len, ptrdiff_t delta)
+{
+	prop_scanner_t* p = (prop_scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+
+	LOGD_SCANNER_REBASE(p, start, len, delta);
+}
+
+/* logs are always scanned whole: there is no header to scan ahead */
+void scanner_set_lazy(void* _p, bool lazy) { DEBUG_ASSERT(_p != NULL); }
+
 void scanner_init(void* _p, prop_t* pslab)
 {
 	prop_scanner_t* p = (prop_scanner_t*)_p;
@@ -158,7 +173,7 @@ error:
 		return (p)->res;                                                       \
 	case ':':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_KEY(p);                                                         \
 		(p)->state = VAL_TRANS_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -178,7 +193,7 @@ error:
 		break;                                                                 \
 	case '"':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_KEY(p);                                                         \
 		(p)->state = VAL_SPLIT_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -247,12 +262,12 @@ error:
 	switch ((p)->token) {                                                      \
 	case '\n':                                                                 \
 	case '}':                                                                  \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		SCAN_END(p);                                                          \
 		return (p)->res;                                                       \
 	case ',':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		(p)->state = KEY_TRANS_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -272,7 +287,7 @@ error:
 		return (p)->res;                                                       \
 	case '"':                                                                  \
 	case '\x00': /* re-submitted data */                                       \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		(p)->state = KEY_TRANS_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -314,7 +329,7 @@ error:
 #define SCANNER_SCAN_VAL_NODE_COMMIT(p)                                        \
 	switch ((p)->token) {                                                      \
 	case '}':                                                                  \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		SCAN_END(p);                                                          \
 		return (p)->res;                                                       \
 	case '\n':                                                                 \
@@ -325,7 +340,7 @@ error:
 	case ' ':                                                                  \
 	case ',':                                                                  \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		(p)->state = KEY_TRANS_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -356,7 +371,7 @@ error:
 		}                                                                      \
 		break;                                                                 \
 	case '\x00':                                                               \
-		COMMIT(p);                                                             \
+		COMMIT_VALUE(p);                                                       \
 		(p)->state = KEY_TRANS_JSTATE;                                         \
 		break;                                                                 \
 	default:                                                                   \
@@ -364,9 +379,36 @@ error:
 		break;                                                                 \
 	}
 
+/* skips the bytes of strings and unquoted keys and values that would only be
+ * counted. Unquoted keys do not end on '"' but stopping there is harmless */
+#define SCANNER_SKIP(p, chunk, clen, set)                                      \
+	skip = simd_find4(                                                         \
+	  (chunk) + (p)->res.consumed, (clen) - (p)->res.consumed, set);           \
+	(p)->blen += skip;                                                         \
+	(p)->res.consumed += skip;
+
+/* skips nested objects and arrays, which are never looked into, with their
+ * strings and escapes. Their scanning state is carried in p->state */
+#define SCANNER_SKIP_NODE(p, chunk, clen, in, out, node, in_str, in_esc)       \
+	j.nest = (p)->nest;                                                        \
+	j.str = (p)->state != (node);                                              \
+	j.esc = (p)->state == (in_esc);                                            \
+	skip = simd_json_skip((chunk) + (p)->res.consumed,                         \
+	  (clen) - (p)->res.consumed, in, out, &j);                                \
+	(p)->nest = j.nest;                                                        \
+	(p)->state = j.esc ? (in_esc) : j.str ? (in_str) : (node);                 \
+	(p)->blen += skip;                                                         \
+	(p)->res.consumed += skip;
+
+static const char str_delims[4] = {'\n', '\\', '"', '\x00'};
+static const char key_delims[4] = {'\n', ':', '"', '\x00'};
+static const char val_delims[4] = {'\n', '}', ',', '\x00'};
+
 scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 {
 	prop_scanner_t* p = (prop_scanner_t*)_p;
+	simd_json_t j;
+	size_t skip;
 
 	DEBUG_ASSERT(p != NULL);
 	DEBUG_ASSERT(chunk != NULL);
@@ -376,6 +418,35 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 	p->res.consumed = 0;
 
 	while (p->res.consumed < clen) {
+		switch (p->state) {
+		case KEY_STR_JSTATE:
+		case VAL_STR_JSTATE:
+			SCANNER_SKIP(p, chunk, clen, str_delims);
+			break;
+		case KEY_OTHER_JSTATE:
+			SCANNER_SKIP(p, chunk, clen, key_delims);
+			break;
+		case VAL_OTHER_JSTATE:
+			SCANNER_SKIP(p, chunk, clen, val_delims);
+			break;
+		case VAL_OBJ_JSTATE:
+		case VAL_OBJ_ESCAPE_JSTATE:
+		case VAL_OBJ_STR_ESCAPE_JSTATE:
+			SCANNER_SKIP_NODE(p, chunk, clen, '{', '}', VAL_OBJ_JSTATE,
+			  VAL_OBJ_ESCAPE_JSTATE, VAL_OBJ_STR_ESCAPE_JSTATE);
+			break;
+		case VAL_ARR_JSTATE:
+		case VAL_ARR_ESCAPE_JSTATE:
+		case VAL_ARR_STR_ESCAPE_JSTATE:
+			SCANNER_SKIP_NODE(p, chunk, clen, '[', ']', VAL_ARR_JSTATE,
+			  VAL_ARR_ESCAPE_JSTATE, VAL_ARR_STR_ESCAPE_JSTATE);
+			break;
+		default:
+			break;
+		}
+		if (p->res.consumed == clen)
+			break;
+
 		p->token = chunk[p->res.consumed++];
 		// printf("%c: %d -> ", p->token, p->state);
 		switch (p->state) {
@@ -442,3 +513,14 @@ scan_res_t scanner_scan(void* _p, char* chunk, size_t clen)
 
 	return p->res;
 }
+
+size_t scanner_scan_batch(
+  void* _p, char* chunk, size_t clen, scan_batch_t* batch)
+{
+	prop_scanner_t* p = (prop_scanner_t*)_p;
+
+	DEBUG_ASSERT(p != NULL);
+	DEBUG_ASSERT(batch != NULL);
+
+	LOGD_SCANNER_SCAN_BATCH(p, scanner_scan, scanner_reset, chunk, clen, batch);
+}
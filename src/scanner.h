@@ -2,7 +2,11 @@
 #define LOGD_SCANNER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "config.h"
+#include "keys.h"
 #include "log.h"
 
 /* scan result data structures */
@@ -22,6 +26,21 @@ typedef struct scan_res_s {
 	log_t* log;
 } scan_res_t;
 
+/* max number of results of scanner_scan_batch */
+#ifndef LOGD_SCAN_BATCH_CAP
+#define LOGD_SCAN_BATCH_CAP 64
+#endif
+
+typedef struct scan_batch_s {
+	/* results in scan order */
+	scan_res_t res[LOGD_SCAN_BATCH_CAP];
+	/* complete logs and their properties */
+	log_t logs[LOGD_SCAN_BATCH_CAP];
+	prop_t pslabs[LOGD_SCAN_BATCH_CAP][LOGD_SLAB_CAP];
+	log_index_t indexes[LOGD_SCAN_BATCH_CAP];
+	log_body_t bodies[LOGD_SCAN_BATCH_CAP];
+} scan_batch_t;
+
 /* optional base fields for scanner.h implementations.
  * This fields enable the use of the following macros */
 #define LOGD_SCANNER_FIELDS                                                    \
@@ -38,7 +57,11 @@ typedef struct scan_res_s {
 	/* offset from chunk address for current iteration */                      \
 	int blen;                                                                  \
 	/* return value of scanner_scan  */                                        \
-	scan_res_t res;
+	scan_res_t res;                                                            \
+	/* index of result */                                                      \
+	log_index_t index;                                                         \
+	/* body of result if its scanning was deferred */                          \
+	log_body_t body;
 
 #define LOGD_SCANNER_INIT(p, pslab)                                            \
 	p->pslab = pslab;                                                          \
@@ -49,6 +72,7 @@ typedef struct scan_res_s {
 	p->pnext = 0;                                                              \
 	memset(p->pslab, 0, LOGD_SLAB_CAP);                                        \
 	log_init(&p->result);                                                      \
+	log_set_index(&p->result, &p->index);                                      \
 	p->res.type = SCAN_PARTIAL;
 
 #define SCANNER_SET_ERROR(p, m, error_state)                                    \
@@ -70,9 +94,20 @@ typedef struct scan_res_s {
 	}                                                                          \
 	ADD_PROP(p);
 
-#define SET_VALUE(p, chunk) (p)->result.props->value = chunk;
+#define SET_VALUE(p, chunk)                                                    \
+	(p)->result.props->value = chunk;                                          \
+	(p)->result.props->vlen = 0;
 
-#define SET_KEY(p, chunk) (p)->result.props->key = chunk;
+#define SET_KEY(p, chunk)                                                      \
+	(p)->result.props->key = chunk;                                            \
+	(p)->result.props->klen = 0;                                               \
+	(p)->result.props->kid = KEY_ID_NONE;
+
+/* sets a key whose id from keys.h is known, like the keys of log.h */
+#define SET_KEY_ID(p, name, id)                                                \
+	(p)->result.props->key = name;                                             \
+	(p)->result.props->klen = 0;                                               \
+	(p)->result.props->kid = id;
 
 #define NOOP(p, chunk) ;
 
@@ -81,6 +116,19 @@ typedef struct scan_res_s {
 	(p)->chunk += (p)->blen + 1;                                               \
 	(p)->blen = 0;
 
+/* COMMIT_KEY and COMMIT_VALUE end the key or the value of the current
+ * property, which may have started in a previous chunk, and record its length
+ * so that it does not have to be counted again */
+#define COMMIT_KEY(p)                                                          \
+	(p)->result.props->klen =                                                  \
+	  (p)->chunk + (p)->blen - (p)->result.props->key;                         \
+	COMMIT(p);
+
+#define COMMIT_VALUE(p)                                                        \
+	(p)->result.props->vlen =                                                  \
+	  (p)->chunk + (p)->blen - (p)->result.props->value;                       \
+	COMMIT(p);
+
 #define SKIP(p) (p)->chunk++;
 
 #define REMOVE_PROP(p)                                                         \
@@ -103,6 +151,78 @@ typedef struct scan_res_s {
 		break;                                                                 \
 	}
 
+/* shifts ptr by delta if it points into the len bytes at start or right past
+ * them. Anything else, like static key names, is left untouched */
+#define REBASE_PTR(ptr, start, len, delta)                                     \
+	if ((uintptr_t)(ptr) - (uintptr_t)(start) <= (len))                        \
+		(ptr) += (delta);
+
+#define LOGD_SCANNER_REBASE(p, start, len, delta)                              \
+	{                                                                          \
+		prop_t* prop;                                                          \
+		for (prop = (p)->result.props; prop != NULL; prop = prop->next) {      \
+			REBASE_PTR(prop->key, start, len, delta);                          \
+			REBASE_PTR(prop->value, start, len, delta);                        \
+		}                                                                      \
+		REBASE_PTR((p)->chunk, start, len, delta);                             \
+		REBASE_PTR((p)->body.start, start, len, delta);                        \
+		REBASE_PTR((p)->res.error.at, start, len, delta);                      \
+	}
+
+/* moves the properties of the log being scanned to the slab at dst */
+#define LOGD_SCANNER_MOVE_PROPS(p, dst)                                        \
+	if ((p)->pslab != (dst)) {                                                 \
+		int i;                                                                 \
+		memcpy((dst), (p)->pslab, (p)->pnext * sizeof(prop_t));                \
+		for (i = 0; i < (p)->pnext; i++) {                                     \
+			if ((dst)[i].next != NULL)                                         \
+				(dst)[i].next = (dst) + ((dst)[i].next - (p)->pslab);          \
+		}                                                                      \
+		if ((p)->result.props != NULL)                                         \
+			(p)->result.props = (dst) + ((p)->result.props - (p)->pslab);      \
+		if ((p)->result.body != NULL) {                                        \
+			(p)->body.pslab = (dst);                                           \
+			(p)->body.at = (dst) + ((p)->body.at - (p)->pslab);                \
+		}                                                                      \
+		(p)->pslab = (dst);                                                    \
+		log_reindex(&(p)->result);                                             \
+	}
+
+/* scanner_scan_batch on top of scan_fn and reset_fn. Logs are scanned straight
+ * into the slabs of the batch, except for the first one which may have been
+ * started by an earlier call and for the last one if it is not complete: those
+ * are scanned in the slab of the scanner and moved */
+#define LOGD_SCANNER_SCAN_BATCH(p, scan_fn, reset_fn, chunk, clen, batch)      \
+	{                                                                          \
+		prop_t* own = (p)->pslab;                                              \
+		size_t n = 0;                                                          \
+		scan_res_t res;                                                        \
+                                                                               \
+		while (n < LOGD_SCAN_BATCH_CAP) {                                      \
+			res = scan_fn((p), (chunk), (clen));                               \
+			(chunk) += res.consumed;                                           \
+			(clen) -= res.consumed;                                            \
+			if (res.type != SCAN_COMPLETE) {                                   \
+				LOGD_SCANNER_MOVE_PROPS(p, own);                               \
+				(batch)->res[n++] = res;                                       \
+				break;                                                         \
+			}                                                                  \
+			LOGD_SCANNER_MOVE_PROPS(p, (batch)->pslabs[n]);                    \
+			(batch)->logs[n] = (p)->result;                                    \
+			log_set_index(&(batch)->logs[n], &(batch)->indexes[n]);            \
+			if ((p)->result.body != NULL) {                                    \
+				(batch)->bodies[n] = (p)->body;                                \
+				(batch)->logs[n].body = &(batch)->bodies[n];                   \
+			}                                                                  \
+			res.log = &(batch)->logs[n];                                       \
+			(batch)->res[n++] = res;                                           \
+			(p)->pslab = n < LOGD_SCAN_BATCH_CAP ? (batch)->pslabs[n] : own;   \
+			reset_fn(p);                                                       \
+		}                                                                      \
+                                                                               \
+		return n;                                                              \
+	}
+
 #define TRY_SET_NEW_KEY(p, chunk, error_state)                                 \
 	TRY_ADD_PROP(p, error_state);                                              \
 	SET_KEY(p, chunk);
@@ -143,4 +263,34 @@ scan_res_t scanner_scan(void* p, char* chunk, size_t clen);
 /* scanner_reset should be called after a returned log has been used */
 void scanner_reset(void* p);
 
+/* scanner_scan_batch scans up to LOGD_SCAN_BATCH_CAP logs from chunk at once
+ * and returns the number of results stored in batch. It stops after the first
+ * result that is not complete, which is the same that scanner_scan would have
+ * returned. The consumed bytes of a result are counted from the end of the
+ * previous one.
+ *
+ * Complete logs are stored in batch and stay valid until it is used again.
+ * The scanner is reset after each of them so that only errors have to be
+ * followed by a call to scanner_reset.
+ *
+ * It is optional for scanners loaded at runtime: without it logs are scanned
+ * one call at a time */
+size_t scanner_scan_batch(
+  void* p, char* chunk, size_t clen, scan_batch_t* batch);
+
+/* scanner_rebase should be called after the len bytes at start that were
+ * already scanned into a partial log are moved delta bytes, so that scanning
+ * can be resumed on the moved data instead of starting over.
+ *
+ * It is optional for scanners loaded at runtime: without it the partial log
+ * is scanned again from its beginning after scanner_reset */
+void scanner_rebase(void* p, const char* start, size_t len, ptrdiff_t delta);
+
+/* scanner_set_lazy lets the scanner return logs once their header is scanned
+ * and the end of their line is found, leaving the rest for log_scan_body.
+ *
+ * It is optional for scanners loaded at runtime: without it logs are always
+ * scanned whole */
+void scanner_set_lazy(void* p, bool lazy);
+
 #endif
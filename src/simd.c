@@ -0,0 +1,284 @@
+#include <stdint.h>
+
+#include "./simd.h"
+
+#ifdef LOGD_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define BLOCK 64
+
+/* bitmasks of a block of BLOCK bytes with bit i set for byte i */
+typedef struct block_s {
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t in;
+	uint64_t out;
+	uint64_t newline;
+	uint64_t nul;
+} block_t;
+
+static size_t find4_scalar(const char* s, size_t len, const char set[4])
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == set[0] || s[i] == set[1] || s[i] == set[2] ||
+		  s[i] == set[3])
+			break;
+	}
+
+	return i;
+}
+
+/* only the fallback of platforms without SIMD, x86 always has SSE2 */
+#ifndef LOGD_SIMD_X86
+static void classify_scalar(const char* s, char in, char out, block_t* b)
+{
+	uint64_t bit;
+	int i;
+
+	*b = (block_t){0};
+	for (i = 0; i < BLOCK; i++) {
+		bit = (uint64_t)1 << i;
+		if (s[i] == '"')
+			b->quote |= bit;
+		else if (s[i] == '\\')
+			b->backslash |= bit;
+		else if (s[i] == in)
+			b->in |= bit;
+		else if (s[i] == out)
+			b->out |= bit;
+		else if (s[i] == '\n')
+			b->newline |= bit;
+		else if (s[i] == '\x00')
+			b->nul |= bit;
+	}
+}
+#endif
+
+#ifdef LOGD_SIMD_X86
+static size_t find4_sse2(const char* s, size_t len, const char set[4])
+{
+	const __m128i c0 = _mm_set1_epi8(set[0]);
+	const __m128i c1 = _mm_set1_epi8(set[1]);
+	const __m128i c2 = _mm_set1_epi8(set[2]);
+	const __m128i c3 = _mm_set1_epi8(set[3]);
+	__m128i v, eq;
+	unsigned mask;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)(s + i));
+		eq = _mm_or_si128(
+		  _mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+		  _mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+		if ((mask = _mm_movemask_epi8(eq)) != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + find4_scalar(s + i, len - i, set);
+}
+
+#define SSE2_MASK(v, c)                                                        \
+	((uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)))
+
+static void classify_sse2(const char* s, char in, char out, block_t* b)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i cin = _mm_set1_epi8(in);
+	const __m128i cout = _mm_set1_epi8(out);
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	__m128i v;
+	int i;
+
+	*b = (block_t){0};
+	for (i = 0; i < BLOCK; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)(s + i));
+		b->quote |= SSE2_MASK(v, quote) << i;
+		b->backslash |= SSE2_MASK(v, backslash) << i;
+		b->in |= SSE2_MASK(v, cin) << i;
+		b->out |= SSE2_MASK(v, cout) << i;
+		b->newline |= SSE2_MASK(v, newline) << i;
+		b->nul |= SSE2_MASK(v, nul) << i;
+	}
+}
+
+__attribute__((target("avx2"))) static size_t find4_avx2(
+  const char* s, size_t len, const char set[4])
+{
+	const __m256i c0 = _mm256_set1_epi8(set[0]);
+	const __m256i c1 = _mm256_set1_epi8(set[1]);
+	const __m256i c2 = _mm256_set1_epi8(set[2]);
+	const __m256i c3 = _mm256_set1_epi8(set[3]);
+	__m256i v, eq;
+	unsigned mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i*)(s + i));
+		eq = _mm256_or_si256(
+		  _mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)),
+		  _mm256_or_si256(_mm256_cmpeq_epi8(v, c2), _mm256_cmpeq_epi8(v, c3)));
+		if ((mask = _mm256_movemask_epi8(eq)) != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + find4_sse2(s + i, len - i, set);
+}
+
+#define AVX2_MASK(v, c)                                                        \
+	((uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c)))
+
+__attribute__((target("avx2"))) static void classify_avx2(
+  const char* s, char in, char out, block_t* b)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i cin = _mm256_set1_epi8(in);
+	const __m256i cout = _mm256_set1_epi8(out);
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i nul = _mm256_setzero_si256();
+	__m256i v;
+	int i;
+
+	*b = (block_t){0};
+	for (i = 0; i < BLOCK; i += 32) {
+		v = _mm256_loadu_si256((const __m256i*)(s + i));
+		b->quote |= AVX2_MASK(v, quote) << i;
+		b->backslash |= AVX2_MASK(v, backslash) << i;
+		b->in |= AVX2_MASK(v, cin) << i;
+		b->out |= AVX2_MASK(v, cout) << i;
+		b->newline |= AVX2_MASK(v, newline) << i;
+		b->nul |= AVX2_MASK(v, nul) << i;
+	}
+}
+
+static size_t find4_resolve(const char* s, size_t len, const char set[4]);
+static void classify_resolve(const char* s, char in, char out, block_t* b);
+
+static size_t (*find4)(const char*, size_t, const char[4]) = &find4_resolve;
+static void (*classify)(const char*, char, char, block_t*) = &classify_resolve;
+
+/* picks the implementations for this CPU on first use */
+static void resolve()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		find4 = &find4_avx2;
+		classify = &classify_avx2;
+	} else {
+		find4 = &find4_sse2;
+		classify = &classify_sse2;
+	}
+}
+
+static size_t find4_resolve(const char* s, size_t len, const char set[4])
+{
+	resolve();
+
+	return find4(s, len, set);
+}
+
+static void classify_resolve(const char* s, char in, char out, block_t* b)
+{
+	resolve();
+
+	classify(s, in, out, b);
+}
+#else
+static size_t (*find4)(const char*, size_t, const char[4]) = &find4_scalar;
+static void (*classify)(const char*, char, char, block_t*) = &classify_scalar;
+#endif
+
+size_t simd_find4(const char* s, size_t len, const char set[4])
+{
+	return find4(s, len, set);
+}
+
+/* bytes escaped by a backslash: the ones that follow an odd number of
+ * backslashes. *carry is whether the first byte of the block is escaped and
+ * is set to whether the first byte of the next block is */
+static uint64_t find_escaped(uint64_t backslash, uint64_t* carry)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+	uint64_t follows, starts, even_starts;
+
+	backslash &= ~*carry;
+	follows = backslash << 1 | *carry;
+	starts = backslash & ~even & ~follows;
+	*carry = __builtin_add_overflow(starts, backslash, &even_starts);
+
+	return (even ^ (even_starts << 1)) & follows;
+}
+
+/* bit i is the parity of the bits up to and including i */
+static uint64_t prefix_xor(uint64_t m)
+{
+	m ^= m << 1;
+	m ^= m << 2;
+	m ^= m << 4;
+	m ^= m << 8;
+	m ^= m << 16;
+	m ^= m << 32;
+
+	return m;
+}
+
+size_t simd_json_skip(
+  const char* s, size_t len, char in, char out, simd_json_t* j)
+{
+	uint64_t esc, escaped, str, outside, stop, brackets, bit;
+	size_t i;
+	int nest, at;
+	block_t b;
+
+	for (i = 0; i + BLOCK <= len; i += BLOCK) {
+		classify(s + i, in, out, &b);
+
+		/* stage 1: the bytes whose preceding byte is within a string, which
+		 * is what decides how the byte is scanned */
+		esc = j->esc;
+		escaped = find_escaped(b.backslash, &esc);
+		str = prefix_xor(b.quote & ~escaped);
+		if (j->str)
+			str = ~str;
+		outside = ~(str << 1 | (uint64_t)j->str);
+
+		/* escapes are only recognized within strings */
+		if (b.backslash & outside)
+			return i;
+
+		/* stage 2: visit the structural bytes only */
+		nest = j->nest;
+		stop = b.newline | (b.nul & outside);
+		brackets = (b.in | b.out) & outside;
+		if (stop)
+			brackets &= (stop & -stop) - 1;
+		for (; brackets; brackets &= brackets - 1) {
+			bit = brackets & -brackets;
+			if (b.in & bit) {
+				nest++;
+			} else if (nest > 0) {
+				nest--;
+			} else {
+				stop = bit;
+				break;
+			}
+		}
+
+		j->nest = nest;
+		if (stop) {
+			at = __builtin_ctzll(stop);
+			j->str = !((outside >> at) & 1);
+			j->esc = (escaped >> at) & 1;
+			return i + at;
+		}
+		j->str = str >> 63;
+		j->esc = esc;
+	}
+
+	return i;
+}
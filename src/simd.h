@@ -0,0 +1,40 @@
+#ifndef LOGD_SIMD_H
+#define LOGD_SIMD_H
+
+#include <stddef.h>
+
+/* vectorized byte searches for the scanners: SSE2 on x86_64, AVX2 when the
+ * CPU supports it, and plain loops elsewhere */
+#if defined(__x86_64__) && defined(__SSE2__)
+#define LOGD_SIMD_X86
+#endif
+
+/* simd_find4 returns the offset of the first of the len bytes at s that is
+ * any of the 4 bytes in set, or len if there is none. Sets of less than 4
+ * bytes repeat one of them */
+size_t simd_find4(const char* s, size_t len, const char set[4]);
+
+/* position in a JSON object or array that is being skipped over */
+typedef struct simd_json_s {
+	/* brackets opened after the first one */
+	int nest;
+	/* the next byte is within a string */
+	int str;
+	/* the next byte is escaped by a backslash within a string */
+	int esc;
+} simd_json_t;
+
+/* simd_json_skip skips over the nested JSON at s whose brackets are in and
+ * out, 64 bytes at a time. It first classifies quotes, backslashes, brackets,
+ * newlines and NULs of a whole block into bitmasks, derives the bytes within
+ * strings from them, and then only visits the brackets outside of strings.
+ *
+ * It returns the offset of the first byte that needs to be looked at by the
+ * caller: the bracket that closes the nest level 0, a newline or a NUL outside
+ * of strings. j is updated to describe the position returned. It stops early
+ * on the last len % 64 bytes and on blocks with backslashes outside of strings
+ * since JSON does not have those */
+size_t simd_json_skip(
+  const char* s, size_t len, char in, char out, simd_json_t* j);
+
+#endif
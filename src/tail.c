@@ -5,17 +5,366 @@
 #include "./tail.h"
 #include "./util.h"
 
+#ifdef LOGD_TAIL_INOTIFY
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define TAIL_INOTIFY_MASK                                                      \
+	(IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB)
+/* watched on the parent directory of a moved file to learn when a new file
+ * takes its place */
+#define TAIL_INOTIFY_DIR_MASK (IN_CREATE | IN_MOVED_TO)
+
+tail_t* tail_create(uv_loop_t* loop, char* input_file)
+{
+	if (input_file == NULL || loop == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	tail_t* tail = calloc(1, sizeof(tail_t));
+	if (tail == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	tail->loop = loop;
+	tail->input_file = input_file;
+	tail->fd = -1;
+	tail->inotify_fd = -1;
+	tail->dir_wd = -1;
+
+	return tail;
+}
+
+static void tail_close_fds(tail_t* tail)
+{
+	DEBUG_LOG("closing tail fds, fd: %d, inotify_fd: %d", tail->fd,
+	  tail->inotify_fd);
+
+	if (tail->inotify_fd != -1) {
+		UNEINTR2(close(tail->inotify_fd));
+		tail->inotify_fd = -1;
+	}
+	if (tail->fd != -1) {
+		UNEINTR2(close(tail->fd));
+		tail->fd = -1;
+	}
+}
+
+static int tail_open_file(tail_t* tail, off_t offset)
+{
+	struct stat st;
+
+	do {
+		errno = 0;
+		tail->fd = open(tail->input_file, O_RDONLY | O_CLOEXEC);
+	} while (tail->fd == -1 && errno == EINTR);
+	if (tail->fd == -1) {
+		perror("open");
+		return 1;
+	}
+
+	if (fstat(tail->fd, &st) != 0) {
+		perror("fstat");
+		goto error;
+	}
+	/* behave like tail -n0 unless told otherwise */
+	if (offset == TAIL_OFFSET_END || offset > st.st_size)
+		tail->offset = st.st_size;
+	else
+		tail->offset = offset;
+	tail->moved = 0;
+	tail->gone = 0;
+
+	return 0;
+error:
+	UNEINTR2(close(tail->fd));
+	tail->fd = -1;
+	return 1;
+}
+
+static int tail_watch_file(tail_t* tail)
+{
+	char fdpath[32];
+
+	/* watch the inode we just opened rather than whatever input_file points
+	 * to by now */
+	snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", tail->fd);
+	if ((tail->wd = inotify_add_watch(
+		   tail->inotify_fd, fdpath, TAIL_INOTIFY_MASK)) == -1 &&
+	  (tail->wd = inotify_add_watch(
+		 tail->inotify_fd, tail->input_file, TAIL_INOTIFY_MASK)) == -1) {
+		perror("inotify_add_watch");
+		return 1;
+	}
+
+	return 0;
+}
+
+static int tail_open_fds(tail_t* tail, off_t offset)
+{
+	if (tail_open_file(tail, offset) != 0)
+		return 1;
+
+	if ((tail->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+		perror("inotify_init1");
+		goto error;
+	}
+	tail->dir_wd = -1;
+
+	if (tail_watch_file(tail) != 0)
+		goto error;
+
+	DEBUG_LOG("opened tail fds, fd: %d, inotify_fd: %d, offset: %ld", tail->fd,
+	  tail->inotify_fd, (long)tail->offset);
+
+	return 0;
+error:
+	tail_close_fds(tail);
+	return 1;
+}
+
+int tail_open_at(tail_t* tail, off_t offset, void (*exit_cb)(tail_t*, int))
+{
+	DEBUG_ASSERT(tail != NULL);
+
+	switch (tail->state) {
+	case OPEN_TSTATE:
+		tail_close_fds(tail);
+		/* fallthrough */
+	default:
+		tail->state = INIT_TSTATE;
+		break;
+	}
+
+	if (tail_open_fds(tail, offset) != 0) {
+		perror("tail_open_fds");
+		return -1;
+	}
+
+	tail->exit_cb = exit_cb;
+	tail->state = OPEN_TSTATE;
+
+	return tail->inotify_fd;
+}
+
+int tail_open(tail_t* tail, void (*exit_cb)(tail_t*, int))
+{
+	return tail_open_at(tail, TAIL_OFFSET_END, exit_cb);
+}
+
+static void tail_call_exit_cb(tail_t* tail, int status)
+{
+	if (tail->exit_cb) {
+		tail->exit_cb(tail, status);
+	}
+}
+
+/* tail_watch_dir watches the directory of input_file so that the client is
+ * woken up when a new file takes the place of the moved one */
+static void tail_watch_dir(tail_t* tail)
+{
+	char* path;
+
+	if (tail->dir_wd != -1)
+		return;
+
+	if ((path = strdup(tail->input_file)) == NULL) {
+		perror("strdup");
+		return;
+	}
+	if ((tail->dir_wd = inotify_add_watch(
+		   tail->inotify_fd, dirname(path), TAIL_INOTIFY_DIR_MASK)) == -1)
+		perror("inotify_add_watch");
+	free(path);
+}
+
+/* tail_replaced returns whether input_file names an inode other than st */
+static int tail_replaced(tail_t* tail, const struct stat* st)
+{
+	struct stat cur;
+
+	if (stat(tail->input_file, &cur) != 0)
+		return 0;
+
+	return cur.st_dev != st->st_dev || cur.st_ino != st->st_ino;
+}
+
+/* tail_follow_replaced follows the file that took the place of the moved one
+ * from its start, keeping the inotify instance clients poll */
+static int tail_follow_replaced(tail_t* tail)
+{
+	DEBUG_LOG("following file that replaced moved file: %s", tail->input_file);
+
+	inotify_rm_watch(tail->inotify_fd, tail->wd);
+	if (tail->dir_wd != -1) {
+		inotify_rm_watch(tail->inotify_fd, tail->dir_wd);
+		tail->dir_wd = -1;
+	}
+	UNEINTR2(close(tail->fd));
+	tail->fd = -1;
+	tail->wd = -1;
+
+	if (tail_open_file(tail, 0) != 0)
+		return 1;
+
+	return tail_watch_file(tail);
+}
+
+/* drain pending inotify events so a level-triggered poll on inotify_fd only
+ * fires again once the file changes after this call */
+static int tail_drain_events(tail_t* tail)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event* ev;
+	ssize_t len;
+	char* ptr;
+
+	for (;;) {
+		len = read(tail->inotify_fd, buf, sizeof(buf));
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return 0;
+			return 1;
+		}
+
+		for (ptr = buf; ptr < buf + len;
+			 ptr += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event*)ptr;
+			/* directory events only wake the client up, as do events of
+			 * the watch on a file that was followed before */
+			if (ev->wd != tail->wd)
+				continue;
+			if (ev->mask & IN_MOVE_SELF) {
+				DEBUG_LOG("followed file was moved: %s", tail->input_file);
+				tail->moved = 1;
+				tail_watch_dir(tail);
+			}
+			if (ev->mask & (IN_DELETE_SELF | IN_IGNORED | IN_UNMOUNT)) {
+				DEBUG_LOG("followed file is gone: %s", tail->input_file);
+				tail->gone = 1;
+			}
+		}
+	}
+}
+
+ssize_t tail_read(tail_t* tail, char* buf, size_t len)
+{
+	struct stat st;
+	ssize_t ret;
+	int truncated = 0;
+
+	if (tail->state != OPEN_TSTATE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	/* drain before reading so that writes racing with this read always leave
+	 * a pending event behind */
+	if (tail_drain_events(tail) != 0) {
+		perror("inotify read");
+		tail_call_exit_cb(tail, 1);
+		return -1;
+	}
+
+read:
+	do {
+		ret = pread(tail->fd, buf, len, tail->offset);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		tail->offset += ret;
+		return ret;
+	}
+
+	if (ret < 0)
+		return -1;
+
+	/* caught up with the end of the file */
+	if (fstat(tail->fd, &st) != 0)
+		return -1;
+
+	if (st.st_size < tail->offset && !truncated) {
+		DEBUG_LOG("followed file was truncated: %s", tail->input_file);
+		tail->offset = 0;
+		truncated = 1;
+		goto read;
+	}
+
+	if (tail->gone || st.st_nlink == 0)
+		return 0;
+
+	/* a moved file is read up to its end before following the file that
+	 * replaced it, if any, as writers may append to it until they reopen */
+	if (tail->moved && tail_replaced(tail, &st)) {
+		if (tail_follow_replaced(tail) != 0)
+			return 0;
+		truncated = 0;
+		goto read;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+off_t tail_tell(tail_t* tail)
+{
+	if (tail->state != OPEN_TSTATE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	return tail->offset;
+}
+
+void tail_close(tail_t* tail)
+{
+	switch (tail->state) {
+	case OPEN_TSTATE:
+		break;
+	default:
+		return;
+	}
+
+	tail_close_fds(tail);
+	tail->state = INIT_TSTATE;
+}
+
+void tail_free(tail_t* tail)
+{
+	if (tail == NULL)
+		return;
+
+	tail_close(tail);
+	free(tail);
+}
+
+#else
 static void tail_kill_tail(tail_t* tail);
 static void tail_close_pipes(tail_t* tail);
 static void tail_spawn(uv_timer_t*);
 
-static void set_inmediate(uv_loop_t* loop, void* data, uv_timer_cb cb)
+static void set_inmediate(tail_t* tail, uv_timer_cb cb)
 {
-	static uv_timer_t timer;
-	uv_timer_init(loop, &timer);
+	uv_timer_start(&tail->spawn_timer, cb, 0, 0);
+}
+
+static void on_spawn_timer_close(uv_handle_t* handle) { free(handle->data); }
+
+/* tail_release frees tail once the loop lets go of spawn_timer, right away
+ * if the loop closed it already */
+static void tail_release(tail_t* tail)
+{
+	if (uv_is_closing((uv_handle_t*)&tail->spawn_timer)) {
+		free(tail);
+		return;
+	}
 
-	timer.data = data;
-	uv_timer_start(&timer, cb, 0, 0);
+	uv_close((uv_handle_t*)&tail->spawn_timer, on_spawn_timer_close);
 }
 
 static void on_tail_stderr(uv_poll_t* req, int status, int events)
@@ -50,7 +399,7 @@ static void on_tail_stderr(uv_poll_t* req, int status, int events)
 static void tail_call_exit_cb(tail_t* tail, int status)
 {
 	if (tail->exit_cb) {
-		tail->exit_cb(status);
+		tail->exit_cb(tail, status);
 	}
 }
 
@@ -67,10 +416,10 @@ static void on_tail_exit(
 
 	switch (tail->state) {
 	case CLOSING_FREEING_TSTATE:
-		free(tail);
+		tail_release(tail);
 		return;
 	case CLOSING_OPENING_TSTATE:
-		set_inmediate(tail->loop, tail, tail_spawn);
+		set_inmediate(tail, tail_spawn);
 		break;
 	case OPEN_TSTATE:
 		tail_close_pipes(tail);
@@ -99,11 +448,15 @@ tail_t* tail_create(uv_loop_t* loop, char* input_file)
 	}
 	tail->loop = loop;
 
+	uv_timer_init(loop, &tail->spawn_timer);
+	tail->spawn_timer.data = tail;
+
 	tail->proc_args[0] = "tail";
-	tail->proc_args[1] = "-n0";
-	tail->proc_args[2] = "-f";
-	tail->proc_args[3] = input_file;
-	tail->proc_args[4] = NULL;
+	tail->proc_args[1] = "-n";
+	tail->proc_args[2] = "0";
+	tail->proc_args[3] = "-f";
+	tail->proc_args[4] = input_file;
+	tail->proc_args[5] = NULL;
 
 	tail->proc_options.exit_cb = on_tail_exit;
 	tail->proc_options.file = "tail";
@@ -181,8 +534,25 @@ static void tail_spawn(uv_timer_t* timer)
 	DEBUG_LOG("executed new tail subprocess, pid: %d", tail->proc.pid);
 }
 
-int tail_open(tail_t* tail, void (*exit_cb)(int))
+static void tail_set_offset(tail_t* tail, off_t offset)
 {
+	if (offset == TAIL_OFFSET_END) {
+		tail->proc_args[1] = "-n";
+		tail->proc_args[2] = "0";
+		return;
+	}
+
+	/* tail -c +K outputs starting with the Kth byte */
+	snprintf(tail->proc_offset_arg, sizeof(tail->proc_offset_arg), "+%lld",
+	  (long long)offset + 1);
+	tail->proc_args[1] = "-c";
+	tail->proc_args[2] = tail->proc_offset_arg;
+}
+
+int tail_open_at(tail_t* tail, off_t offset, void (*exit_cb)(tail_t*, int))
+{
+	tail_set_offset(tail, offset);
+
 	switch (tail->state) {
 	case OPEN_TSTATE:
 		tail_kill_tail(tail);
@@ -213,11 +583,16 @@ int tail_open(tail_t* tail, void (*exit_cb)(int))
 
 	// we need to spawn asynchronously because libuv calls uv__finish_close even
 	// after calling proc exit callback so we run into some assertion failures
-	set_inmediate(tail->loop, tail, tail_spawn);
+	set_inmediate(tail, tail_spawn);
 
 	return tail->read_data_fd;
 }
 
+int tail_open(tail_t* tail, void (*exit_cb)(tail_t*, int))
+{
+	return tail_open_at(tail, TAIL_OFFSET_END, exit_cb);
+}
+
 static void tail_close_pipes(tail_t* tail)
 {
 	DEBUG_LOG("closing pipes, write_tail_stderr_fd: %d, read_tail_stderr_fd: "
@@ -262,6 +637,18 @@ void tail_close(tail_t* tail)
 	tail_kill_tail(tail);
 }
 
+ssize_t tail_read(tail_t* tail, char* buf, size_t len)
+{
+	return read(tail->read_data_fd, buf, len);
+}
+
+/* the subprocess does not tell how much it skipped with -n0 */
+off_t tail_tell(tail_t* tail)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
 void tail_free(tail_t* tail)
 {
 	if (tail == NULL)
@@ -269,7 +656,7 @@ void tail_free(tail_t* tail)
 
 	switch (tail->state) {
 	case INIT_TSTATE:
-		free(tail);
+		tail_release(tail);
 		return;
 	case OPEN_TSTATE:
 		tail_kill_tail(tail);
@@ -284,4 +671,10 @@ void tail_free(tail_t* tail)
 	}
 
 	tail->state = CLOSING_FREEING_TSTATE;
+
+	/* on_tail_exit does not come once the loop closed proc on exit */
+	if (uv_is_closing((uv_handle_t*)&tail->proc))
+		tail_release(tail);
 }
+
+#endif
@@ -1,8 +1,15 @@
 #ifndef LOGD_TAIL_H
 #define LOGD_TAIL_H
 
+#include <sys/types.h>
 #include <uv.h>
 
+/* follow regular files in-process via inotify where available and fall back
+ * to a `tail -n0 -f` subprocess otherwise */
+#ifdef __linux__
+#define LOGD_TAIL_INOTIFY
+#endif
+
 typedef enum tail_state_e {
 	INIT_TSTATE,
 	OPEN_TSTATE,
@@ -11,23 +18,70 @@ typedef enum tail_state_e {
 	CLOSING_TSTATE,
 } tail_state_t;
 
+#ifdef LOGD_TAIL_INOTIFY
+typedef struct tail_s {
+	tail_state_t state;
+	uv_loop_t* loop;
+	char* input_file;
+	/* followed file */
+	uv_file fd;
+	/* inotify instance watching fd's inode; polled by clients */
+	uv_file inotify_fd;
+	int wd;
+	/* next file offset to read from */
+	off_t offset;
+	/* inode was moved away from input_file, which is followed from its start
+	 * once the moved inode is read up to its end and another file takes its
+	 * place */
+	int moved;
+	/* watch on the directory of input_file while moved, or -1 */
+	int dir_wd;
+	/* inode was removed or watch was otherwise lost */
+	int gone;
+	void (*exit_cb)(struct tail_s* tail, int status);
+	/* free for clients to use */
+	void* data;
+} tail_t;
+#else
 typedef struct tail_s {
 	tail_state_t state;
 	uv_loop_t* loop;
 	uv_process_t proc;
 	uv_process_options_t proc_options;
 	uv_stdio_container_t proc_child_stdio[3];
-	char* proc_args[5];
+	char* proc_args[6];
+	char proc_offset_arg[32];
 	uv_file read_data_fd;
 	uv_file write_data_fd;
 	uv_file read_tail_stderr_fd;
 	uv_file write_tail_stderr_fd;
 	uv_poll_t uv_poll_err_req;
-	void (*exit_cb)(int status);
+	/* per tail so that several tails can spawn in the same loop iteration */
+	uv_timer_t spawn_timer;
+	void (*exit_cb)(struct tail_s* tail, int status);
+	/* free for clients to use */
+	void* data;
 } tail_t;
+#endif
+
+#define TAIL_OFFSET_END ((off_t)-1)
 
 tail_t* tail_create(uv_loop_t* loop, char* input_file);
-int tail_open(tail_t* tail, void (*exit_cb)(int));
+/* tail_open starts following input_file from its end and returns a file
+ * descriptor that becomes readable when there is new data to tail_read. On
+ * Linux the file that replaces a moved input_file is followed from its start
+ * without a new descriptor */
+int tail_open(tail_t* tail, void (*exit_cb)(tail_t*, int));
+/* tail_open_at is like tail_open but starts following input_file from the
+ * given byte offset, or from its end if offset is TAIL_OFFSET_END */
+int tail_open_at(tail_t* tail, off_t offset, void (*exit_cb)(tail_t*, int));
+/* tail_read has the same semantics as read(2) on a non-blocking descriptor:
+ * it returns -1 and sets errno to EAGAIN when there is no new data and 0 when
+ * the followed file is gone */
+ssize_t tail_read(tail_t* tail, char* buf, size_t len);
+/* tail_tell returns the offset in the followed file of the next byte that
+ * tail_read returns, or -1 if it is not known */
+off_t tail_tell(tail_t* tail);
 void tail_close(tail_t* tail);
 void tail_free(tail_t* tail);
 
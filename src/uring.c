@@ -0,0 +1,583 @@
+#include "./uring.h"
+
+#ifdef LOGD_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "./util.h"
+
+/* file position of the descriptor rather than an explicit offset */
+#define URING_OFFSET_CURRENT ((__u64)-1)
+
+enum uring_slot_state_e {
+	FREE_SSTATE,
+	IDLE_SSTATE,
+	INFLIGHT_SSTATE,
+	READY_SSTATE,
+};
+
+struct uring_slot_s {
+	enum uring_slot_state_e state;
+	/* owner or NULL once the reader stopped */
+	uring_reader_t* reader;
+	struct iovec iov;
+	/* index of the registered buffer */
+	unsigned index;
+	/* result of the read and bytes of it already read out */
+	ssize_t res;
+	size_t off;
+};
+
+struct uring_s {
+	int fd;
+	int efd;
+	/* buffers are registered so reads skip mapping them on every request */
+	int fixed;
+	/* reaping completions: submissions are batched until done */
+	int processing;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned sq_entries;
+	/* tail of the submission queue not yet published to the kernel */
+	unsigned sqe_tail;
+	struct io_uring_sqe* sqes;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+	char* bufs;
+	size_t bufs_len;
+	uring_slot_t* slots;
+	unsigned slots_len;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, 0, 0, NULL, 0);
+}
+
+static int sys_io_uring_register(
+  int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static struct io_uring_sqe* uring_get_sqe(uring_t* ring)
+{
+	struct io_uring_sqe* sqe;
+	unsigned head, idx;
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (ring->sqe_tail - head >= ring->sq_entries)
+		return NULL;
+
+	idx = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[idx] = idx;
+	ring->sqe_tail++;
+
+	return sqe;
+}
+
+static int uring_submit(uring_t* ring)
+{
+	unsigned to_submit;
+	int ret;
+
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+	to_submit =
+	  ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (to_submit == 0)
+		return 0;
+
+	do {
+		errno = 0;
+		ret = sys_io_uring_enter(ring->fd, to_submit);
+	} while (ret == -1 && errno == EINTR);
+
+	/* entries stay queued and go with the next submission */
+	if (ret == -1 && (errno == EAGAIN || errno == EBUSY)) {
+		DEBUG_LOG("io_uring_enter would block, to_submit: %u", to_submit);
+		return 0;
+	}
+
+	return ret == -1;
+}
+
+static void uring_flush(uring_t* ring)
+{
+	if (!ring->processing && uring_submit(ring) != 0)
+		perror("io_uring_enter");
+}
+
+/* uring_reader_submit queues a read for every idle buffer. The reads are
+ * linked so that the kernel runs them one after the other and data stays in
+ * order, which also means that a new chain is only queued once the last one
+ * is done */
+static void uring_reader_submit(uring_reader_t* reader)
+{
+	uring_t* ring = reader->ring;
+	struct io_uring_sqe *sqe, *prev = NULL;
+	uring_slot_t* slot;
+
+	if (reader->done || reader->inflight > 0)
+		return;
+
+	while (reader->pending < reader->slots_len) {
+		if ((sqe = uring_get_sqe(ring)) == NULL) {
+			DEBUG_LOG("io_uring submission queue is full, fd: %d", reader->fd);
+			break;
+		}
+
+		slot = reader->slots[reader->tail];
+		if (ring->fixed) {
+			sqe->opcode = IORING_OP_READ_FIXED;
+			sqe->addr = (uintptr_t)slot->iov.iov_base;
+			sqe->len = slot->iov.iov_len;
+			sqe->buf_index = slot->index;
+		} else {
+			sqe->opcode = IORING_OP_READV;
+			sqe->addr = (uintptr_t)&slot->iov;
+			sqe->len = 1;
+		}
+		sqe->fd = reader->fd;
+		sqe->off = URING_OFFSET_CURRENT;
+		sqe->user_data = (uintptr_t)slot;
+		if (prev != NULL)
+			prev->flags |= IOSQE_IO_LINK;
+		prev = sqe;
+
+		slot->state = INFLIGHT_SSTATE;
+		reader->tail = (reader->tail + 1) % reader->slots_len;
+		reader->pending++;
+		reader->inflight++;
+	}
+
+	uring_flush(ring);
+}
+
+/* a short read breaks the chain it is part of and the reads linked after it
+ * complete with ECANCELED. Their buffers are the last ones queued, so once the
+ * chain is done they are taken off the queue to be read into again */
+static void uring_reader_rewind(uring_reader_t* reader)
+{
+	int last;
+
+	while (reader->pending > 0) {
+		last = (reader->tail + reader->slots_len - 1) % reader->slots_len;
+		if (reader->slots[last]->state != IDLE_SSTATE)
+			break;
+		reader->tail = last;
+		reader->pending--;
+	}
+}
+
+static void uring_slot_complete(uring_slot_t* slot, int res)
+{
+	uring_reader_t* reader = slot->reader;
+
+	if (reader == NULL) {
+		slot->state = FREE_SSTATE;
+		return;
+	}
+
+	reader->inflight--;
+	if (res == -ECANCELED) {
+		slot->state = IDLE_SSTATE;
+	} else {
+		slot->state = READY_SSTATE;
+		slot->res = res;
+		slot->off = 0;
+		if (res <= 0) {
+			reader->done = 1;
+			reader->error = -res;
+		}
+	}
+
+	/* have the kernel fill the buffers that were read out meanwhile while
+	 * these ones are scanned */
+	if (reader->inflight == 0) {
+		uring_reader_rewind(reader);
+		uring_reader_submit(reader);
+	}
+
+	/* a cancelled read has nothing to be read out, but the last one of a
+	 * chain that ended the stream lets the end be seen */
+	if (reader->cb &&
+	  (res != -ECANCELED || (reader->done && reader->inflight == 0)))
+		reader->cb(reader);
+}
+
+int uring_process(uring_t* ring)
+{
+	struct io_uring_cqe* cqe;
+	uring_slot_t* slot;
+	eventfd_t ev;
+	unsigned head;
+	int res;
+
+	if (eventfd_read(ring->efd, &ev) != 0 && errno != EAGAIN) {
+		perror("eventfd_read");
+		return 1;
+	}
+
+	ring->processing = 1;
+
+	head = *ring->cq_head;
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		slot = (uring_slot_t*)(uintptr_t)cqe->user_data;
+		res = cqe->res;
+
+		/* release the entry before callbacks can submit more requests */
+		__atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+
+		/* cancellations are submitted without a slot */
+		if (slot != NULL)
+			uring_slot_complete(slot, res);
+	}
+
+	ring->processing = 0;
+
+	if (uring_submit(ring) != 0) {
+		perror("io_uring_enter");
+		return 1;
+	}
+
+	return 0;
+}
+
+int uring_fd(uring_t* ring) { return ring->efd; }
+
+static int uring_map(uring_t* ring, struct io_uring_params* p)
+{
+	ring->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	ring->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = 0;
+	}
+
+	if ((ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING)) ==
+	  MAP_FAILED) {
+		ring->sq_ptr = NULL;
+		return 1;
+	}
+
+	if (ring->cq_len == 0) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else if ((ring->cq_ptr = mmap(NULL, ring->cq_len,
+				  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				  ring->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+		ring->cq_ptr = NULL;
+		return 1;
+	}
+
+	ring->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+	if ((ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES)) ==
+	  MAP_FAILED) {
+		ring->sqes = NULL;
+		return 1;
+	}
+
+	ring->sq_head = (unsigned*)((char*)ring->sq_ptr + p->sq_off.head);
+	ring->sq_tail = (unsigned*)((char*)ring->sq_ptr + p->sq_off.tail);
+	ring->sq_mask = (unsigned*)((char*)ring->sq_ptr + p->sq_off.ring_mask);
+	ring->sq_array = (unsigned*)((char*)ring->sq_ptr + p->sq_off.array);
+	ring->sq_entries = p->sq_entries;
+	ring->sqe_tail = *ring->sq_tail;
+	ring->cq_head = (unsigned*)((char*)ring->cq_ptr + p->cq_off.head);
+	ring->cq_tail = (unsigned*)((char*)ring->cq_ptr + p->cq_off.tail);
+	ring->cq_mask = (unsigned*)((char*)ring->cq_ptr + p->cq_off.ring_mask);
+	ring->cqes =
+	  (struct io_uring_cqe*)((char*)ring->cq_ptr + p->cq_off.cqes);
+
+	return 0;
+}
+
+static int uring_init_slots(uring_t* ring, unsigned slots, size_t slot_len)
+{
+	struct iovec* iovs;
+	unsigned i;
+
+	ring->bufs_len = slots * slot_len;
+	if ((ring->bufs = mmap(NULL, ring->bufs_len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		ring->bufs = NULL;
+		return 1;
+	}
+
+	if ((ring->slots = calloc(slots, sizeof(uring_slot_t))) == NULL ||
+	  (iovs = calloc(slots, sizeof(struct iovec))) == NULL) {
+		errno = ENOMEM;
+		return 1;
+	}
+	ring->slots_len = slots;
+
+	for (i = 0; i < slots; i++) {
+		ring->slots[i].iov.iov_base = ring->bufs + i * slot_len;
+		ring->slots[i].iov.iov_len = slot_len;
+		ring->slots[i].index = i;
+		iovs[i] = ring->slots[i].iov;
+	}
+
+	/* registering pins the buffers, which is subject to RLIMIT_MEMLOCK */
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovs, slots) ==
+	  0) {
+		ring->fixed = 1;
+	} else {
+		DEBUG_LOG("io_uring buffers not registered, errno: %d", errno);
+	}
+
+	free(iovs);
+
+	return 0;
+}
+
+uring_t* uring_create(unsigned slots, size_t slot_len)
+{
+	struct io_uring_params p;
+	uring_t* ring;
+
+	if (slots == 0 || slot_len == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((ring = calloc(1, sizeof(uring_t))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	ring->fd = -1;
+	ring->efd = -1;
+
+	/* every slot has at most a read and its cancellation queued */
+	memset(&p, 0, sizeof(p));
+	if ((ring->fd = sys_io_uring_setup(slots * 2, &p)) < 0) {
+		ring->fd = -1;
+		goto error;
+	}
+
+	if (uring_map(ring, &p) != 0 ||
+	  uring_init_slots(ring, slots, slot_len) != 0)
+		goto error;
+
+	if ((ring->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+	  sys_io_uring_register(
+		ring->fd, IORING_REGISTER_EVENTFD, &ring->efd, 1) != 0)
+		goto error;
+
+	DEBUG_LOG("created io_uring, fd: %d, efd: %d, entries: %u, fixed: %d",
+	  ring->fd, ring->efd, p.sq_entries, ring->fixed);
+
+	return ring;
+
+error:
+	uring_free(ring);
+	return NULL;
+}
+
+void uring_free(uring_t* ring)
+{
+	int lerrno = errno;
+
+	if (ring == NULL)
+		return;
+
+	/* closing the ring cancels whatever is in flight. Buffers are unmapped
+	 * rather than freed so the kernel can never write into reused memory */
+	if (ring->fd != -1)
+		UNEINTR2(close(ring->fd));
+	if (ring->efd != -1)
+		UNEINTR2(close(ring->efd));
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_len);
+	if (ring->sq_ptr)
+		munmap(ring->sq_ptr, ring->sq_len);
+	if (ring->bufs)
+		munmap(ring->bufs, ring->bufs_len);
+	free(ring->slots);
+	free(ring);
+
+	errno = lerrno;
+}
+
+int uring_reader_start(uring_t* ring, uring_reader_t* reader, int fd)
+{
+	unsigned i;
+	int flags;
+
+	reader->ring = ring;
+	reader->fd = fd;
+	reader->slots_len = 0;
+	reader->head = 0;
+	reader->tail = 0;
+	reader->pending = 0;
+	reader->inflight = 0;
+	reader->done = 0;
+	reader->error = 0;
+
+	for (i = 0; i < ring->slots_len && reader->slots_len < URING_READER_DEPTH;
+		 i++) {
+		if (ring->slots[i].state == FREE_SSTATE)
+			reader->slots[reader->slots_len++] = &ring->slots[i];
+	}
+
+	if (reader->slots_len == 0) {
+		errno = EBUSY;
+		return 1;
+	}
+
+	if ((flags = fcntl(fd, F_GETFL)) == -1 ||
+	  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+		reader->slots_len = 0;
+		return 1;
+	}
+
+	for (i = 0; i < (unsigned)reader->slots_len; i++) {
+		reader->slots[i]->state = IDLE_SSTATE;
+		reader->slots[i]->reader = reader;
+	}
+
+	DEBUG_LOG("started io_uring reader, fd: %d, slots: %d", fd,
+	  reader->slots_len);
+
+	uring_reader_submit(reader);
+
+	return 0;
+}
+
+static void uring_reader_consume(uring_reader_t* reader)
+{
+	reader->slots[reader->head]->state = IDLE_SSTATE;
+	reader->head = (reader->head + 1) % reader->slots_len;
+	reader->pending--;
+}
+
+ssize_t uring_reader_peek(uring_reader_t* reader, char** data)
+{
+	uring_slot_t* slot;
+
+again:
+	if (reader->pending == 0) {
+		if (reader->done) {
+			if (reader->error == 0)
+				return 0;
+			errno = reader->error;
+			return -1;
+		}
+		uring_reader_submit(reader);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	slot = reader->slots[reader->head];
+	if (slot->state != READY_SSTATE) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* end of file or the error is reported from done from now on */
+	if (slot->res <= 0) {
+		uring_reader_consume(reader);
+		goto again;
+	}
+
+	*data = (char*)slot->iov.iov_base + slot->off;
+
+	return slot->res - slot->off;
+}
+
+void uring_reader_ack(uring_reader_t* reader, size_t n)
+{
+	uring_slot_t* slot;
+
+	/* the reader may have been stopped since the peek */
+	if (reader->pending == 0)
+		return;
+
+	slot = reader->slots[reader->head];
+	slot->off += n;
+	if (slot->off == (size_t)slot->res) {
+		uring_reader_consume(reader);
+		uring_reader_submit(reader);
+	}
+}
+
+ssize_t uring_reader_read(uring_reader_t* reader, char* buf, size_t len)
+{
+	char* data;
+	ssize_t n;
+
+	if ((n = uring_reader_peek(reader, &data)) <= 0)
+		return n;
+
+	if ((size_t)n > len)
+		n = len;
+	memcpy(buf, data, n);
+	uring_reader_ack(reader, n);
+
+	return n;
+}
+
+void uring_reader_stop(uring_reader_t* reader)
+{
+	struct io_uring_sqe* sqe;
+	uring_slot_t* slot;
+	int i;
+
+	for (i = 0; i < reader->slots_len; i++) {
+		slot = reader->slots[i];
+		slot->reader = NULL;
+
+		if (slot->state != INFLIGHT_SSTATE) {
+			slot->state = FREE_SSTATE;
+			continue;
+		}
+
+		/* the slot is freed when the read completes, cancelled or not */
+		if ((sqe = uring_get_sqe(reader->ring)) != NULL) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = (uintptr_t)slot;
+		}
+	}
+
+	DEBUG_LOG("stopped io_uring reader, fd: %d", reader->fd);
+
+	reader->slots_len = 0;
+	reader->pending = 0;
+	reader->inflight = 0;
+	reader->done = 1;
+	reader->fd = -1;
+
+	uring_flush(reader->ring);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LOGD_URING_H
+#define LOGD_URING_H
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+/* completion based reads via io_uring where the kernel headers have it. The
+ * ring is driven through raw system calls so there is no liburing dependency
+ * and uring_create fails at runtime on kernels without io_uring */
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LOGD_URING
+#endif
+#endif
+
+#ifdef LOGD_URING
+
+/* buffers a reader keeps cycling: the kernel fills them with a chain of
+ * linked reads while the ones it filled before hold data waiting to be read */
+#define URING_READER_DEPTH 4
+
+typedef struct uring_s uring_t;
+typedef struct uring_slot_s uring_slot_t;
+
+typedef struct uring_reader_s {
+	uring_t* ring;
+	int fd;
+	uring_slot_t* slots[URING_READER_DEPTH];
+	int slots_len;
+	/* next slot to be read from and next slot to be submitted */
+	int head;
+	int tail;
+	/* slots between head and tail, ready or in flight */
+	int pending;
+	/* reads of the chain in flight: a stream is read by one chain at a time
+	 * to keep data in order */
+	int inflight;
+	/* end of file or error was read: no more submissions */
+	int done;
+	/* errno of the failed read if any */
+	int error;
+	/* called for every read completed by the kernel */
+	void (*cb)(struct uring_reader_s* reader);
+	/* free for clients to use */
+	void* data;
+} uring_reader_t;
+
+/* uring_create sets up a ring with slots buffers of slot_len bytes that are
+ * registered with the kernel if the memlock limit allows it */
+uring_t* uring_create(unsigned slots, size_t slot_len);
+/* uring_fd returns an eventfd that becomes readable when there are
+ * completions for uring_process */
+int uring_fd(uring_t* ring);
+/* uring_process reaps completions, resubmits reads and calls reader
+ * callbacks. It returns 0 or 1 on error */
+int uring_process(uring_t* ring);
+void uring_free(uring_t* ring);
+
+/* uring_reader_start starts reading fd sequentially from its current position
+ * and puts it in blocking mode so that the kernel waits for data instead of
+ * completing reads with EAGAIN. It fails with EBUSY if the ring has no buffers
+ * left */
+int uring_reader_start(uring_t* ring, uring_reader_t* reader, int fd);
+/* uring_reader_read has the same semantics as read(2) on a non-blocking
+ * descriptor, copying out data that the kernel already read */
+ssize_t uring_reader_read(uring_reader_t* reader, char* buf, size_t len);
+/* uring_reader_peek is uring_reader_read without the copy: data is pointed at
+ * what the kernel read into the next buffer, which stays there and may be
+ * written to until it is handed back with uring_reader_ack */
+ssize_t uring_reader_peek(uring_reader_t* reader, char** data);
+/* uring_reader_ack hands back the first n bytes of the last peek */
+void uring_reader_ack(uring_reader_t* reader, size_t n);
+/* uring_reader_stop cancels reads in flight. Buffers are returned to the
+ * ring once the kernel is done with them, so fd can be closed right away */
+void uring_reader_stop(uring_reader_t* reader);
+
+#endif
+
+#endif
@@ -22,6 +22,41 @@ static const char* util_log_get(log_t* l, const char* key)
 	return value;
 }
 
+static const char* header_keys[] = {
+  KEY_DATE, KEY_TIME, KEY_LEVEL, KEY_CLASS, KEY_THREAD, KEY_CALLTYPE};
+#define HEADER_KEYS_LEN (sizeof(header_keys) / sizeof(header_keys[0]))
+
+/* is_header_prop returns whether p is printed in the header rather than with
+ * the other properties. The keys of indexed logs come with their hash */
+static bool is_header_prop(prop_t* p, bool indexed)
+{
+	static uint32_t hashes[HEADER_KEYS_LEN];
+	static bool hashed = false;
+	uint32_t len;
+	size_t i;
+
+	if (!indexed) {
+		for (i = 0; i < HEADER_KEYS_LEN; i++) {
+			if (strcmp(p->key, header_keys[i]) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	if (!hashed) {
+		for (i = 0; i < HEADER_KEYS_LEN; i++)
+			hashes[i] = log_hash(header_keys[i], &len);
+		hashed = true;
+	}
+
+	for (i = 0; i < HEADER_KEYS_LEN; i++) {
+		if (p->khash == hashes[i] && strcmp(p->key, header_keys[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
 #define ADD_OFFSET(want, buf, blen, res)                                       \
 	blen -= want;                                                              \
 	if (blen < 0) {                                                            \
@@ -37,11 +72,10 @@ static int snprintp(char* buf, int blen, log_t* l)
 	prop_t* p;
 	int want = 0;
 	int res = 0;
+	bool indexed = log_indexed(l);
 
 	for (p = l->props; p != NULL && p->key != NULL; p = p->next) {
-		if (strcmp(p->key, KEY_DATE) != 0 && strcmp(p->key, KEY_TIME) != 0 &&
-		  strcmp(p->key, KEY_LEVEL) != 0 && strcmp(p->key, KEY_CLASS) != 0 &&
-		  strcmp(p->key, KEY_THREAD) != 0 && strcmp(p->key, KEY_CALLTYPE)) {
+		if (!is_header_prop(p, indexed)) {
 			want = snprintf(buf, blen, "%s: %s, ", p->key,
 			  p->value == NULL ? "null" : p->value);
 			ADD_OFFSET(want, buf, blen, res);
@@ -56,6 +90,8 @@ int snprintl(char* buf, int blen, log_t* l)
 	int want;
 	int res = 0;
 
+	log_scan_body(l);
+
 	want =
 	  snprintf(buf, blen, "%s %s\t%s\t[%s]\t%s\t", util_log_get(l, KEY_DATE),
 		util_log_get(l, KEY_TIME), util_log_get(l, KEY_LEVEL),
@@ -78,10 +114,10 @@ int snprintl(char* buf, int blen, log_t* l)
 static void fprintp(FILE* stream, log_t* l)
 {
 	prop_t* p;
+	bool indexed = log_indexed(l);
+
 	for (p = l->props; p != NULL && p->key != NULL; p = p->next) {
-		if (strcmp(p->key, KEY_DATE) != 0 && strcmp(p->key, KEY_TIME) != 0 &&
-		  strcmp(p->key, KEY_LEVEL) != 0 && strcmp(p->key, KEY_CLASS) != 0 &&
-		  strcmp(p->key, KEY_THREAD) != 0 && strcmp(p->key, KEY_CALLTYPE)) {
+		if (!is_header_prop(p, indexed)) {
 			fprintf(
 			  stream, "%s: %s, ", p->key, p->value == NULL ? "null" : p->value);
 		}
@@ -90,6 +126,8 @@ static void fprintp(FILE* stream, log_t* l)
 
 void fprintl(FILE* stream, log_t* log)
 {
+	log_scan_body(log);
+
 	fprintf(stream, "%s %s\t%s\t[%s]\t%s\t", util_log_get(log, KEY_DATE),
 	  util_log_get(log, KEY_TIME), util_log_get(log, KEY_LEVEL),
 	  util_log_get(log, KEY_THREAD), util_log_get(log, KEY_CLASS));
@@ -196,3 +234,27 @@ error:
 	errno = EINVAL;
 	return -1;
 }
+
+long long parse_non_negative_llong(const char* str)
+{
+	char* endptr;
+	long long val;
+
+	errno = 0;
+	val = strtoll(str, &endptr, 10);
+
+	if ((errno == ERANGE && (val == LLONG_MAX || val == LLONG_MIN)) ||
+	  (errno != 0 && val == 0)) {
+		perror("strtoll");
+		goto error;
+	}
+
+	if (endptr == str || *endptr != '\0' || val < 0)
+		goto error;
+
+	return val;
+
+error:
+	errno = EINVAL;
+	return -1;
+}
@@ -70,5 +70,6 @@ const char* util_get_date();
 int next_attempt_backoff(
   int start_delay, int reopen_retries, int backoff_exponent);
 int parse_non_negative_int(const char* str);
+long long parse_non_negative_llong(const char* str);
 
 #endif
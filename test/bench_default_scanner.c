@@ -0,0 +1,82 @@
+#include <time.h>
+
+#include "../src/default_scanner.h"
+#include "../src/scanner.h"
+#include "test.h"
+
+/* a header followed by enough key/value pairs for the body to dominate */
+#define LOG                                                                    \
+	"2018-05-30 11:01:47,633	 INFO	[0x7f65b9365700]	"                          \
+	"registry.ClientBuilder	getSupportedFormats: message: Ignoring "           \
+	"unsupported codec telephone-event, connectionId: "                        \
+	"139bca64-4480-4727-b241-74699b5a20cc, partnerId: 100, publisherId: "      \
+	"72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, routerStreamId: "                   \
+	"72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, sessionId: "                        \
+	"2_MX4xMDB-flR1ZSBOb3YgMTkgMTE6MDk6NTggUFNUIDIwMTN-MC4zNzQxNzIxNX4, "      \
+	"streamId: 72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, widgetType: Publisher\n"
+
+#define BYTES (256 * 1024 * 1024)
+
+static void report(const char* name, struct timespec* start,
+  struct timespec* end, size_t bytes, size_t total)
+{
+	double s = (end->tv_sec - start->tv_sec) +
+	  (end->tv_nsec - start->tv_nsec) / 1e9;
+
+	printf("  BENCH\t%-12s %10.2f MB/s %10.2f logs/s\n", name,
+	  (bytes / 1048576.0) / s, total / s);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t len = strlen(LOG);
+	size_t logs = BYTES / len;
+	size_t i, n, off, total = 0;
+	char* data = malloc(logs * len);
+	scan_batch_t* batch = malloc(sizeof(scan_batch_t));
+	void* p = scanner_create();
+	struct timespec start, end;
+	scan_res_t res;
+
+	for (i = 0; i < logs; i++)
+		memcpy(data + i * len, LOG, len);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (off = 0; off < logs * len; off += res.consumed) {
+		res = scanner_scan(p, data + off, logs * len - off);
+		if (res.type != SCAN_COMPLETE) {
+			fprintf(stderr, "unexpected scan result %d\n", res.type);
+			return EXIT_FAILURE;
+		}
+		total++;
+		scanner_reset(p);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	report("kv", &start, &end, logs * len, total);
+
+	/* the scanner wrote NUL over the delimiters of the data it scanned */
+	for (i = 0; i < logs; i++)
+		memcpy(data + i * len, LOG, len);
+
+	total = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (off = 0; off < logs * len;) {
+		n = scanner_scan_batch(p, data + off, logs * len - off, batch);
+		for (i = 0; i < n; i++) {
+			off += batch->res[i].consumed;
+			total += batch->res[i].type == SCAN_COMPLETE;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (total != logs) {
+		fprintf(stderr, "scanned %zu logs out of %zu\n", total, logs);
+		return EXIT_FAILURE;
+	}
+	report("kv batch", &start, &end, logs * len, total);
+
+	scanner_free(p);
+	free(batch);
+	free(data);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+# Compares logs/s of a script that looks into every log with logd.log_get
+# against the same script using the LuaJIT FFI view of logd.ffi.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/bench_ffi.in"
+SCRIPT="$DIR/bench_ffi.lua"
+OUT="$DIR/bench_ffi.out"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $IN $SCRIPT $OUT
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+push_file
+LOGS=$(wc -l < $IN)
+
+cat > $SCRIPT << EOF
+local logd = require("logd")
+local logdffi = require("logd.ffi")
+local matches = 0
+
+local function count_log_get(logptr)
+	if logd.log_get(logptr, "level") == "ERROR" then
+		matches = matches + 1
+	end
+	if logd.log_get(logptr, "thread") == "thread5" then
+		matches = matches + 1
+	end
+	if logd.log_get(logptr, "b") ~= nil then
+		matches = matches + 1
+	end
+end
+
+local function count_ffi(logptr)
+	local log = logdffi.log(logptr)
+	local prop = logdffi.find(log, "level")
+	if prop ~= nil and logdffi.value_eq(prop, "ERROR") then
+		matches = matches + 1
+	end
+	prop = logdffi.find(log, "thread")
+	if prop ~= nil and logdffi.value_eq(prop, "thread5") then
+		matches = matches + 1
+	end
+	if logdffi.find(log, "b") ~= nil then
+		matches = matches + 1
+	end
+end
+
+if os.getenv("LOGD_BENCH_FFI") then
+	logd.on_log = count_ffi
+else
+	logd.on_log = count_log_get
+end
+
+function logd.on_exit(code, reason)
+	io.write(matches)
+	io.flush()
+end
+EOF
+
+function bench() {
+	local name=$1
+	local start=$(date +%s%N)
+	cat $IN | $LOGD_EXEC $SCRIPT > $OUT
+	local end=$(date +%s%N)
+	awk -v name="$name" -v logs="$LOGS" -v ns="$((end - start))" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f logs/s\n", name, logs / (ns / 1e9)
+	}'
+}
+
+bench "log_get"
+EXPECTED=$(cat $OUT)
+export LOGD_BENCH_FFI=1
+bench "ffi"
+assert_file_content "$EXPECTED" $OUT
+
+exit 0
@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+# Compares logs/s of a script that drops most logs in logd.on_log against the
+# same script with the logs dropped by --filter before they get to Lua.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/bench_filter.in"
+SCRIPT="$DIR/bench_filter.lua"
+OUT="$DIR/bench_filter.out"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $IN $SCRIPT $OUT
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+push_file
+LOGS=$(wc -l < $IN)
+
+cat > $SCRIPT << EOF
+local logd = require("logd")
+local matches = 0
+
+function logd.on_log(logptr)
+	if logd.log_get(logptr, "level") ~= "ERROR" then
+		return
+	end
+	matches = matches + 1
+end
+
+function logd.on_exit(code, reason)
+	io.write(matches)
+	io.flush()
+end
+EOF
+
+function bench() {
+	local name=$1
+	shift
+	local start=$(date +%s%N)
+	cat $IN | $LOGD_EXEC $SCRIPT "$@" > $OUT
+	local end=$(date +%s%N)
+	awk -v name="$name" -v logs="$LOGS" -v ns="$((end - start))" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f logs/s\n", name, logs / (ns / 1e9)
+	}'
+}
+
+bench "lua"
+EXPECTED=$(cat $OUT)
+bench "filter" --filter="level = ERROR"
+assert_file_content "$EXPECTED" $OUT
+
+exit 0
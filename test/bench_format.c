@@ -0,0 +1,72 @@
+#include <time.h>
+
+#include "../src/format.h"
+#include "../src/scanner.h"
+#include "test.h"
+
+/* the layout of the default scanner spelled as a format */
+#define FORMAT "%date %time %level [%thread] %class %kv"
+
+#define LOG                                                                    \
+	"2018-05-30 11:01:47,633	 INFO	[0x7f65b9365700]	"                  \
+	"registry.ClientBuilder	getSupportedFormats: message: Ignoring "           \
+	"unsupported codec telephone-event, connectionId: "                        \
+	"139bca64-4480-4727-b241-74699b5a20cc, partnerId: 100, publisherId: "      \
+	"72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, routerStreamId: "                   \
+	"72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, sessionId: "                        \
+	"2_MX4xMDB-flR1ZSBOb3YgMTkgMTE6MDk6NTggUFNUIDIwMTN-MC4zNzQxNzIxNX4, "      \
+	"streamId: 72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2, widgetType: Publisher\n"
+
+#define BYTES (256 * 1024 * 1024)
+
+static int bench(const char* name, void* p,
+  scan_res_t (*scan)(void*, char*, size_t), void (*reset)(void*))
+{
+	size_t len = strlen(LOG);
+	size_t logs = BYTES / len;
+	size_t i, off, total = 0;
+	char* data = malloc(logs * len);
+	struct timespec start, end;
+	scan_res_t res;
+	double s;
+
+	for (i = 0; i < logs; i++)
+		memcpy(data + i * len, LOG, len);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (off = 0; off < logs * len; off += res.consumed) {
+		res = scan(p, data + off, logs * len - off);
+		if (res.type != SCAN_COMPLETE) {
+			fprintf(stderr, "unexpected scan result %d\n", res.type);
+			return 1;
+		}
+		total++;
+		reset(p);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("  BENCH\t%-12s %10.2f MB/s %10.2f logs/s\n", name,
+	  (logs * len / 1048576.0) / s, total / s);
+
+	free(data);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	format_t* f = format_compile(FORMAT);
+	void* builtin = scanner_create();
+	void* format = format_scanner_create(f);
+	int ret;
+
+	ret = bench("builtin", builtin, &scanner_scan, &scanner_reset) ||
+	  bench("format", format, &format_scanner_scan, &format_scanner_reset);
+
+	scanner_free(builtin);
+	format_scanner_free(format);
+	format_free(f);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+# Measures throughput and CPU usage of scanning 500KB JSON logs that arrive in
+# 4KB writes, so that every log is scanned across many reads and the input
+# buffer has to be compacted or grown while it is partially scanned.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+DATA="$DIR/bench_long_logs.data"
+SCRIPT="$DIR/bench_long_logs.lua"
+OUT="$DIR/bench_long_logs.out"
+TIMING="$DIR/bench_long_logs.time"
+LOGD_EXEC="$DIR/../bin/logd"
+PROP_SCANNER="$DIR/../lib/logd_prop_scanner.so"
+LONG_LOGS=${LONG_LOGS:-200}
+LONG_LOG_LEN=${LONG_LOG_LEN:-500000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $DATA
+	rm -f $OUT
+	rm -f $TIMING
+	exit $CODE;
+}
+
+trap finish EXIT
+
+awk -v logs="$LONG_LOGS" -v len="$LONG_LOG_LEN" 'BEGIN {
+	payload = sprintf("%*s", len, "")
+	gsub(/ /, "a", payload)
+	for (i = 0; i < logs; i++) {
+		printf "{\"date\": \"2018-05-12\", \"time\": \"12:51:28\", "
+		printf "\"level\": \"INFO\", \"n\": %d, \"payload\": \"%s\"}\n", i, payload
+	}
+}' > $DATA
+BYTES=$(wc -c < $DATA)
+LOGS=$(wc -l < $DATA)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local uv = require("uv")
+local expected = $LOGS
+local counter = 0
+local start
+function logd.on_log(logptr)
+	if counter == 0 then
+		start = uv.hrtime()
+	end
+	counter = counter + 1
+	if counter == expected then
+		io.write(string.format("%d\n", uv.hrtime() - start))
+		io.flush()
+		os.exit(0)
+	end
+end
+function logd.on_error()
+	logd.on_log()
+end
+EOF
+
+function report() {
+	local name=$1
+	local elapsed_ns=$(cat $OUT)
+	local cpu_s=$(awk '/user|sys/ { split($2, t, "m"); sub("s", "", t[2]); s += t[1] * 60 + t[2] } END { print s }' $TIMING)
+	awk -v name="$name" -v bytes="$BYTES" -v ns="$elapsed_ns" -v cpu="$cpu_s" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f MB/s %10.2f cpu-s/GB\n", name,
+			(bytes / 1048576) / (ns / 1e9), cpu / (bytes / 1073741824)
+	}'
+}
+
+truncate -s 0 $OUT
+( time ( dd if=$DATA bs=4096 status=none | \
+	$LOGD_EXEC $SCRIPT --scanner="$PROP_SCANNER" > $OUT ) ) 2> $TIMING
+report "buffer"
+
+truncate -s 0 $OUT
+( time ( dd if=$DATA bs=4096 status=none | \
+	$LOGD_EXEC $SCRIPT --scanner="$PROP_SCANNER" --ring-buffer > $OUT ) ) \
+	2> $TIMING
+report "ring-buffer"
+
+exit 0
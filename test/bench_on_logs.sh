@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+# Compares logs/s of the summary example handling logs one at a time with
+# logd.on_log against all the logs scanned at once with logd.on_logs.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/bench_on_logs.in"
+SCRIPT="$DIR/../examples/summary/main.lua"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+push_file
+LOGS=$(wc -l < $IN)
+
+function bench() {
+	local name=$1
+	local start=$(date +%s%N)
+	cat $IN | $LOGD_EXEC $SCRIPT > /dev/null
+	local end=$(date +%s%N)
+	awk -v name="$name" -v logs="$LOGS" -v ns="$((end - start))" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f logs/s\n", name, logs / (ns / 1e9)
+	}'
+}
+
+bench "on_log"
+export LOGD_ON_LOGS=1
+bench "on_logs"
+
+exit 0
@@ -0,0 +1,133 @@
+#!/usr/bin/env bash
+# Compares throughput and CPU usage of reading a pipe fed by a fast writer with
+# reads and scans on a reader thread (--pipeline) against the default single
+# threaded path. The script does some work per log so that there is something
+# for the reader thread to overlap with. Latency is measured from the time a
+# paced writer stamps into each log to the time on_log sees it.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+DATA="$DIR/bench_pipeline.data"
+SCRIPT="$DIR/bench_pipeline.lua"
+LATENCY_SCRIPT="$DIR/bench_pipeline_latency.lua"
+OUT="$DIR/bench_pipeline.out"
+TIMING="$DIR/bench_pipeline.time"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+LATENCY_LOGS=${LATENCY_LOGS:-20000}
+# logs the writer writes at once and microseconds it sleeps in between
+LATENCY_BATCH=${LATENCY_BATCH:-100}
+LATENCY_PAUSE=${LATENCY_PAUSE:-1000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $LATENCY_SCRIPT $DATA $OUT $TIMING
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $DATA
+IN=$DATA
+push_file
+BYTES=$(wc -c < $DATA)
+LOGS=$(wc -l < $DATA)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local uv = require("uv")
+local expected = $LOGS
+local counter = 0
+local levels = {}
+local start
+function logd.on_log(logptr)
+	if counter == 0 then
+		start = uv.hrtime()
+	end
+	counter = counter + 1
+	local level = logd.log_get(logptr, "level")
+	if level ~= nil then
+		levels[level] = (levels[level] or 0) + 1
+	end
+	if counter == expected then
+		io.write(string.format("%d\n", uv.hrtime() - start))
+		io.flush()
+		os.exit(0)
+	end
+end
+function logd.on_error()
+	logd.on_log()
+end
+EOF
+
+# same clock as uv.hrtime so that the script can compare stamps with it
+function paced_writer() {
+	perl -MTime::HiRes=clock_gettime,usleep,CLOCK_MONOTONIC -e '
+		my ($logs, $batch, $pause) = @ARGV;
+		$| = 0;
+		for (my $i = 0; $i < $logs; $i++) {
+			printf "2018-05-12 12:51:28 INFO\t[thread]\tclazz\tts: %.0f, \n",
+				clock_gettime(CLOCK_MONOTONIC) * 1e9;
+			if (($i + 1) % $batch == 0) {
+				STDOUT->flush();
+				usleep($pause);
+			}
+		}' $LATENCY_LOGS $LATENCY_BATCH $LATENCY_PAUSE
+}
+
+cat >$LATENCY_SCRIPT << EOF
+local logd = require("logd")
+local uv = require("uv")
+local expected = $LATENCY_LOGS
+local latencies = {}
+function logd.on_log(logptr)
+	local ts = tonumber(logd.log_get(logptr, "ts"))
+	latencies[#latencies + 1] = uv.hrtime() - ts
+	if #latencies == expected then
+		table.sort(latencies)
+		io.write(string.format("%d %d %d\n",
+			latencies[math.ceil(expected * 0.5)],
+			latencies[math.ceil(expected * 0.99)],
+			latencies[expected]))
+		io.flush()
+		os.exit(0)
+	end
+end
+EOF
+
+function report_latency() {
+	local name=$1
+	awk -v name="$name" '{
+		printf "  BENCH\t%-12s %10.1f us p50 %10.1f us p99 %10.1f us max\n",
+			name, $1 / 1e3, $2 / 1e3, $3 / 1e3
+	}' $OUT
+}
+
+function report() {
+	local name=$1
+	local elapsed_ns=$(cat $OUT)
+	local cpu_s=$(awk '/user|sys/ { split($2, t, "m"); sub("s", "", t[2]); s += t[1] * 60 + t[2] } END { print s }' $TIMING)
+	awk -v name="$name" -v bytes="$BYTES" -v logs="$LOGS" -v ns="$elapsed_ns" -v cpu="$cpu_s" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f MB/s %12.2f logs/s %10.2f cpu-s/GB\n",
+			name, (bytes / 1048576) / (ns / 1e9), logs / (ns / 1e9),
+			cpu / (bytes / 1073741824)
+	}'
+}
+
+truncate -s 0 $OUT
+( time ( cat $DATA | $LOGD_EXEC $SCRIPT > $OUT ) ) 2> $TIMING
+report "default"
+
+truncate -s 0 $OUT
+( time ( cat $DATA | $LOGD_EXEC $SCRIPT --pipeline > $OUT ) ) 2> $TIMING
+report "pipeline"
+
+truncate -s 0 $OUT
+paced_writer | $LOGD_EXEC $LATENCY_SCRIPT > $OUT
+report_latency "default"
+
+truncate -s 0 $OUT
+paced_writer | $LOGD_EXEC $LATENCY_SCRIPT --pipeline > $OUT
+report_latency "pipeline"
+
+exit 0
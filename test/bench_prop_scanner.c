@@ -0,0 +1,60 @@
+#include <time.h>
+
+#include "../src/prop_scanner.h"
+#include "test.h"
+
+/* a few top level properties and a big nested payload that is never looked
+ * into */
+#define HEAD "{\"level\": \"INFO\", \"msg\": \"request\", \"payload\": "
+#define TAIL ", \"duration\": 2.017655998468399}"
+#define ITEM                                                                   \
+	"{\"id\": \"72ee1ae2-8c55-4fb6-8cfc-653e8b0618c2\", \"tags\": [\"a\", "    \
+	"\"b\"], \"text\": \"say \\\"hi\\\" {or} [not]\"}"
+#define ITEMS 64
+
+#define BYTES (256 * 1024 * 1024)
+
+int main(int argc, char* argv[])
+{
+	char log[sizeof(HEAD) + sizeof(TAIL) + ITEMS * (sizeof(ITEM) + 1) + 2];
+	size_t len, logs, i, off, total = 0;
+	void* p = scanner_create();
+	struct timespec start, end;
+	scan_res_t res;
+	char* data;
+	double s;
+
+	strcpy(log, HEAD "[");
+	for (i = 0; i < ITEMS; i++) {
+		strcat(log, ITEM);
+		strcat(log, i + 1 < ITEMS ? "," : "]");
+	}
+	strcat(log, TAIL);
+
+	len = strlen(log);
+	logs = BYTES / len;
+	data = malloc(logs * len);
+	for (i = 0; i < logs; i++)
+		memcpy(data + i * len, log, len);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (off = 0; off < logs * len; off += res.consumed) {
+		res = scanner_scan(p, data + off, logs * len - off);
+		if (res.type != SCAN_COMPLETE) {
+			fprintf(stderr, "unexpected scan result %d\n", res.type);
+			return EXIT_FAILURE;
+		}
+		total++;
+		scanner_reset(p);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("  BENCH\t%-12s %10.2f MB/s %10.2f logs/s\n", "nested",
+	  (logs * len / 1048576.0) / s, total / s);
+
+	scanner_free(p);
+	free(data);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+# Compares throughput and CPU usage of following a regular file with the
+# in-process follower (-f) against the `tail -n0 -f` subprocess pipe path.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/bench_tail.in"
+DATA="$DIR/bench_tail.data"
+SCRIPT="$DIR/bench_tail.lua"
+OUT="$DIR/bench_tail.out"
+TIMING="$DIR/bench_tail.time"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $IN
+	rm -f $DATA
+	rm -f $OUT
+	rm -f $TIMING
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+touch $DATA
+IN_BAK=$IN
+IN=$DATA
+push_file
+IN=$IN_BAK
+BYTES=$(wc -c < $DATA)
+LOGS=$(wc -l < $DATA)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local uv = require("uv")
+local expected = $LOGS
+local counter = 0
+local start
+function logd.on_log(logptr)
+	if counter == 0 then
+		start = uv.hrtime()
+	end
+	counter = counter + 1
+	if counter == expected then
+		io.write(string.format("%d\n", uv.hrtime() - start))
+		io.flush()
+		os.exit(0)
+	end
+end
+function logd.on_error()
+	logd.on_log()
+end
+EOF
+
+function report() {
+	local name=$1
+	local elapsed_ns=$(cat $OUT)
+	local cpu_s=$(awk '/user|sys/ { split($2, t, "m"); sub("s", "", t[2]); s += t[1] * 60 + t[2] } END { print s }' $TIMING)
+	awk -v name="$name" -v bytes="$BYTES" -v ns="$elapsed_ns" -v cpu="$cpu_s" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f MB/s %10.2f cpu-s/GB\n", name,
+			(bytes / 1048576) / (ns / 1e9), cpu / (bytes / 1073741824)
+	}'
+}
+
+function wait_out() {
+	while [ ! -s $OUT ]; do sleep 0.1; done
+}
+
+# in-process follower
+truncate -s 0 $IN
+truncate -s 0 $OUT
+( time $LOGD_EXEC $SCRIPT -f $IN > $OUT ) 2> $TIMING &
+sleep $TESTS_SLEEP
+cat $DATA >> $IN
+wait_out
+wait
+report "inotify"
+
+# tail subprocess writing to a pipe
+truncate -s 0 $IN
+truncate -s 0 $OUT
+( time ( tail -n0 -f $IN | $LOGD_EXEC $SCRIPT > $OUT ) ) 2> $TIMING &
+sleep $TESTS_SLEEP
+cat $DATA >> $IN
+wait_out
+# make tail notice its reader is gone
+echo >> $IN
+wait
+report "subprocess"
+
+exit 0
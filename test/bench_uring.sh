@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+# Compares throughput and CPU usage of reading a pipe fed by a fast writer with
+# the io_uring backend (--io-uring) against the default poll backend.
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+DATA="$DIR/bench_uring.data"
+SCRIPT="$DIR/bench_uring.lua"
+OUT="$DIR/bench_uring.out"
+TIMING="$DIR/bench_uring.time"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=${PUSH_FILE_ITER:-20000}
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $DATA
+	rm -f $OUT
+	rm -f $TIMING
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $DATA
+IN=$DATA
+push_file
+BYTES=$(wc -c < $DATA)
+LOGS=$(wc -l < $DATA)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local uv = require("uv")
+local expected = $LOGS
+local counter = 0
+local start
+function logd.on_log(logptr)
+	if counter == 0 then
+		start = uv.hrtime()
+	end
+	counter = counter + 1
+	if counter == expected then
+		io.write(string.format("%d\n", uv.hrtime() - start))
+		io.flush()
+		os.exit(0)
+	end
+end
+function logd.on_error()
+	logd.on_log()
+end
+EOF
+
+function report() {
+	local name=$1
+	local elapsed_ns=$(cat $OUT)
+	local cpu_s=$(awk '/user|sys/ { split($2, t, "m"); sub("s", "", t[2]); s += t[1] * 60 + t[2] } END { print s }' $TIMING)
+	awk -v name="$name" -v bytes="$BYTES" -v ns="$elapsed_ns" -v cpu="$cpu_s" 'BEGIN {
+		printf "  BENCH\t%-12s %10.2f MB/s %10.2f cpu-s/GB\n", name,
+			(bytes / 1048576) / (ns / 1e9), cpu / (bytes / 1073741824)
+	}'
+}
+
+# the writer is as fast as the page cache so logd is the bottleneck
+truncate -s 0 $OUT
+( time ( cat $DATA | $LOGD_EXEC $SCRIPT > $OUT ) ) 2> $TIMING
+report "poll"
+
+truncate -s 0 $OUT
+( time ( cat $DATA | $LOGD_EXEC $SCRIPT --io-uring > $OUT ) ) 2> $TIMING
+report "io_uring"
+
+exit 0
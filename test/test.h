@@ -299,6 +299,21 @@ static int __test_ctx_init(test_ctx_t* ctx, int argc, char* argv[])
 		}                                                                      \
 	}
 
+/* lengths recorded by scanners must be those of the strings */
+int log_lens_cmp(log_t* l)
+{
+	prop_t* p;
+
+	for (p = l->props; p != NULL; p = p->next) {
+		if (p->klen > 0 && p->klen != strlen(p->key))
+			return 1;
+		if (p->vlen > 0 && p->vlen != strlen(p->value))
+			return 1;
+	}
+
+	return 0;
+}
+
 // compares la with lb. Return will be 0 if all properties are the same and in
 // the same order.
 int log_cmp(log_t* la, log_t* lb)
@@ -310,6 +325,12 @@ int log_cmp(log_t* la, log_t* lb)
 	DEBUG_ASSERT(la != NULL);
 	DEBUG_ASSERT(lb != NULL);
 
+	log_scan_body(la);
+	log_scan_body(lb);
+
+	if (log_lens_cmp(la) != 0 || log_lens_cmp(lb) != 0)
+		return 1;
+
 	size_t wanta = snprintl(loga, bufsize, la);
 	size_t wantb = snprintl(logb, bufsize, lb);
 
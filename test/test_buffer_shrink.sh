@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/buffer_shrink.in"
+SCRIPT="$DIR/buffer_shrink.lua"
+OUT="$DIR/buffer_shrink.out"
+ERR="$DIR/buffer_shrink.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PID=
+
+source $DIR/helper.sh
+TESTS_SLEEP_MS=$(($TESTS_SLEEP * 1000))
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN
+	kill $PID 2> /dev/null
+	exit $CODE;
+}
+
+trap finish EXIT
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local warns = 0
+local function write_buf_bytes()
+	io.write(logd.stats().buf_bytes, ";")
+	io.flush() -- setvbuf default is line
+end
+function logd.on_log(logptr)
+	if logd.log_get(logptr, "level") == "WARN" then
+		write_buf_bytes()
+		warns = warns + 1
+		if warns == 2 then
+			-- no logs come after this one
+			local timer = uv.new_timer()
+			uv.timer_start(timer, $TESTS_SLEEP_MS * 3.5, 0, function ()
+				uv.close(timer)
+				write_buf_bytes()
+			end)
+		end
+	end
+end
+EOF
+
+touch $IN
+touch $OUT
+
+$LOGD_EXEC $SCRIPT -f $IN --buffer-shrink-delay $TESTS_SLEEP_MS \
+	2> $ERR 1> $OUT &
+PID=$!
+sleep $TESTS_SLEEP
+
+# a log longer than the initial buffer makes it grow
+printf "2018-05-12 12:51:28 ERROR	[thread1]	clazz	long: " >> $IN
+head -c $(( $LOGD_BUF_INIT_CAP * 2 )) /dev/zero | tr '\0' 'a' >> $IN
+echo "" >> $IN
+pushdata
+
+# the buffer stays big while long logs are recent
+pushdata
+
+# and shrinks back a couple of delays later, even if no more logs come
+sleep $(( $TESTS_SLEEP * 4 ))
+assert_file_content "$(( $LOGD_BUF_INIT_CAP * 4 ));$(( $LOGD_BUF_INIT_CAP * 4 ));$LOGD_BUF_INIT_CAP;" $OUT
+
+exit 0
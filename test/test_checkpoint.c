@@ -0,0 +1,109 @@
+#include <errno.h>
+#include <unistd.h>
+
+#include "../src/checkpoint.h"
+#include "test.h"
+
+static char dir[] = "/tmp/logd_test_checkpoint.XXXXXX";
+
+int test_checkpoint_path()
+{
+	/* test.h uses assertion arguments as format strings */
+	const char* expected1 = "/var/lib/logd/%2Fvar%2Flog%2Fapp.log.checkpoint";
+	const char* expected2 = "./a%252Fb.checkpoint";
+	const char* expected3 = "./a%2Fb.checkpoint";
+	char* path;
+
+	path = checkpoint_path("/var/lib/logd", "/var/log/app.log");
+	ASSERT_STR_EQ(path, expected1);
+	free(path);
+
+	/* escaping must not make two different inputs collide */
+	path = checkpoint_path(".", "a%2Fb");
+	ASSERT_STR_EQ(path, expected2);
+	free(path);
+
+	path = checkpoint_path(".", "a/b");
+	ASSERT_STR_EQ(path, expected3);
+	free(path);
+
+	return 0;
+}
+
+int test_checkpoint_save_load()
+{
+	checkpoint_t cp = {.dev = 2049, .ino = 18446744073709551615ULL,
+	  .offset = 21474836480LL};
+	checkpoint_t loaded = {0};
+	char* path = checkpoint_path(dir, "/var/log/app.log");
+
+	ASSERT_EQ(checkpoint_save(path, &cp), 0);
+	ASSERT_EQ(checkpoint_sync_dir(dir), 0);
+	ASSERT_EQ(checkpoint_load(path, &loaded), 0);
+	ASSERT_EQ(loaded.dev, cp.dev);
+	ASSERT_EQ(loaded.ino, cp.ino);
+	ASSERT_EQ(loaded.offset, cp.offset);
+
+	/* saving again replaces the previous checkpoint */
+	cp.offset = 7;
+	ASSERT_EQ(checkpoint_save(path, &cp), 0);
+	ASSERT_EQ(checkpoint_load(path, &loaded), 0);
+	ASSERT_EQ(loaded.offset, 7);
+
+	unlink(path);
+	free(path);
+
+	return 0;
+}
+
+int test_checkpoint_load_missing()
+{
+	checkpoint_t cp;
+	char* path = checkpoint_path(dir, "missing");
+
+	ASSERT_EQ(checkpoint_load(path, &cp), 1);
+	ASSERT_EQ(errno, ENOENT);
+
+	free(path);
+
+	return 0;
+}
+
+int test_checkpoint_load_corrupted()
+{
+	checkpoint_t cp;
+	char* path = checkpoint_path(dir, "corrupted");
+	FILE* f = fopen(path, "w");
+
+	ASSERT_NEQ(f, NULL);
+	fputs("12 garbage", f);
+	fclose(f);
+
+	ASSERT_EQ(checkpoint_load(path, &cp), 1);
+	ASSERT_EQ(errno, EINVAL);
+
+	unlink(path);
+	free(path);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	TEST_RUN(ctx, test_checkpoint_path);
+	TEST_RUN(ctx, test_checkpoint_save_load);
+	TEST_RUN(ctx, test_checkpoint_load_missing);
+	TEST_RUN(ctx, test_checkpoint_load_corrupted);
+
+	rmdir(dir);
+
+	TEST_RELEASE(ctx);
+}
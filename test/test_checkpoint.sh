@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/checkpoint.in"
+CHECKPOINT_DIR="$DIR/checkpoint.d"
+SCRIPT="$DIR/checkpoint.lua"
+OUT="$DIR/checkpoint.out"
+ERR="$DIR/checkpoint.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PID=
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN
+	rm -rf $CHECKPOINT_DIR
+	kill $PID 2> /dev/null
+	exit $CODE;
+}
+
+trap finish EXIT
+
+function makescript() {
+	cat >$SCRIPT << EOF
+local logd = require("logd")
+function logd.on_log(logptr)
+	if logd.log_get(logptr, "level") == "$1" then
+		logd.ack()
+	end
+	io.write("log")
+	io.flush() -- setvbuf default is line
+end
+EOF
+}
+
+# ERROR is marked and only acked after the WARN that follows it, if at all
+function makescript_unordered() {
+	cat >$SCRIPT << EOF
+local logd = require("logd")
+local mark
+function logd.on_log(logptr)
+	if logd.log_get(logptr, "level") == "ERROR" then
+		mark = logd.mark()
+	else
+		logd.ack()
+		if "$1" == "late" then
+			logd.ack(mark)
+		end
+	end
+	io.write("log")
+	io.flush() -- setvbuf default is line
+end
+EOF
+}
+
+function start() {
+	truncate -s 0 $OUT
+	$LOGD_EXEC $SCRIPT -f $IN --checkpoint-dir $CHECKPOINT_DIR \
+		--checkpoint-interval 100 $@ 2> $ERR 1> $OUT &
+	PID=$!
+	sleep $TESTS_SLEEP
+}
+
+function stop() {
+	kill -s INT $PID
+	wait $PID 2> /dev/null
+}
+
+mkdir -p $CHECKPOINT_DIR
+touch $IN
+makescript ERROR
+
+# first run follows from the end like tail -f
+pushdata
+start
+assert_file_content "" $OUT
+pushdata
+assert_file_content "loglog" $OUT
+stop
+
+# data written while logd was down is not lost nor replayed
+pushdata
+start
+assert_file_content "loglog" $OUT
+stop
+
+# with manual acks only acked logs are checkpointed:
+# ERROR is acked and WARN right after it is not
+start --manual-ack
+assert_file_content "" $OUT
+pushdata
+assert_file_content "loglog" $OUT
+stop
+
+start
+assert_file_content "log" $OUT
+stop
+
+# acks may come out of order, but the checkpoint never moves past a log that
+# was not acked: WARN is acked while the ERROR before it is not
+makescript_unordered never
+start --manual-ack
+pushdata
+assert_file_content "loglog" $OUT
+stop
+
+# so both are read again, and acking ERROR after WARN commits both
+makescript_unordered late
+start --manual-ack
+assert_file_content "loglog" $OUT
+stop
+
+makescript ERROR
+start
+assert_file_content "" $OUT
+stop
+
+exit 0
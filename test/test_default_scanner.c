@@ -152,6 +152,84 @@ int test_scan_partial2()
 	return 0;
 }
 
+int test_scan_split()
+{
+	scan_res_t res;
+	scanner_t* p = (scanner_t*)scanner_create();
+	static const size_t CASES_LEN = 5;
+	struct tcase CASES[CASES_LEN];
+	CASES[0] = (struct tcase){LOG2, LEN2, &EXPECTED2};
+	CASES[1] = (struct tcase){LOG3, LEN3, &EXPECTED3};
+	CASES[2] = (struct tcase){LOG4, LEN4, &EXPECTED4};
+	CASES[3] = (struct tcase){LOG5, LEN5, &EXPECTED5};
+	CASES[4] = (struct tcase){LOG7, LEN7, &EXPECTED7};
+	char* buf;
+	size_t i;
+
+	/* resuming must not depend on where a chunk ends within keys, values
+	 * or in the delimiters between them */
+	for (int c = 0; c < CASES_LEN; c++) {
+		struct tcase test = CASES[c];
+		buf = malloc(test.ilen);
+		for (i = 1; i < test.ilen; i++) {
+			memcpy(buf, test.input, test.ilen);
+			res = scanner_scan(p, buf, i);
+			ASSERT_EQ(res.type, SCAN_PARTIAL);
+			ASSERT_EQ(res.consumed, i);
+
+			res = scanner_scan(p, buf + i, test.ilen - i);
+			ASSERT_EQ(res.type, SCAN_COMPLETE);
+			ASSERT_EQ(res.consumed, test.ilen - i);
+			ASSERT_LOG_EQ(res.log, test.expected);
+			/* and neither does the length of what was split */
+			ASSERT_EQ(log_get_prop(res.log, KEY_LEVEL)->vlen,
+			  strlen(log_get(res.log, KEY_LEVEL)));
+			ASSERT_EQ(log_get_prop(res.log, KEY_LEVEL)->kid, KEY_ID_LEVEL);
+			scanner_reset(p);
+		}
+		free(buf);
+	}
+
+	scanner_free(p);
+
+	return 0;
+}
+
+int test_scan_rebase()
+{
+	scan_res_t res;
+	scanner_t* p = (scanner_t*)scanner_create();
+	char* buf = malloc(LEN8);
+	char* moved;
+	size_t i, len, step = 13;
+
+	memcpy(buf, LOG8, LEN8);
+
+	/* the data is moved after every partial scan like when an input buffer
+	 * is compacted or grown, and scanning resumes on the moved data */
+	for (i = 0;; i += step) {
+		len = LEN8 - i < step ? LEN8 - i : step;
+		res = scanner_scan(p, buf + i, len);
+		if (res.type != SCAN_PARTIAL)
+			break;
+		ASSERT_EQ(res.consumed, len);
+
+		moved = malloc(LEN8);
+		memcpy(moved, buf, LEN8);
+		scanner_rebase(p, buf, i + len, (intptr_t)moved - (intptr_t)buf);
+		free(buf);
+		buf = moved;
+	}
+
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	ASSERT_LOG_EQ(res.log, &EXPECTED8);
+
+	scanner_free(p);
+	free(buf);
+
+	return 0;
+}
+
 int test_scan_partial1()
 {
 
@@ -343,6 +421,169 @@ int test_scan_multiple()
 	return 0;
 }
 
+int test_scan_batch()
+{
+	scanner_t* p = (scanner_t*)scanner_create();
+	scan_batch_t* batch = malloc(sizeof(scan_batch_t));
+	static const size_t CASES_LEN = 4;
+	struct tcase CASES[CASES_LEN];
+	CASES[0] = (struct tcase){LOG3, LEN3, &EXPECTED3};
+	CASES[1] = (struct tcase){LOG2, LEN2, &EXPECTED2};
+	CASES[2] = (struct tcase){LOG4, LEN4, &EXPECTED4};
+	CASES[3] = (struct tcase){LOG5, LEN5, &EXPECTED5};
+	size_t len = LEN3 + LEN2 + LEN4 + LEN5 + LEN7;
+	char* buf = malloc(len);
+	char* chunk = buf;
+	scan_res_t res;
+	size_t i, n;
+
+	for (i = 0; i < CASES_LEN; i++) {
+		memcpy(chunk, CASES[i].input, CASES[i].ilen);
+		chunk += CASES[i].ilen;
+	}
+	memcpy(chunk, LOG7, LEN7);
+
+	/* the first log was started by scanner_scan and the last one is not
+	 * complete yet */
+	res = scanner_scan(p, buf, 10);
+	ASSERT_EQ(res.type, SCAN_PARTIAL);
+	chunk = buf + 10;
+	n = scanner_scan_batch(p, chunk, len - 10 - LEN7 + LEN7 / 2, batch);
+	ASSERT_EQ(n, CASES_LEN + 1);
+
+	for (i = 0; i < CASES_LEN; i++) {
+		ASSERT_EQ(batch->res[i].type, SCAN_COMPLETE);
+		ASSERT_EQ(batch->res[i].consumed, CASES[i].ilen - (i == 0 ? 10 : 0));
+		ASSERT_LOG_EQ(batch->res[i].log, CASES[i].expected);
+		chunk += batch->res[i].consumed;
+	}
+
+	res = batch->res[CASES_LEN];
+	ASSERT_EQ(res.type, SCAN_PARTIAL);
+	ASSERT_EQ(res.consumed, LEN7 / 2);
+
+	/* and it can be resumed one call at a time */
+	res = scanner_scan(p, chunk + res.consumed, LEN7 - res.consumed);
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	ASSERT_LOG_EQ(res.log, &EXPECTED7);
+	scanner_reset(p);
+
+	free(buf);
+
+	/* a full batch leaves the rest of the data for the next one */
+	len = (LOGD_SCAN_BATCH_CAP + 1) * LEN5;
+	buf = malloc(len);
+	for (i = 0; i <= LOGD_SCAN_BATCH_CAP; i++)
+		memcpy(buf + i * LEN5, LOG5, LEN5);
+
+	n = scanner_scan_batch(p, buf, len, batch);
+	ASSERT_EQ(n, LOGD_SCAN_BATCH_CAP);
+	for (i = 0; i < n; i++) {
+		ASSERT_EQ(batch->res[i].type, SCAN_COMPLETE);
+		ASSERT_LOG_EQ(batch->res[i].log, &EXPECTED5);
+	}
+
+	n = scanner_scan_batch(p, buf + len - LEN5, LEN5, batch);
+	ASSERT_EQ(n, 2);
+	ASSERT_EQ(batch->res[0].type, SCAN_COMPLETE);
+	ASSERT_LOG_EQ(batch->res[0].log, &EXPECTED5);
+	ASSERT_EQ(batch->res[1].type, SCAN_PARTIAL);
+	ASSERT_EQ(batch->res[1].consumed, 0);
+
+	free(buf);
+	free(batch);
+	scanner_free(p);
+
+	return 0;
+}
+
+int test_scan_lazy()
+{
+	scanner_t* p = (scanner_t*)scanner_create();
+	scan_batch_t* batch = malloc(sizeof(scan_batch_t));
+	static const size_t CASES_LEN = 5;
+	struct tcase CASES[CASES_LEN];
+	CASES[0] = (struct tcase){LOG2, LEN2, &EXPECTED2};
+	CASES[1] = (struct tcase){LOG3, LEN3, &EXPECTED3};
+	CASES[2] = (struct tcase){LOG4, LEN4, &EXPECTED4};
+	CASES[3] = (struct tcase){LOG5, LEN5, &EXPECTED5};
+	CASES[4] = (struct tcase){LOG7, LEN7, &EXPECTED7};
+	prop_t prop;
+	scan_res_t res;
+	char* buf;
+	size_t i, n, len;
+
+	scanner_set_lazy(p, true);
+
+	/* the header is there right away and the body only once needed */
+	buf = malloc(LEN1);
+	memcpy(buf, LOG1, LEN1);
+	res = scanner_scan(p, buf, LEN1);
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	ASSERT_EQ(res.consumed, LEN1);
+	ASSERT_STR_EQ(log_get(res.log, KEY_LEVEL), "DEBUG");
+	ASSERT_STR_EQ(log_get(res.log, KEY_CLASS), "control.RaptorHandler");
+	ASSERT_NEQ(res.log->body, NULL);
+	ASSERT_EQ(buf[LEN1 - 1], '\n');
+	ASSERT_STR_EQ(log_get(res.log, "flow"), "Publish");
+	ASSERT_EQ(res.log->body, NULL);
+	ASSERT_LOG_EQ(res.log, &EXPECTED1);
+	scanner_reset(p);
+
+	/* props set before the body is scanned are still found first */
+	memcpy(buf, LOG1, LEN1);
+	res = scanner_scan(p, buf, LEN1);
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	log_set(res.log, &prop, "flow", "Subscribe");
+	ASSERT_STR_EQ(log_get(res.log, "flow"), "Subscribe");
+	ASSERT_STR_EQ(log_get(res.log, "step"), "Attempt");
+	ASSERT_EQ(log_size(res.log), log_size(&EXPECTED1) + 1);
+	scanner_reset(p);
+	free(buf);
+
+	/* the body can be split anywhere */
+	for (int c = 0; c < CASES_LEN; c++) {
+		struct tcase test = CASES[c];
+		buf = malloc(test.ilen);
+		for (i = 1; i < test.ilen; i++) {
+			memcpy(buf, test.input, test.ilen);
+			res = scanner_scan(p, buf, i);
+			ASSERT_EQ(res.type, SCAN_PARTIAL);
+
+			res = scanner_scan(p, buf + i, test.ilen - i);
+			ASSERT_EQ(res.type, SCAN_COMPLETE);
+			ASSERT_EQ(res.consumed, test.ilen - i);
+			ASSERT_LOG_EQ(res.log, test.expected);
+			scanner_reset(p);
+		}
+		free(buf);
+	}
+
+	/* and the bodies of a batch go with their logs */
+	len = 0;
+	for (i = 0; i < CASES_LEN; i++)
+		len += CASES[i].ilen;
+	buf = malloc(len);
+	for (i = 0, len = 0; i < CASES_LEN; i++) {
+		memcpy(buf + len, CASES[i].input, CASES[i].ilen);
+		len += CASES[i].ilen;
+	}
+
+	n = scanner_scan_batch(p, buf, len, batch);
+	ASSERT_EQ(n, CASES_LEN + 1);
+	for (i = 0; i < CASES_LEN; i++) {
+		ASSERT_EQ(batch->res[i].type, SCAN_COMPLETE);
+		ASSERT_LOG_EQ(batch->res[i].log, CASES[i].expected);
+	}
+	ASSERT_EQ(batch->res[CASES_LEN].type, SCAN_PARTIAL);
+
+	free(buf);
+	free(batch);
+	scanner_free(p);
+
+	return 0;
+}
+
 int test_scan_reset()
 {
 	scanner_t* p = (scanner_t*)scanner_create();
@@ -378,7 +619,11 @@ int main(int argc, char* argv[])
 	TEST_RUN(ctx, test_scan_reset);
 	TEST_RUN(ctx, test_scan_partial1);
 	TEST_RUN(ctx, test_scan_partial2);
+	TEST_RUN(ctx, test_scan_split);
+	TEST_RUN(ctx, test_scan_rebase);
 	TEST_RUN(ctx, test_scan_multiple);
+	TEST_RUN(ctx, test_scan_batch);
+	TEST_RUN(ctx, test_scan_lazy);
 	TEST_RUN(ctx, test_scan_error);
 
 	TEST_RELEASE(ctx);
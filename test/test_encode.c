@@ -0,0 +1,141 @@
+#include "../src/encode.h"
+#include "test.h"
+
+#define ASSERT_ENCODED(encode, b, log, expected)                               \
+	do {                                                                       \
+		size_t len;                                                            \
+		char* str = encode(b, log, &len);                                      \
+		ASSERT_NEQ(str, NULL);                                                 \
+		ASSERT_EQ(len, sizeof(expected) - 1);                                  \
+		ASSERT_MEM_EQ(str, expected, len);                                     \
+	} while (0)
+
+int test_encode_json()
+{
+	encode_buf_t b;
+	prop_t props[4];
+	log_t log;
+
+	encode_buf_init(&b);
+	log_init(&log);
+	ASSERT_ENCODED(encode_json, &b, &log, "{}");
+
+	log_set(&log, &props[0], "a", "A");
+	ASSERT_ENCODED(encode_json, &b, &log, "{\"a\":\"A\"}");
+
+	log_set(&log, &props[1], "q\"k", "line\n\ttab \\ \x01");
+	ASSERT_ENCODED(encode_json, &b, &log,
+	  "{\"q\\\"k\":\"line\\n\\ttab \\\\ \\u0001\",\"a\":\"A\"}");
+
+	/* keys set twice are written once with their latest value */
+	log_set(&log, &props[2], "a", "B");
+	log_set(&log, &props[3], "n", NULL);
+	ASSERT_ENCODED(encode_json, &b, &log,
+	  "{\"n\":null,\"a\":\"B\",\"q\\\"k\":\"line\\n\\ttab \\\\ \\u0001\"}");
+
+	encode_buf_free(&b);
+	return 0;
+}
+
+int test_encode_logfmt()
+{
+	encode_buf_t b;
+	prop_t props[4];
+	log_t log;
+
+	encode_buf_init(&b);
+	log_init(&log);
+	ASSERT_ENCODED(encode_logfmt, &b, &log, "");
+
+	log_set(&log, &props[0], "a", "A");
+	log_set(&log, &props[1], "b", "");
+	log_set(&log, &props[2], "c d", "x=\"y\"\n");
+	log_set(&log, &props[3], "n", NULL);
+	ASSERT_ENCODED(encode_logfmt, &b, &log,
+	  "n=null c_d=\"x=\\\"y\\\"\\n\" b=\"\" a=A");
+
+	encode_buf_free(&b);
+	return 0;
+}
+
+int test_encode_msgpack()
+{
+	char value[300];
+	char keys[20][4];
+	encode_buf_t b;
+	prop_t props[20];
+	log_t log;
+	size_t len;
+	char* str;
+	int i;
+
+	encode_buf_init(&b);
+	log_init(&log);
+	ASSERT_ENCODED(encode_msgpack, &b, &log, "\x80");
+
+	log_set(&log, &props[0], "a", "A");
+	log_set(&log, &props[1], "n", NULL);
+	ASSERT_ENCODED(encode_msgpack, &b, &log, "\x82\xa1n\xc0\xa1" "a\xa1" "A");
+
+	/* strings of more than 255 bytes take a 16 bit length */
+	memset(value, 'v', sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+	log_init(&log);
+	log_set(&log, &props[0], "n", value);
+	str = encode_msgpack(&b, &log, &len);
+	ASSERT_NEQ(str, NULL);
+	ASSERT_EQ(len, 1 + 2 + 3 + sizeof(value) - 1);
+	ASSERT_MEM_EQ(str, "\x81\xa1n\xda\x01\x2b", 6);
+	ASSERT_MEM_EQ(str + 6, value, sizeof(value) - 1);
+
+	/* and maps of more than 15 pairs a 16 bit size */
+	log_init(&log);
+	for (i = 0; i < 20; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+		log_set(&log, &props[i], keys[i], "");
+	}
+	str = encode_msgpack(&b, &log, &len);
+	ASSERT_NEQ(str, NULL);
+	ASSERT_MEM_EQ(str, "\xde\x00\x14\xa3k19\xa0", 8);
+
+	encode_buf_free(&b);
+	return 0;
+}
+
+int test_encode_str()
+{
+	encode_buf_t b;
+	prop_t props[2];
+	char expected[64];
+	log_t log;
+	size_t len;
+	char* str;
+	int want;
+
+	encode_buf_init(&b);
+	log_init(&log);
+	log_set(&log, &props[0], KEY_LEVEL, "INFO");
+	log_set(&log, &props[1], "a", "A");
+
+	want = snprintl(expected, sizeof(expected), &log);
+	str = encode_str(&b, &log, &len);
+	ASSERT_NEQ(str, NULL);
+	ASSERT_EQ(len, want);
+	ASSERT_MEM_EQ(str, expected, len);
+
+	encode_buf_free(&b);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	TEST_RUN(ctx, test_encode_json);
+	TEST_RUN(ctx, test_encode_logfmt);
+	TEST_RUN(ctx, test_encode_msgpack);
+	TEST_RUN(ctx, test_encode_str);
+
+	TEST_RELEASE(ctx);
+}
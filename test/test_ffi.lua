@@ -0,0 +1,53 @@
+local lunit = require('lunit')
+local logd = require('logd')
+local logdffi = require('logd.ffi')
+
+module("test_ffi", lunit.testcase, package.seeall)
+
+local sample_log = {
+	a = "a",
+	date = "b",
+	thread = "myThread",
+}
+
+function test_ffi_get()
+	local log = logdffi.log(logd.to_logptr(sample_log))
+
+	for k, v in pairs(sample_log) do
+		lunit.assert_equal(v, logdffi.get(log, k))
+	end
+	lunit.assert_equal(nil, logdffi.get(log, "missing"))
+	lunit.assert_equal(nil, logdffi.find(log, "missing"))
+end
+
+function test_ffi_props()
+	local ptr = logd.to_logptr(sample_log)
+	local log = logdffi.log(ptr)
+	local n = 0
+
+	-- same properties as to_table, level and time included
+	for prop in logdffi.props(log) do
+		local key = logdffi.key(prop)
+		lunit.assert_equal(logd.log_get(ptr, key), logdffi.value(prop))
+		lunit.assert_true(logdffi.key_eq(prop, key))
+		lunit.assert_true(logdffi.value_eq(prop, logdffi.value(prop)))
+		lunit.assert_false(logdffi.key_eq(prop, key .. "x"))
+		n = n + 1
+	end
+
+	local t = logd.to_table(ptr)
+	for _ in pairs(t) do
+		n = n - 1
+	end
+	lunit.assert_equal(0, n)
+end
+
+function test_ffi_lengths()
+	local ptr = logd.to_logptr({})
+	logd.log_set(ptr, "a", "b\0c")
+	local log = logdffi.log(ptr)
+
+	lunit.assert_equal("b\0c", logdffi.get(log, "a"))
+	lunit.assert_true(logdffi.value_eq(logdffi.find(log, "a"), "b\0c"))
+	lunit.assert_false(logdffi.value_eq(logdffi.find(log, "a"), "b"))
+end
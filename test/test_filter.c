@@ -0,0 +1,102 @@
+#include "../src/filter.h"
+#include "../src/keys.h"
+#include "test.h"
+
+#define ASSERT_FILTER(log, expr, expected)                                     \
+	do {                                                                       \
+		filter_t* f = filter_compile(expr);                                    \
+		ASSERT_NEQ(f, NULL);                                                   \
+		ASSERT_EQ(filter_match(f, log), expected);                             \
+		filter_free(f);                                                        \
+	} while (0)
+
+static void init_test_log(log_t* log, prop_t* props)
+{
+	log_init(log);
+	log_set(log, &props[0], KEY_LEVEL, "ERROR");
+	log_set(log, &props[1], KEY_CLASS, "com.acme.Main");
+	log_set(log, &props[2], "flow", "Publish order");
+}
+
+int test_filter_compile_error()
+{
+	ASSERT_EQ(filter_compile(""), NULL);
+	ASSERT_EQ(filter_compile("level ="), NULL);
+	ASSERT_EQ(filter_compile("level = ERROR and"), NULL);
+	ASSERT_EQ(filter_compile("(level = ERROR"), NULL);
+	ASSERT_EQ(filter_compile("level = ERROR)"), NULL);
+	ASSERT_EQ(filter_compile("level in ERROR"), NULL);
+	ASSERT_EQ(filter_compile("level in (ERROR"), NULL);
+	ASSERT_EQ(filter_compile("level = 'ERROR"), NULL);
+	ASSERT_EQ(filter_compile("level ~ '(ERROR'"), NULL);
+
+	return 0;
+}
+
+int test_filter_ops()
+{
+	prop_t props[3];
+	log_t log;
+
+	init_test_log(&log, props);
+
+	ASSERT_FILTER(&log, "level", true);
+	ASSERT_FILTER(&log, "thread", false);
+	ASSERT_FILTER(&log, "level = ERROR", true);
+	ASSERT_FILTER(&log, "level=ERRO", false);
+	ASSERT_FILTER(&log, "level != ERROR", false);
+	ASSERT_FILTER(&log, "level!=INFO", true);
+	ASSERT_FILTER(&log, "class ^= com.acme", true);
+	ASSERT_FILTER(&log, "class ^= org", false);
+	ASSERT_FILTER(&log, "class ~ 'Main$'", true);
+	ASSERT_FILTER(&log, "class ~ '^acme'", false);
+	ASSERT_FILTER(&log, "level in (WARN, ERROR)", true);
+	ASSERT_FILTER(&log, "level in (WARN,INFO)", false);
+
+	/* quoted keys and values can have spaces and operators in them */
+	ASSERT_FILTER(&log, "flow = 'Publish order'", true);
+	ASSERT_FILTER(&log, "\"flow\" = \"Publish order\"", true);
+	ASSERT_FILTER(&log, "flow ^= 'Publish o'", true);
+
+	/* logs without the property only pass != */
+	ASSERT_FILTER(&log, "thread = main", false);
+	ASSERT_FILTER(&log, "thread != main", true);
+	ASSERT_FILTER(&log, "thread in (main)", false);
+
+	return 0;
+}
+
+int test_filter_logic()
+{
+	prop_t props[3];
+	log_t log;
+
+	init_test_log(&log, props);
+
+	ASSERT_FILTER(&log, "level = ERROR and class ^= com", true);
+	ASSERT_FILTER(&log, "level = ERROR and class ^= org", false);
+	ASSERT_FILTER(&log, "level = INFO or class ^= com", true);
+	ASSERT_FILTER(&log, "not level = INFO", true);
+	ASSERT_FILTER(&log, "not not level = INFO", false);
+
+	/* and binds tighter than or, which parentheses can change */
+	ASSERT_FILTER(&log, "level = INFO and thread or flow", true);
+	ASSERT_FILTER(&log, "level = INFO and (thread or flow)", false);
+	ASSERT_FILTER(&log, "not (level = INFO or level = WARN)", true);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	TEST_RUN(ctx, test_filter_compile_error);
+	TEST_RUN(ctx, test_filter_ops);
+	TEST_RUN(ctx, test_filter_logic);
+
+	keys_free();
+
+	TEST_RELEASE(ctx);
+}
@@ -0,0 +1,199 @@
+#include "../src/format.h"
+#include "test.h"
+
+#define DEFAULT_FORMAT "%date %time\\t%level\\t[%thread]\\t%class\\t%kv"
+
+#define LOG1                                                                   \
+	"2017-09-07 14:54:39,474	DEBUG	[pool-5-thread-6]	"                  \
+	"control.RaptorHandler	flow: Publish, step: Attempt,  empty:,"            \
+	"traceId: Publish:Rumor:012ae1a5\n"
+#define LOG2                                                                   \
+	"2017-04-19 18:01:11,437     INFO  [Test worker]    "                      \
+	"core.InstrumentationListener	i do not want to log anything special "    \
+	"here\n"
+#define LOG3 "2018-06-05 13:12:12,852	 INFO	[]	v2.ArchiveResource	\n"
+#define LOG4 "2018-06-05 13:12:12,852	 INFO	[main\n"
+#define LOG5 "2018-06-05 13:12:12,852	 INFO	main	a: b\n"
+
+static format_t* f;
+static log_t expected;
+static prop_t props[16];
+
+static void expect_header(const char* date, const char* time,
+  const char* level, const char* thread, const char* clazz)
+{
+	log_init(&expected);
+	log_set(&expected, &props[0], "date", date);
+	log_set(&expected, &props[1], "time", time);
+	log_set(&expected, &props[2], "level", level);
+	log_set(&expected, &props[3], "thread", thread);
+	log_set(&expected, &props[4], "class", clazz);
+}
+
+/* scans log split in two chunks at split, or at once if split is 0 */
+static scan_res_t scan(void* p, char* buf, const char* log, size_t split)
+{
+	scan_res_t res;
+	size_t len = strlen(log);
+
+	memcpy(buf, log, len);
+	format_scanner_reset(p);
+
+	if (split > 0) {
+		res = format_scanner_scan(p, buf, split);
+		if (res.type != SCAN_PARTIAL || res.consumed != split)
+			return res;
+	}
+
+	res = format_scanner_scan(p, buf + split, len - split);
+	res.consumed += split;
+
+	return res;
+}
+
+int test_format_compile()
+{
+	/* test.h uses assertion arguments as format strings */
+	static const char* invalid[] = {"", "%", "%date%time", "%kv %date",
+	  "%date\n", "%date\\n"};
+	static const char* valid = "%%%date [%level] %msg";
+	format_t* g;
+	size_t i;
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+		ASSERT_EQ(format_compile(invalid[i]), NULL);
+
+	ASSERT_NEQ((g = format_compile(valid)), NULL);
+	format_free(g);
+
+	return 0;
+}
+
+int test_format_scan()
+{
+	void* p = format_scanner_create(f);
+	char buf[256];
+	scan_res_t res;
+	size_t i;
+
+	expect_header("2017-09-07", "14:54:39,474", "DEBUG", "pool-5-thread-6",
+	  "control.RaptorHandler");
+	log_set(&expected, &props[5], "flow", "Publish");
+	log_set(&expected, &props[6], "step", "Attempt");
+	log_set(&expected, &props[7], "empty", "");
+	log_set(&expected, &props[8], "traceId", "Publish:Rumor:012ae1a5");
+
+	/* resuming must not depend on where a chunk ends */
+	for (i = 0; i < strlen(LOG1); i++) {
+		res = scan(p, buf, LOG1, i);
+		ASSERT_EQ(res.type, SCAN_COMPLETE);
+		ASSERT_EQ(res.consumed, strlen(LOG1));
+		ASSERT_LOG_EQ(res.log, &expected);
+	}
+
+	format_scanner_free(p);
+
+	return 0;
+}
+
+int test_format_scan_message()
+{
+	void* p = format_scanner_create(f);
+	char buf[256];
+	scan_res_t res;
+	size_t i;
+
+	expect_header("2017-04-19", "18:01:11,437", "INFO", "Test worker",
+	  "core.InstrumentationListener");
+	log_set(&expected, &props[5], "msg",
+	  "i do not want to log anything special here");
+
+	for (i = 0; i < strlen(LOG2); i++) {
+		res = scan(p, buf, LOG2, i);
+		ASSERT_EQ(res.type, SCAN_COMPLETE);
+		ASSERT_LOG_EQ(res.log, &expected);
+	}
+
+	/* empty fields and no properties */
+	expect_header(
+	  "2018-06-05", "13:12:12,852", "INFO", "", "v2.ArchiveResource");
+
+	for (i = 0; i < strlen(LOG3); i++) {
+		res = scan(p, buf, LOG3, i);
+		ASSERT_EQ(res.type, SCAN_COMPLETE);
+		ASSERT_LOG_EQ(res.log, &expected);
+	}
+
+	format_scanner_free(p);
+
+	return 0;
+}
+
+int test_format_scan_error()
+{
+	void* p = format_scanner_create(f);
+	char buf[256];
+	scan_res_t res;
+
+	res = scan(p, buf, LOG4, 0);
+	ASSERT_EQ(res.type, SCAN_ERROR);
+	ASSERT_EQ(res.consumed, strlen(LOG4));
+	ASSERT_STR_EQ(res.error.msg, "incomplete header");
+
+	res = scan(p, buf, LOG5, 0);
+	ASSERT_EQ(res.type, SCAN_ERROR);
+	ASSERT_EQ(res.consumed, strlen(LOG5));
+	ASSERT_STR_EQ(res.error.msg, "invalid log header");
+	ASSERT_STR_EQ(res.error.at, "main	a: b");
+
+	format_scanner_free(p);
+
+	return 0;
+}
+
+int test_format_scan_custom()
+{
+	static const char* spec = "%%%level|%code|  %msg";
+	static const char* log1 = "%WARN||disk: 91%, full\n";
+	static const char* log2 = "WARN||disk: 91%, full\n";
+	format_t* g = format_compile(spec);
+	void* p = format_scanner_create(g);
+	char buf[256];
+	scan_res_t res;
+
+	log_init(&expected);
+	log_set(&expected, &props[0], "level", "WARN");
+	log_set(&expected, &props[1], "code", "");
+	log_set(&expected, &props[2], "msg", "disk: 91%, full");
+
+	res = scan(p, buf, log1, 0);
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	ASSERT_LOG_EQ(res.log, &expected);
+
+	res = scan(p, buf, log2, 0);
+	ASSERT_EQ(res.type, SCAN_ERROR);
+
+	format_scanner_free(p);
+	format_free(g);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	if ((f = format_compile(DEFAULT_FORMAT)) == NULL)
+		return EXIT_FAILURE;
+
+	TEST_RUN(ctx, test_format_compile);
+	TEST_RUN(ctx, test_format_scan);
+	TEST_RUN(ctx, test_format_scan_message);
+	TEST_RUN(ctx, test_format_scan_error);
+	TEST_RUN(ctx, test_format_scan_custom);
+
+	format_free(f);
+
+	TEST_RELEASE(ctx);
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/from_start.in"
+SCRIPT="$DIR/from_start.lua"
+OUT="$DIR/from_start.out"
+ERR="$DIR/from_start.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PID=
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN
+	kill $PID
+	exit $CODE;
+}
+
+trap finish EXIT
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+function logd.on_log(logptr)
+	io.write("log")
+	io.flush() -- setvbuf default is line
+end
+EOF
+
+touch $OUT
+touch $IN
+
+# existing content is backfilled
+pushdata
+printf "2018-05-12 12:51:28 ERROR	[thread1]	clazz	a: A, " >> $IN
+
+$LOGD_EXEC $SCRIPT --from-start -f $IN 2> $ERR 1> $OUT &
+PID=$!
+sleep $TESTS_SLEEP
+
+assert_file_content "loglog" $OUT
+
+# trailing partial log is completed by the follower
+echo "" >> $IN
+sleep $TESTS_SLEEP
+assert_file_content "logloglog" $OUT
+
+pushdata
+assert_file_content "logloglogloglog" $OUT
+
+kill $PID
+wait $PID 2> /dev/null
+
+# backfill from the offset of the last log
+truncate -s 0 $OUT
+OFFSET=$(( $(wc -c < $IN) - $(tail -n 1 $IN | wc -c) ))
+$LOGD_EXEC $SCRIPT --from-offset $OFFSET -f $IN 2> $ERR 1> $OUT &
+PID=$!
+sleep $TESTS_SLEEP
+
+assert_file_content "log" $OUT
+
+kill $PID
+wait $PID 2> /dev/null
+
+# backfilling a file many times larger than a slice only keeps about a slice
+# of it resident
+if [[ "Linux" == $(uname) ]]; then
+	LINES=65536
+	yes "2018-05-12 12:51:28 INFO	[thread]	clazz	pad: $(head -c 1000 \
+		/dev/zero | tr '\0' 'a')" | head -n $LINES > $IN
+	cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+	if counter == $LINES then
+		for line in io.lines("/proc/self/status") do
+			local hwm = string.match(line, "^VmHWM:%s*(%d+)")
+			if hwm ~= nil then
+				io.write(hwm)
+			end
+		end
+		io.flush()
+		os.exit(0)
+	end
+end
+EOF
+	truncate -s 0 $OUT
+	$LOGD_EXEC $SCRIPT --from-start -f $IN 2> $ERR 1> $OUT
+	HWM=$(cat $OUT)
+	if [[ "$HWM" == "" || $HWM -gt $(( 40 * 1024 )) ]]; then
+		echo "peak RSS of $HWM kB backfilling $(wc -c < $IN) bytes"
+		exit 1
+	fi
+fi
+
+exit 0
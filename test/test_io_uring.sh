@@ -0,0 +1,77 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/io_uring.in"
+SCRIPT="$DIR/io_uring.lua"
+OUT="$DIR/io_uring.out"
+ERR="$DIR/io_uring.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=50
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $OUT $ERR $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $OUT
+touch $ERR
+touch $IN
+push_file
+LOGS=$(wc -l < $IN)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+end
+function logd.on_error()
+	counter = counter + 1
+end
+function logd.on_exit(code, reason)
+	assert(string.match(reason, 'EOF'));
+	io.write(counter)
+	io.flush()
+end
+EOF
+
+# same result with or without io_uring, which falls back to poll when the
+# kernel does not support it
+cat $IN | $LOGD_EXEC $SCRIPT --io-uring 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+# logs are scanned where the kernel read them and the ones cut across reads
+# are completed in the input buffer, in order either way
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local expected = 1
+function logd.on_log(logptr)
+	if tonumber(logd.log_get(logptr, "n")) ~= expected then
+		expected = -1
+	elseif expected > 0 then
+		expected = expected + 1
+	end
+end
+function logd.on_exit(code, reason)
+	io.write(expected - 1)
+	io.flush()
+end
+EOF
+
+truncate -s 0 $OUT
+perl -e '
+	$| = 1;
+	for my $i (1 .. 200) {
+		my $log = "2018-05-12 12:51:28 INFO\t[thread]\tclazz\tn: $i, \n";
+		my $half = int(length($log) / 2);
+		print substr($log, 0, $half);
+		select(undef, undef, undef, 0.001) if $i % 20 == 0;
+		print substr($log, $half);
+	}' | $LOGD_EXEC $SCRIPT --io-uring 2> $ERR 1> $OUT
+assert_file_content "200" $OUT
+
+exit 0
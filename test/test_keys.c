@@ -0,0 +1,61 @@
+#include "../src/keys.h"
+#include "test.h"
+
+int test_keys_static()
+{
+	size_t len;
+
+	/* the keys of log.h are there from the start with their ids */
+	ASSERT_EQ(keys_id(KEY_DATE, strlen(KEY_DATE)), KEY_ID_DATE);
+	ASSERT_EQ(keys_id(KEY_MESSAGE, strlen(KEY_MESSAGE)), KEY_ID_MESSAGE);
+	ASSERT_EQ(keys_id(KEY_CALLTYPE, strlen(KEY_CALLTYPE)), KEY_ID_CALLTYPE);
+	ASSERT_STR_EQ(keys_name(KEY_ID_LEVEL, &len), KEY_LEVEL);
+	ASSERT_EQ(len, strlen(KEY_LEVEL));
+
+	return 0;
+}
+
+int test_keys_id()
+{
+	char key[16];
+	uint32_t id, i;
+	size_t len;
+
+	id = keys_id("flow: Publish", 4);
+	ASSERT_NEQ(id, KEY_ID_NONE);
+	ASSERT_NEQ(id, KEY_ID_UNINTERNED);
+	ASSERT_EQ(keys_id("flow", 4), id);
+	ASSERT_STR_EQ(keys_name(id, &len), "flow");
+	ASSERT_EQ(len, 4);
+
+	/* keys are told apart by all of their bytes */
+	ASSERT_NEQ(keys_id("flow\0a", 6), id);
+	ASSERT_NEQ(keys_id("flow\0a", 6), keys_id("flow\0b", 6));
+
+	/* until there is no room left */
+	for (i = 0; i < KEYS_CAP; i++) {
+		len = snprintf(key, sizeof(key), "k%u", i);
+		id = keys_id(key, len);
+	}
+	ASSERT_EQ(id, KEY_ID_UNINTERNED);
+	ASSERT_NEQ(keys_id("flow", 4), KEY_ID_UNINTERNED);
+	ASSERT_EQ(keys_id(key, KEYS_MAX_LEN + 1), KEY_ID_UNINTERNED);
+
+	keys_free();
+	ASSERT_EQ(keys_id(KEY_DATE, strlen(KEY_DATE)), KEY_ID_DATE);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	TEST_RUN(ctx, test_keys_static);
+	TEST_RUN(ctx, test_keys_id);
+
+	keys_free();
+
+	TEST_RELEASE(ctx);
+}
@@ -1,5 +1,6 @@
 #include <errno.h>
 
+#include "../src/keys.h"
 #include "../src/log.h"
 #include "test.h"
 
@@ -46,6 +47,7 @@ int test_log_get()
 int test_log_set()
 {
 	log_t log;
+	log_init(&log);
 
 	prop_t* prop = malloc(sizeof(prop_t));
 
@@ -131,6 +133,132 @@ int test_log_remove()
 	return 0;
 }
 
+int test_log_index()
+{
+	static const int PROPS_LEN = 100;
+	log_index_t index;
+	prop_t props[PROPS_LEN + 2];
+	char keys[PROPS_LEN][8];
+	char values[PROPS_LEN][8];
+	prop_t* removed;
+	log_t log;
+	int i;
+
+	log_init(&log);
+	log_set_index(&log, &index);
+	for (i = 0; i < PROPS_LEN; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+		snprintf(values[i], sizeof(values[i]), "v%d", i);
+		log_set(&log, &props[i], keys[i], values[i]);
+	}
+
+	/* the index is built by the first lookup */
+	ASSERT_EQ(log_indexed(&log), true);
+	for (i = 0; i < PROPS_LEN; i++)
+		ASSERT_STR_EQ(log_get(&log, keys[i]), values[i]);
+	ASSERT_EQ(log_get(&log, "k100"), NULL);
+
+	/* props set later hide the ones with the same key until removed */
+	log_set(&log, &props[PROPS_LEN], "k7", "seven");
+	ASSERT_STR_EQ(log_get(&log, "k7"), "seven");
+	ASSERT_EQ(log_remove(&log, "k7"), &props[PROPS_LEN]);
+	ASSERT_STR_EQ(log_get(&log, "k7"), "v7");
+
+	/* removing from the middle of probe sequences keeps the rest found */
+	for (i = 0; i < PROPS_LEN; i += 2) {
+		removed = log_remove(&log, keys[i]);
+		ASSERT_EQ(removed, &props[i]);
+	}
+	for (i = 0; i < PROPS_LEN; i++) {
+		if (i % 2 == 0) {
+			ASSERT_EQ(log_get(&log, keys[i]), NULL);
+		} else {
+			ASSERT_STR_EQ(log_get(&log, keys[i]), values[i]);
+		}
+	}
+	ASSERT_EQ(log_size(&log), PROPS_LEN / 2);
+
+	/* props changed in place are found once reindexed */
+	props[1].key = "changed";
+	props[1].klen = 0;
+	log_reindex(&log);
+	ASSERT_STR_EQ(log_get(&log, "changed"), "v1");
+	ASSERT_EQ(log_get(&log, "k1"), NULL);
+
+	/* recorded key lengths are kept, so keys with NULs in them are found */
+	log_init(&log);
+	log_set_index(&log, &index);
+	for (i = 0; i < PROPS_LEN; i++)
+		log_set(&log, &props[i], keys[i], values[i]);
+	props[PROPS_LEN].key = "nul\0key";
+	props[PROPS_LEN].value = "v";
+	props[PROPS_LEN].klen = 7;
+	props[PROPS_LEN].vlen = 0;
+	props[PROPS_LEN].kid = KEY_ID_NONE;
+	props[PROPS_LEN].next = log.props;
+	log.props = &props[PROPS_LEN];
+	log_reindex(&log);
+	ASSERT_EQ(log_indexed(&log), true);
+	ASSERT_EQ(props[PROPS_LEN].klen, 7);
+	ASSERT_EQ(log_get_id(&log, 44, "nul\0key", 7), &props[PROPS_LEN]);
+	ASSERT_EQ(log_get_id(&log, 45, "nul", 3), NULL);
+
+	/* small logs are not indexed */
+	log_init(&log);
+	log_set_index(&log, &index);
+	log_set(&log, &props[0], "A", "a");
+	ASSERT_EQ(log_indexed(&log), false);
+	ASSERT_STR_EQ(log_get(&log, "A"), "a");
+
+	return 0;
+}
+
+int test_log_value_len()
+{
+	static const char value[] = "a\0b";
+	prop_t props[2];
+	log_t log;
+
+	log_init(&log);
+	log_set(&log, &props[0], "A", "abc");
+	log_set(&log, &props[1], "B", value);
+
+	/* values are counted unless their length was recorded */
+	ASSERT_EQ(log_value_len(&props[0]), 3);
+	ASSERT_EQ(log_value_len(&props[1]), 1);
+	props[1].vlen = sizeof(value) - 1;
+	ASSERT_EQ(log_value_len(log_get_prop(&log, "B")), 3);
+	ASSERT_EQ(log_key_len(&props[1]), 1);
+
+	return 0;
+}
+
+int test_log_get_id()
+{
+	prop_t props[3];
+	log_t log;
+
+	log_init(&log);
+	log_set(&log, &props[0], "flow", "Publish");
+	log_set(&log, &props[1], "step", "Attempt");
+	log_set(&log, &props[2], KEY_LEVEL, "INFO");
+	props[2].kid = KEY_ID_LEVEL;
+
+	/* props without an id are compared by key and remember the id */
+	ASSERT_EQ(log_get_id(&log, 42, "flow", 4), &props[0]);
+	ASSERT_EQ(props[0].kid, 42);
+	ASSERT_EQ(props[1].kid, KEY_ID_NONE);
+	ASSERT_EQ(log_get_id(&log, KEY_ID_LEVEL, KEY_LEVEL, 5), &props[2]);
+	ASSERT_EQ(log_get_id(&log, 43, "thread", 6), NULL);
+
+	/* ids of keys that change are forgotten */
+	log_init(&log);
+	log_set(&log, &props[0], "other", "Publish");
+	ASSERT_EQ(props[0].kid, KEY_ID_NONE);
+
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	test_ctx_t ctx;
@@ -141,6 +269,9 @@ int main(int argc, char* argv[])
 	TEST_RUN(ctx, test_log_set);
 	TEST_RUN(ctx, test_log_remove);
 	TEST_RUN(ctx, test_log_size);
+	TEST_RUN(ctx, test_log_index);
+	TEST_RUN(ctx, test_log_value_len);
+	TEST_RUN(ctx, test_log_get_id);
 
 	TEST_RELEASE(ctx);
 }
@@ -69,3 +69,74 @@ function test_logd_log_to_table()
 	local clone = logd.to_logptr(logd.to_table(ptr))
 	assert_sample_log(clone)
 end
+
+function test_logd_log_get_interned_keys()
+	-- keys are looked up by id from the second time on, in any log
+	for i = 1, 3 do
+		local ptr = logd.to_logptr(sample_log)
+		assert_sample_log(ptr)
+		lunit.assert_equal(nil, logd.log_get(ptr, "missing"))
+		local t = logd.to_table(ptr)
+		lunit.assert_equal("myThread", t.thread)
+		lunit.assert_equal("a", t.a)
+	end
+end
+
+function test_logd_log_set_nul()
+	local ptr = logd.to_logptr({})
+	logd.log_set(ptr, "a", "b\0c")
+	lunit.assert_equal("b\0c", logd.log_get(ptr, "a"))
+	lunit.assert_equal("b\0c", logd.to_table(ptr).a)
+end
+
+function test_logd_logptr_index()
+	local ptr = logd.to_logptr(sample_log)
+	lunit.assert_equal("a", ptr.a)
+	lunit.assert_equal("myThread", ptr["thread"])
+	lunit.assert_equal(nil, ptr.missing)
+	-- level and time are added by logd.to_logptr
+	lunit.assert_equal(6, #ptr)
+	local clone = logd.log_clone(ptr)
+	lunit.assert_equal("myCallType", clone.callType)
+	lunit.assert_equal(#ptr, #clone)
+end
+
+function test_logd_log_pairs()
+	local ptr = logd.to_logptr(sample_log)
+	local n = 0
+	for k, v in logd.log_pairs(ptr) do
+		lunit.assert_equal(logd.log_get(ptr, k), v)
+		n = n + 1
+	end
+	lunit.assert_equal(#ptr, n)
+	logd.log_reset(ptr)
+	for k, v in logd.log_pairs(ptr) do
+		lunit.fail("log was reset")
+	end
+end
+
+function test_logd_log_to_json()
+	-- without the level, time and date added by logd.to_logptr
+	local ptr = logd.to_logptr({})
+	logd.log_reset(ptr)
+	logd.log_set(ptr, "a", "b\"\n")
+	logd.log_set(ptr, "c", "d")
+	lunit.assert_equal('{"c":"d","a":"b\\"\\n"}', logd.to_json(ptr))
+	logd.log_set(ptr, "c", "e")
+	lunit.assert_equal('{"c":"e","a":"b\\"\\n"}', logd.to_json(ptr))
+end
+
+function test_logd_log_to_logfmt()
+	local ptr = logd.to_logptr({})
+	logd.log_reset(ptr)
+	logd.log_set(ptr, "a", "b c")
+	logd.log_set(ptr, "d", "e")
+	lunit.assert_equal('d=e a="b c"', logd.to_logfmt(ptr))
+end
+
+function test_logd_log_to_msgpack()
+	local ptr = logd.to_logptr({})
+	logd.log_reset(ptr)
+	logd.log_set(ptr, "a", "b")
+	lunit.assert_equal("\129\161a\161b", logd.to_msgpack(ptr))
+end
@@ -0,0 +1,96 @@
+#include <unistd.h>
+
+#include "../src/mirror.h"
+#include "test.h"
+
+#ifdef LOGD_MIRROR
+
+static void fill(char* p, size_t len, int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = (char)(seed + i * 7);
+}
+
+static int check(const char* p, size_t len, int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (p[i] != (char)(seed + i * 7))
+			return 1;
+	}
+
+	return 0;
+}
+
+int test_mirror_wrap()
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	mirror_t m;
+
+	ASSERT_EQ(mirror_init(&m, 1), 0);
+	ASSERT_EQ(m.cap, pg);
+
+	/* writes past the end of the ring land at its beginning */
+	fill(m.base + m.cap - 10, 20, 1);
+	ASSERT_EQ(check(m.base + m.cap - 10, 20, 1), 0);
+	ASSERT_MEM_EQ(m.base, m.base + m.cap, 10);
+
+	mirror_free(&m);
+
+	return 0;
+}
+
+int test_mirror_grow()
+{
+	size_t pg = sysconf(_SC_PAGESIZE);
+	size_t cap, start;
+	char* data;
+	mirror_t m;
+
+	ASSERT_EQ(mirror_init(&m, 2 * pg), 0);
+
+	/* a full ring whose data wraps around in the middle of a page */
+	start = m.cap - pg / 2 - 3;
+	data = m.base + start;
+	fill(data, m.cap, 2);
+
+	cap = m.cap;
+	ASSERT_NEQ((data = mirror_grow(&m, data, cap, 1)), NULL);
+	ASSERT_EQ(m.cap, cap + pg);
+	ASSERT_EQ(check(data, cap, 2), 0);
+
+	/* new room right after the data does not overwrite it */
+	fill(data + cap, m.cap - cap, 3);
+	ASSERT_EQ(check(data, cap, 2), 0);
+	ASSERT_EQ(check(data + cap, m.cap - cap, 3), 0);
+
+	/* again with data that does not fill the ring */
+	data += 5;
+	cap = m.cap;
+	ASSERT_NEQ((data = mirror_grow(&m, data, cap - 5, 3 * pg)), NULL);
+	ASSERT_EQ(m.cap, cap + 3 * pg);
+	ASSERT_EQ(check(data, cap - pg - 5, 2 + 5 * 7), 0);
+	ASSERT_EQ(check(data + cap - pg - 5, pg, 3), 0);
+
+	mirror_free(&m);
+
+	return 0;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+#ifdef LOGD_MIRROR
+	TEST_RUN(ctx, test_mirror_wrap);
+	TEST_RUN(ctx, test_mirror_grow);
+#endif
+
+	TEST_RELEASE(ctx);
+}
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN_DIR="$DIR/multi_input.d"
+IN_A="$IN_DIR/a.log"
+IN_B="$IN_DIR/b.log"
+IN_C="$IN_DIR/c.log"
+IN_OTHER="$DIR/multi_input_other.in"
+SCRIPT="$DIR/multi_input.lua"
+OUT="$DIR/multi_input.out"
+ERR="$DIR/multi_input.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PID=
+SIGUSR2=12
+
+if [[ "Darwin" == $(uname) ]]; then
+	SIGUSR2=31
+fi
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN_OTHER
+	rm -rf $IN_DIR
+	kill $PID
+	exit $CODE;
+}
+
+trap finish EXIT
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+function logd.on_log(logptr, source)
+	io.write(string.match(source, "([^/]+)$"), ";")
+	io.flush() -- setvbuf default is line
+end
+EOF
+
+mkdir -p $IN_DIR
+touch $OUT
+touch $IN_A
+touch $IN_B
+touch $IN_OTHER
+
+$LOGD_EXEC $SCRIPT -f "$IN_DIR/*.log" -f $IN_OTHER 2> $ERR 1> $OUT &
+PID=$!
+sleep $TESTS_SLEEP
+
+IN=$IN_A pushdata
+assert_file_content "a.log;a.log;" $OUT
+
+IN=$IN_OTHER pushdata
+assert_file_content "a.log;a.log;multi_input_other.in;multi_input_other.in;" $OUT
+
+IN=$IN_B pushdata
+assert_file_content "a.log;a.log;multi_input_other.in;multi_input_other.in;b.log;b.log;" $OUT
+
+# new files matching a pattern are picked up on SIGUSR2
+truncate -s 0 $OUT
+touch $IN_C
+kill -s $SIGUSR2 $PID
+sleep $TESTS_SLEEP
+
+IN=$IN_C pushdata
+assert_file_content "c.log;c.log;" $OUT
+
+IN=$IN_A pushdata
+assert_file_content "c.log;c.log;a.log;a.log;" $OUT
+
+exit 0
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/on_logs.in"
+SCRIPT="$DIR/on_logs.lua"
+OUT="$DIR/on_logs.out"
+ERR="$DIR/on_logs.err"
+LOGD_EXEC="$DIR/../bin/logd"
+LOGS=1000
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $OUT $ERR $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $OUT
+touch $ERR
+touch $IN
+
+for i in $(seq 1 $LOGS); do
+	echo "2018-05-12 12:51:28 INFO	[thread]	clazz	seq: $i" >> $IN
+done
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+local calls = 0
+function logd.on_log(logptr)
+	error("on_log must not be called if on_logs is defined")
+end
+function logd.on_logs(logptrs, n, source)
+	assert(n > 0 and logptrs[n + 1] == nil)
+	assert(source == "/dev/stdin")
+	for i = 1, n do
+		counter = counter + 1
+		assert(logd.log_get(logptrs[i], "seq") == tostring(counter))
+	end
+	calls = calls + 1
+end
+function logd.on_exit(code, reason)
+	-- logs read at once are handled together
+	assert(calls < counter)
+	io.write(counter)
+	io.flush()
+end
+EOF
+
+cat $IN | $LOGD_EXEC $SCRIPT 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+# backfilled logs are handed over in batches too
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+local calls = 0
+function logd.on_log(logptr)
+	error("on_log must not be called if on_logs is defined")
+end
+function logd.on_logs(logptrs, n, source)
+	assert(source == "$IN")
+	counter = counter + n
+	calls = calls + 1
+	if counter == $LOGS then
+		assert(calls < counter)
+		io.write(counter)
+		io.flush()
+		os.exit(0)
+	end
+end
+EOF
+
+truncate -s 0 $OUT
+$LOGD_EXEC $SCRIPT --from-start -f $IN 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+exit 0
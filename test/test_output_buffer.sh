@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/output_buffer.in"
+SCRIPT="$DIR/output_buffer.lua"
+SOCK_SCRIPT="$DIR/output_buffer_sock.lua"
+OUT="$DIR/output_buffer.out"
+ERR="$DIR/output_buffer.err"
+LOGD_EXEC="$DIR/../bin/logd"
+LOGS=1000
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $SOCK_SCRIPT $OUT $ERR $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+
+for i in $(seq 1 $LOGS); do
+	echo "2018-05-12 12:51:28 INFO	[thread]	clazz	seq: $i" >> $IN
+done
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+function logd.on_log(logptr)
+	logd.print(logptr)
+end
+function logd.on_exit(code, reason)
+	local stats = logd.stats()
+	io.stderr:write(stats.output_drops)
+	io.stderr:flush()
+end
+EOF
+
+# all lines make it through a buffer smaller than the output, in order
+cat $IN | $LOGD_EXEC $SCRIPT --output-buffer=4096 2> $ERR 1> $OUT
+assert_file_content "$LOGS" <(wc -l < $OUT)
+assert_file_content "0" $ERR
+if [ "$(grep -o 'seq: [0-9]*' $OUT | cut -d' ' -f2 | sort -nc 2>&1)" != "" ]; then
+	echo "lines are out of order"
+	exit 1
+fi
+
+# lines that can never fit are dropped
+for policy in drop-newest drop-oldest; do
+	cat $IN | $LOGD_EXEC $SCRIPT --output-buffer=16 \
+		--output-overflow=$policy 2> $ERR 1> $OUT
+	assert_file_content "" $OUT
+	assert_file_content "$LOGS" $ERR
+done
+
+cat >$SOCK_SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_log(logptr)
+	logd.print(logptr)
+	counter = counter + 1
+	if counter == $LOGS then
+		io.stderr:write("done ")
+		io.stderr:flush()
+	end
+end
+function logd.on_exit(code, reason)
+	io.stderr:write(logd.stats().output_drops)
+	io.stderr:flush()
+end
+EOF
+
+# a socket whose consumer stops reading does not stall logd: it handles all
+# logs while nothing is read, and what was not dropped is read once the
+# consumer reads again
+perl -MSocket -MPOSIX=:sys_wait_h -e '
+	my ($in, $err, @cmd) = @ARGV;
+	socketpair(my $logd, my $consumer, AF_UNIX, SOCK_STREAM, PF_UNSPEC)
+		or die "socketpair: $!";
+	setsockopt($logd, SOL_SOCKET, SO_SNDBUF, 4096);
+	setsockopt($consumer, SOL_SOCKET, SO_RCVBUF, 4096);
+	my $pid = fork();
+	if ($pid == 0) {
+		close($consumer);
+		open(STDIN, "<", $in) or die "open: $!";
+		open(STDOUT, ">&", $logd) or die "dup: $!";
+		open(STDERR, ">", $err) or die "open: $!";
+		exec(@cmd) or die "exec: $!";
+	}
+	close($logd);
+	for (my $i = 0; $i < 100; $i++) {
+		last if -s $err;
+		select(undef, undef, undef, 0.1);
+	}
+	if (!-s $err) {
+		kill("KILL", $pid);
+		print STDERR "logd stalled on a socket that is not read\n";
+		exit 1;
+	}
+	my $lines = 0;
+	$lines++ while <$consumer>;
+	waitpid($pid, 0);
+	print "$lines\n";
+' $IN $ERR $LOGD_EXEC $SOCK_SCRIPT --output-buffer=4096 \
+	--output-overflow=drop-newest > $OUT
+assert_file_content "done" <(cut -d' ' -f1 $ERR)
+assert_file_content "$LOGS" <(echo $(( $(cat $OUT) + $(cut -d' ' -f2 $ERR) )))
+
+exit 0
@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/oversize.in"
+SCRIPT="$DIR/oversize.lua"
+OUT="$DIR/oversize.out"
+ERR="$DIR/oversize.err"
+SPILL_DIR="$DIR/oversize.d"
+LOGD_EXEC="$DIR/../bin/logd"
+LONG=$(( $LOGD_BUF_MAX_CAP * 2 ))
+TRUNCATE=1000
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN
+	rm -rf $SPILL_DIR
+	exit $CODE;
+}
+
+trap finish EXIT
+
+mkdir -p $SPILL_DIR
+touch $OUT
+touch $ERR
+
+PREFIX="2018-05-12 12:51:28 ERROR	[thread1]	clazz	callType: long: "
+printf "$PREFIX" > $IN
+head -c $LONG /dev/zero | tr '\0' 'a' >> $IN
+echo "" >> $IN
+echo "2018-05-12 12:52:22 WARN	[thread2]	clazz	callType: b: B" >> $IN
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+function logd.on_log(logptr)
+	local level = logd.log_get(logptr, "level")
+	local truncated = logd.log_get(logptr, "truncated")
+	local spill = logd.log_get(logptr, "spill")
+	io.write(level)
+	if truncated ~= nil then
+		-- the header is intact and the value is cut short
+		assert(logd.log_get(logptr, "thread") == "thread1")
+		local len = string.len(logd.log_get(logptr, "long"))
+		assert(len > 0 and len < $LONG)
+		-- exactly the first $TRUNCATE bytes of the line are kept
+		if len == $TRUNCATE - ${#PREFIX} then
+			io.write(":short")
+		end
+		io.write(":truncated")
+		if spill ~= nil then
+			-- and the whole line is in the spill file
+			local f = assert(io.open(spill, "r"))
+			local spilled = f:read("*a")
+			f:close()
+			os.remove(spill)
+			local line = assert(io.open("$IN", "r")):read("*l")
+			assert(spilled == line, string.format(
+				"%d bytes were spilled out of %d", #spilled, #line))
+			io.write(":spilled")
+		end
+	end
+	io.write(";")
+end
+function logd.on_error(err, logptr, at)
+	io.write(logd.log_get(logptr, "level"), ":skipped;")
+end
+EOF
+
+# the default drops the log with an error
+cat $IN | $LOGD_EXEC $SCRIPT 2> $ERR 1> $OUT
+assert_file_content "ERROR:skipped;WARN;" $OUT
+
+truncate -s 0 $OUT
+cat $IN | $LOGD_EXEC $SCRIPT --oversize truncate 2> $ERR 1> $OUT
+assert_file_content "ERROR:truncated;WARN;" $OUT
+
+# a lazy scan has to keep what is left of the body too
+for flags in "" "--pipeline" "--lazy"; do
+	truncate -s 0 $OUT
+	cat $IN | $LOGD_EXEC $SCRIPT --oversize truncate \
+		--truncate-bytes $TRUNCATE $flags 2> $ERR 1> $OUT
+	assert_file_content "ERROR:short:truncated;WARN;" $OUT
+done
+
+# the cut cannot be past the largest buffer
+if $LOGD_EXEC $SCRIPT --truncate-bytes $(( $LOGD_BUF_MAX_CAP + 1 )) \
+	< /dev/null 2> $ERR; then
+	echo "--truncate-bytes past the max buffer size was accepted"
+	exit 1
+fi
+
+truncate -s 0 $OUT
+cat $IN | $LOGD_EXEC $SCRIPT --oversize spill --spill-dir $SPILL_DIR \
+	2> $ERR 1> $OUT
+assert_file_content "ERROR:truncated:spilled;WARN;" $OUT
+
+truncate -s 0 $OUT
+cat $IN | $LOGD_EXEC $SCRIPT --oversize spill --spill-dir $SPILL_DIR --lazy \
+	2> $ERR 1> $OUT
+assert_file_content "ERROR:truncated:spilled;WARN;" $OUT
+
+exit 0
@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/pipeline.in"
+SCRIPT="$DIR/pipeline.lua"
+OUT="$DIR/pipeline.out"
+ERR="$DIR/pipeline.err"
+LOGD_EXEC="$DIR/../bin/logd"
+LOGS=10000
+PUSH_FILE_ITER=50
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $OUT $ERR $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $OUT
+touch $ERR
+touch $IN
+
+for i in $(seq 1 $LOGS); do
+	echo "2018-05-12 12:51:28 INFO	[thread]	clazz	seq: $i, " >> $IN
+done
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+	assert(logd.log_get(logptr, "seq") == tostring(counter))
+end
+function logd.on_exit(code, reason)
+	assert(string.match(reason, 'EOF'));
+	io.write(counter)
+	io.flush()
+end
+EOF
+
+# logs scanned on the reader thread reach lua in order
+cat $IN | $LOGD_EXEC $SCRIPT --pipeline 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_logs(logptrs, n)
+	for i = 1, n do
+		counter = counter + 1
+		assert(logd.log_get(logptrs[i], "seq") == tostring(counter))
+	end
+end
+function logd.on_exit(code, reason)
+	io.write(counter)
+	io.flush()
+end
+EOF
+
+cat $IN | $LOGD_EXEC $SCRIPT --pipeline 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+# errors are handed to lua in between logs just the same
+rm -f $IN
+touch $IN
+push_file
+LOGS=$(wc -l < $IN)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+end
+function logd.on_error()
+	counter = counter + 1
+end
+function logd.on_exit(code, reason)
+	io.write(counter)
+	io.flush()
+end
+EOF
+
+cat $IN | $LOGD_EXEC $SCRIPT --pipeline 2> $ERR 1> $OUT
+assert_file_content "$LOGS" $OUT
+
+exit 0
@@ -167,6 +167,88 @@ int test_scan_partial2()
 	return 0;
 }
 
+/* nested values long enough to be skipped in blocks, with brackets and
+ * escapes within strings and escaped backslashes across blocks */
+#define PAYLOAD                                                                \
+	"{\"a\": \"}}{{\\\"\\\\\", \"b\": [1, 2, {\"c\": \"]\"}], \"d\": {\"e\": " \
+	"\"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\\\\\\\\\"}, " \
+	"\"f\": {}, \"g\": \"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\\\"\"}"
+#define LIST                                                                   \
+	"[[\"[\", \"\\\\\"], {\"x\": 1}, "                                         \
+	"\"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\"]"
+#define LOG_NESTED                                                             \
+	"{\"level\": \"INFO\", \"payload\": " PAYLOAD ", \"list\": " LIST          \
+	", \"msg\": \"done\"}"
+#define LEN_NESTED strlen(LOG_NESTED)
+
+int test_scan_nested()
+{
+	scan_res_t res;
+	prop_scanner_t* p = scanner_create();
+	char* buf = malloc(LEN_NESTED);
+	size_t i;
+
+	/* i == 0 scans the whole log at once */
+	for (i = 0; i < LEN_NESTED; i++) {
+		memcpy(buf, LOG_NESTED, LEN_NESTED);
+		if (i > 0) {
+			res = scanner_scan(p, buf, i);
+			ASSERT_EQ(res.type, SCAN_PARTIAL);
+			ASSERT_EQ(res.consumed, i);
+		}
+
+		res = scanner_scan(p, buf + i, LEN_NESTED - i);
+		ASSERT_EQ(res.type, SCAN_COMPLETE);
+		ASSERT_EQ(res.consumed, LEN_NESTED - i);
+		ASSERT_EQ(log_size(res.log), 4);
+		ASSERT_STR_EQ(log_get(res.log, "level"), "INFO");
+		ASSERT_STR_EQ(log_get(res.log, "payload"), PAYLOAD);
+		ASSERT_STR_EQ(log_get(res.log, "list"), LIST);
+		ASSERT_STR_EQ(log_get(res.log, "msg"), "done");
+		scanner_reset(p);
+	}
+
+	scanner_free(p);
+	free(buf);
+
+	return 0;
+}
+
+int test_scan_rebase()
+{
+	scan_res_t res;
+	prop_scanner_t* p = scanner_create();
+	char* buf = malloc(LEN8);
+	char* moved;
+	size_t i, len, step = 13;
+
+	memcpy(buf, LOG8, LEN8);
+
+	/* the data is moved after every partial scan like when an input buffer
+	 * is compacted or grown, and scanning resumes on the moved data */
+	for (i = 0;; i += step) {
+		len = LEN8 - i < step ? LEN8 - i : step;
+		res = scanner_scan(p, buf + i, len);
+		if (res.type != SCAN_PARTIAL)
+			break;
+		ASSERT_EQ(res.consumed, len);
+
+		moved = malloc(LEN8);
+		memcpy(moved, buf, LEN8);
+		scanner_rebase(p, buf, i + len, (intptr_t)moved - (intptr_t)buf);
+		free(buf);
+		buf = moved;
+	}
+
+	ASSERT_EQ(res.type, SCAN_COMPLETE);
+	ASSERT_LOG_EQ(res.log, &EXPECTED8);
+
+	scanner_free(p);
+	free(buf);
+
+	return 0;
+}
+
 int test_scan_partial1()
 {
 
@@ -327,6 +409,8 @@ int main(int argc, char* argv[])
 	TEST_RUN(ctx, test_scanner_create);
 	TEST_RUN(ctx, test_scan_partial1);
 	TEST_RUN(ctx, test_scan_partial2);
+	TEST_RUN(ctx, test_scan_nested);
+	TEST_RUN(ctx, test_scan_rebase);
 	TEST_RUN(ctx, test_scan_reset);
 	TEST_RUN(ctx, test_scan_multiple);
 	TEST_RUN(ctx, test_scan_error);
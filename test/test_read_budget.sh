@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/read_budget.in"
+DATA="$DIR/read_budget.data"
+SCRIPT="$DIR/read_budget.lua"
+OUT="$DIR/read_budget.out"
+ERR="$DIR/read_budget.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=50
+PID=
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT
+	rm -f $OUT
+	rm -f $ERR
+	rm -f $IN
+	rm -f $DATA
+	kill $PID 2> /dev/null
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $IN
+touch $DATA
+IN_BAK=$IN
+IN=$DATA
+push_file
+IN=$IN_BAK
+LOGS=$(wc -l < $DATA)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local expected = $LOGS
+local counter = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+	if counter == expected then
+		local stats = logd.stats()
+		io.write("done")
+		if stats.read_budget_exhausted > 0 and stats.read_calls > 1 then
+			io.write(";yielded")
+		end
+		io.flush() -- setvbuf default is line
+	end
+end
+function logd.on_error()
+	logd.on_log()
+end
+EOF
+
+touch $OUT
+
+# a budget of one small read per wakeup still consumes all the data
+$LOGD_EXEC $SCRIPT -f $IN --read-budget-bytes 1 --read-budget-reads 1 \
+	2> $ERR 1> $OUT &
+PID=$!
+sleep $TESTS_SLEEP
+
+cat $DATA >> $IN
+sleep $TESTS_SLEEP
+assert_file_content "done;yielded" $OUT
+
+exit 0
@@ -0,0 +1,59 @@
+#!/usr/bin/env bash
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+IN="$DIR/ring_buffer.in"
+SCRIPT="$DIR/ring_buffer.lua"
+OUT="$DIR/ring_buffer.out"
+ERR="$DIR/ring_buffer.err"
+LOGD_EXEC="$DIR/../bin/logd"
+PUSH_FILE_ITER=200
+
+source $DIR/helper.sh
+
+function finish {
+	CODE=$?
+	rm -f $SCRIPT $OUT $ERR $IN
+	exit $CODE;
+}
+
+trap finish EXIT
+
+touch $OUT
+touch $ERR
+touch $IN
+
+# enough logs to wrap around the ring many times
+push_file
+
+# and a log longer than the initial ring so that it has to grow
+LONG=$(( $LOGD_BUF_INIT_CAP * 2 ))
+printf "2018-05-12 12:51:28 ERROR	[thread1]	clazz	long: " >> $IN
+head -c $LONG /dev/zero | tr '\0' 'a' >> $IN
+echo "" >> $IN
+push_file
+
+LOGS=$(wc -l < $IN)
+
+cat >$SCRIPT << EOF
+local logd = require("logd")
+local counter = 0
+local long = 0
+function logd.on_log(logptr)
+	counter = counter + 1
+	local value = logd.log_get(logptr, "long")
+	if value ~= nil and string.len(value) == $LONG then
+		long = long + 1
+	end
+end
+function logd.on_error()
+	counter = counter + 1
+end
+function logd.on_exit(code, reason)
+	io.write(counter, ";", long)
+	io.flush()
+end
+EOF
+
+cat $IN | $LOGD_EXEC $SCRIPT --ring-buffer 2> $ERR 1> $OUT
+assert_file_content "$LOGS;1" $OUT
+
+exit 0
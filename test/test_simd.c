@@ -0,0 +1,161 @@
+#include "../src/simd.h"
+#include "test.h"
+
+#define LEN 256
+
+static const char set[4] = {'\n', ':', ',', '\x00'};
+
+static size_t find4(const char* s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == '\n' || s[i] == ':' || s[i] == ',' || s[i] == '\x00')
+			break;
+	}
+
+	return i;
+}
+
+int test_simd_find4_none()
+{
+	char buf[LEN + 32];
+	size_t off, len;
+
+	memset(buf, 'a', sizeof(buf));
+
+	/* every alignment and every tail length */
+	for (off = 0; off < 32; off++) {
+		for (len = 0; len <= LEN; len++)
+			ASSERT_EQ(simd_find4(buf + off, len, set), len);
+	}
+
+	return 0;
+}
+
+int test_simd_find4()
+{
+	char buf[LEN + 32];
+	size_t off, at, i;
+
+	for (i = 0; i < sizeof(set); i++) {
+		for (off = 0; off < 32; off++) {
+			for (at = 0; at < LEN; at++) {
+				memset(buf, 'a', sizeof(buf));
+				buf[off + at] = set[i];
+				/* bytes after the first match must not matter */
+				buf[off + LEN - 1] = set[(i + 1) % sizeof(set)];
+				ASSERT_EQ(simd_find4(buf + off, LEN, set), at);
+				ASSERT_EQ(simd_find4(buf + off, at, set), at);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int test_simd_find4_random()
+{
+	char buf[LEN];
+	size_t off, i;
+
+	srand(1);
+	for (i = 0; i < 10000; i++) {
+		for (off = 0; off < LEN; off++)
+			buf[off] = (char)(rand() % 128 ? 'a' + rand() % 26 : rand());
+		off = rand() % LEN;
+		ASSERT_EQ(simd_find4(buf + off, LEN - off, set),
+		  find4(buf + off, LEN - off));
+	}
+
+	return 0;
+}
+
+/* the byte by byte rules of the scanners. Returns 1 if c has to be looked at
+ * by the scanner */
+static int json_step(simd_json_t* j, char c)
+{
+	if (c == '\n')
+		return 1;
+	if (j->esc) {
+		j->esc = 0;
+	} else if (j->str) {
+		if (c == '\\')
+			j->esc = 1;
+		else if (c == '"')
+			j->str = 0;
+	} else if (c == '\x00') {
+		return 1;
+	} else if (c == '{') {
+		j->nest++;
+	} else if (c == '}') {
+		if (j->nest == 0)
+			return 1;
+		j->nest--;
+	} else if (c == '"') {
+		j->str = 1;
+	}
+
+	return 0;
+}
+
+int test_simd_json_skip()
+{
+	static const char alphabet[] = "aaaaaaaaaa\"\"\\{{}}[]\n";
+	simd_json_t j, ref;
+	char buf[LEN * 2];
+	size_t i, k, skip;
+	int stopped;
+
+	srand(2);
+	for (i = 0; i < 100000; i++) {
+		for (k = 0; k < sizeof(buf); k++)
+			buf[k] = alphabet[rand() % (sizeof(alphabet) - 1)];
+		/* sparse newlines and NULs so that blocks are skipped too */
+		for (k = 0; k < sizeof(buf); k++) {
+			if (buf[k] == '\n' && rand() % 16)
+				buf[k] = 'a';
+		}
+		if (rand() % 8 == 0)
+			buf[rand() % sizeof(buf)] = '\x00';
+		if (rand() % 2) {
+			for (k = 0; k < sizeof(buf); k++) {
+				if (buf[k] == '\\' && rand() % 4)
+					buf[k] = 'a';
+			}
+		}
+
+		j.nest = ref.nest = rand() % 3;
+		j.str = ref.str = rand() % 2;
+		j.esc = ref.esc = j.str && rand() % 2;
+		skip = simd_json_skip(buf, sizeof(buf), '{', '}', &j);
+
+		for (k = 0, stopped = 0; k < skip && !stopped; k++)
+			stopped = json_step(&ref, buf[k]);
+
+		/* nothing that the scanner needs was skipped */
+		ASSERT_EQ(stopped, 0);
+		ASSERT_EQ(j.nest, ref.nest);
+		ASSERT_EQ(j.str, ref.str);
+		ASSERT_EQ(j.esc, ref.esc);
+
+		/* and it stops on whole blocks or where the scanner is needed */
+		if (skip % 64 != 0)
+			ASSERT_EQ(json_step(&ref, buf[skip]), 1);
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+	TEST_RUN(ctx, test_simd_find4_none);
+	TEST_RUN(ctx, test_simd_find4);
+	TEST_RUN(ctx, test_simd_find4_random);
+	TEST_RUN(ctx, test_simd_json_skip);
+
+	TEST_RELEASE(ctx);
+}
@@ -67,5 +67,11 @@ sleep $TESTS_SLEEP
 pushdata
 assert_file_content "loglogloglogloglog" $OUT
 
+# rotation by rename is followed without a reopen signal
+if [[ "Linux" == $(uname) ]]; then
+	mv $IN $IN_MOVED
+	pushdata
+	assert_file_content "loglogloglogloglogloglog" $OUT
+fi
 
 exit 0
@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/uring.h"
+#include "test.h"
+
+#ifdef LOGD_URING
+
+#define SLOT_LEN 4096
+#define STREAM_LEN (4 * 1024 * 1024)
+
+static int completions;
+
+static void on_reader_complete(uring_reader_t* reader) { completions++; }
+
+/* wait for the kernel to complete something and process it */
+static int wait_process(uring_t* ring)
+{
+	struct pollfd pfd = {.fd = uring_fd(ring), .events = POLLIN};
+
+	if (poll(&pfd, 1, 1000) != 1)
+		return 1;
+
+	return uring_process(ring);
+}
+
+int test_uring_reader_read()
+{
+	uring_t* ring = uring_create(4, SLOT_LEN);
+	uring_reader_t reader = {.cb = on_reader_complete};
+	char buf[16];
+	int fds[2];
+
+	ASSERT_NEQ(ring, NULL);
+	ASSERT_EQ(pipe(fds), 0);
+	ASSERT_EQ(uring_reader_start(ring, &reader, fds[0]), 0);
+
+	/* every buffer is read into by a chain of linked reads */
+	ASSERT_EQ(reader.inflight, 4);
+
+	/* nothing was written yet */
+	ASSERT_EQ(uring_reader_read(&reader, buf, sizeof(buf)), -1);
+	ASSERT_EQ(errno, EAGAIN);
+
+	completions = 0;
+	ASSERT_EQ(write(fds[1], "hello world", 11), 11);
+	ASSERT_EQ(wait_process(ring), 0);
+	ASSERT_EQ(completions, 1);
+
+	/* data is copied out in pieces as big as the caller asks for */
+	ASSERT_EQ(uring_reader_read(&reader, buf, 5), 5);
+	ASSERT_MEM_EQ(buf, "hello", 5);
+	ASSERT_EQ(uring_reader_read(&reader, buf, sizeof(buf)), 6);
+	ASSERT_MEM_EQ(buf, " world", 6);
+	ASSERT_EQ(uring_reader_read(&reader, buf, sizeof(buf)), -1);
+	ASSERT_EQ(errno, EAGAIN);
+
+	close(fds[1]);
+	ASSERT_EQ(wait_process(ring), 0);
+	ASSERT_EQ(uring_reader_read(&reader, buf, sizeof(buf)), 0);
+	ASSERT_EQ(uring_reader_read(&reader, buf, sizeof(buf)), 0);
+
+	uring_reader_stop(&reader);
+	close(fds[0]);
+	uring_free(ring);
+
+	return 0;
+}
+
+int test_uring_reader_peek()
+{
+	uring_t* ring = uring_create(4, SLOT_LEN);
+	uring_reader_t reader = {0};
+	char* data;
+	int fds[2];
+
+	ASSERT_NEQ(ring, NULL);
+	ASSERT_EQ(pipe(fds), 0);
+	ASSERT_EQ(uring_reader_start(ring, &reader, fds[0]), 0);
+
+	ASSERT_EQ(write(fds[1], "hello", 5), 5);
+	ASSERT_EQ(wait_process(ring), 0);
+
+	/* data stays where the kernel read it until it is acked */
+	ASSERT_EQ(uring_reader_peek(&reader, &data), 5);
+	ASSERT_MEM_EQ(data, "hello", 5);
+	ASSERT_EQ(uring_reader_peek(&reader, &data), 5);
+	uring_reader_ack(&reader, 2);
+	ASSERT_EQ(uring_reader_peek(&reader, &data), 3);
+	ASSERT_MEM_EQ(data, "llo", 3);
+	uring_reader_ack(&reader, 3);
+	ASSERT_EQ(uring_reader_peek(&reader, &data), -1);
+	ASSERT_EQ(errno, EAGAIN);
+
+	close(fds[1]);
+	ASSERT_EQ(wait_process(ring), 0);
+	ASSERT_EQ(uring_reader_peek(&reader, &data), 0);
+
+	uring_reader_stop(&reader);
+	close(fds[0]);
+	uring_free(ring);
+
+	return 0;
+}
+
+int test_uring_reader_order()
+{
+	uring_t* ring = uring_create(4, SLOT_LEN);
+	uring_reader_t reader = {0};
+	char buf[SLOT_LEN / 3];
+	size_t total = 0;
+	int fds[2], status, i;
+	unsigned char expected = 0;
+	ssize_t ret;
+	pid_t pid;
+
+	ASSERT_NEQ(ring, NULL);
+	ASSERT_EQ(pipe(fds), 0);
+
+	if ((pid = fork()) == 0) {
+		char out[SLOT_LEN * 3];
+		size_t written = 0;
+
+		close(fds[0]);
+		while (written < STREAM_LEN) {
+			for (i = 0; i < (int)sizeof(out); i++)
+				out[i] = (unsigned char)(written + i);
+			if (write(fds[1], out, sizeof(out)) != sizeof(out))
+				_exit(1);
+			written += sizeof(out);
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	ASSERT_EQ(uring_reader_start(ring, &reader, fds[0]), 0);
+
+	/* reads smaller than the buffers so that completed buffers pile up */
+	for (;;) {
+		ret = uring_reader_read(&reader, buf, sizeof(buf));
+		if (ret == 0)
+			break;
+		if (ret == -1) {
+			ASSERT_EQ(errno, EAGAIN);
+			ASSERT_EQ(wait_process(ring), 0);
+			continue;
+		}
+		for (i = 0; i < ret; i++) {
+			ASSERT_EQ((unsigned char)buf[i], expected);
+			expected++;
+		}
+		total += ret;
+	}
+
+	ASSERT_EQ(total >= STREAM_LEN, true);
+	ASSERT_EQ(waitpid(pid, &status, 0), pid);
+	ASSERT_EQ(status, 0);
+
+	uring_reader_stop(&reader);
+	close(fds[0]);
+	uring_free(ring);
+
+	return 0;
+}
+
+int test_uring_reader_stop()
+{
+	uring_t* ring = uring_create(1, SLOT_LEN);
+	uring_reader_t reader1 = {0};
+	uring_reader_t reader2 = {0};
+	int fds[2];
+
+	ASSERT_NEQ(ring, NULL);
+	ASSERT_EQ(pipe(fds), 0);
+	ASSERT_EQ(uring_reader_start(ring, &reader1, fds[0]), 0);
+
+	/* the only buffer is taken */
+	ASSERT_EQ(uring_reader_start(ring, &reader2, fds[0]), 1);
+	ASSERT_EQ(errno, EBUSY);
+
+	/* and it is given back once the read in flight is cancelled */
+	uring_reader_stop(&reader1);
+	ASSERT_EQ(wait_process(ring), 0);
+	ASSERT_EQ(uring_reader_start(ring, &reader2, fds[0]), 0);
+
+	uring_reader_stop(&reader2);
+	close(fds[0]);
+	close(fds[1]);
+	uring_free(ring);
+
+	return 0;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+	test_ctx_t ctx;
+	TEST_INIT(ctx, argc, argv);
+
+#ifdef LOGD_URING
+	uring_t* ring;
+
+	/* kernels without io_uring or where it is disabled by policy */
+	if ((ring = uring_create(1, SLOT_LEN)) == NULL) {
+		perror("uring_create");
+		TEST_RELEASE(ctx);
+	}
+	uring_free(ring);
+
+	TEST_RUN(ctx, test_uring_reader_read);
+	TEST_RUN(ctx, test_uring_reader_peek);
+	TEST_RUN(ctx, test_uring_reader_order);
+	TEST_RUN(ctx, test_uring_reader_stop);
+#endif
+
+	TEST_RELEASE(ctx);
+}
@@ -68,6 +68,17 @@ int test_exp_backoff()
 	return 0;
 }
 
+int test_parse_non_negative_llong()
+{
+	ASSERT_EQ(parse_non_negative_llong("0"), 0);
+	ASSERT_EQ(parse_non_negative_llong("21474836480"), 21474836480LL);
+	ASSERT_EQ(parse_non_negative_llong("-1"), -1);
+	ASSERT_EQ(parse_non_negative_llong("12a"), -1);
+	ASSERT_EQ(parse_non_negative_llong(""), -1);
+
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	test_ctx_t ctx;
@@ -76,6 +87,7 @@ int main(int argc, char* argv[])
 
 	TEST_RUN(ctx, test_snprintl);
 	TEST_RUN(ctx, test_exp_backoff);
+	TEST_RUN(ctx, test_parse_non_negative_llong);
 
 	TEST_RELEASE(ctx);
 }